@@ -0,0 +1,222 @@
+#include "affinity.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __linux__
+/* Modes of set_mempolicy(2) and mbind(2): no libnuma needed */
+static const int POLICY_PREFERRED  = 1;
+static const int POLICY_INTERLEAVE = 3;
+
+/* Node masks cover this many nodes */
+static const int MAX_NODES = 64;
+#endif
+
+//+----------------------------------------------------------------------------+
+//| Parse CPU list                                                             |
+//+----------------------------------------------------------------------------+
+
+int parseCpuList(const std::string &list, std::vector<int> *cpus) {
+
+    cpus->clear();
+
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        std::string item = list.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        char *end;
+        long first = strtol(item.c_str(), &end, 10);
+        long last  = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        if (item.empty() || *end || first < 0 || last < first)
+            return -1;
+
+        for (long cpu = first; cpu <= last; ++cpu)
+            cpus->push_back(cpu);
+    }
+
+    return cpus->empty() ? -1 : 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Pin calling process                                                        |
+//+----------------------------------------------------------------------------+
+
+int pinProcess(const std::vector<int> &cpus) {
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        if (cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &set);
+    }
+
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        std::cout << "[sched_setaffinity]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+#else
+    printf("[affinity]:\tCPU pinning is not supported on this system\n");
+    return -1;
+#endif
+}
+
+//+----------------------------------------------------------------------------+
+//| CPUs calling process may run on                                            |
+//+----------------------------------------------------------------------------+
+
+int processCpus(std::vector<int> *cpus) {
+
+    cpus->clear();
+
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        std::cout << "[sched_getaffinity]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set))
+            cpus->push_back(cpu);
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+#ifdef __linux__
+//+----------------------------------------------------------------------------+
+//| Nodes named "node<n>" in sysfs directory, as mask                          |
+//+----------------------------------------------------------------------------+
+
+static unsigned long nodeEntries(const std::string &path) {
+
+    unsigned long mask = 0;
+
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        int node;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &node, &tail) == 1 && node >= 0 && node < MAX_NODES)
+            mask |= 1UL << node;
+    }
+    closedir(dir);
+
+    return mask;
+}
+#endif
+
+//+----------------------------------------------------------------------------+
+//| Node of CPU                                                                |
+//+----------------------------------------------------------------------------+
+
+int cpuNode(int cpu) {
+
+#ifdef __linux__
+    unsigned long mask = nodeEntries("/sys/devices/system/cpu/cpu" + std::to_string(cpu));
+    return mask ? __builtin_ctzl(mask) : 0;
+#else
+    return 0;
+#endif
+}
+
+//+----------------------------------------------------------------------------+
+//| Count of NUMA nodes                                                        |
+//+----------------------------------------------------------------------------+
+
+int numaNodes() {
+
+#ifdef __linux__
+    unsigned long mask = nodeEntries("/sys/devices/system/node");
+    return mask ? 64 - __builtin_clzl(mask) : 1;
+#else
+    return 1;
+#endif
+}
+
+//+----------------------------------------------------------------------------+
+//| Spread pages of range over all nodes                                       |
+//+----------------------------------------------------------------------------+
+
+int interleaveMemory(void *addr, size_t len) {
+
+#ifdef __linux__
+    unsigned long mask = nodeEntries("/sys/devices/system/node");
+    if (!mask)
+        return 0;
+
+    if (syscall(SYS_mbind, addr, len, POLICY_INTERLEAVE, &mask, MAX_NODES + 1, 0) == -1) {
+        std::cout << "[mbind]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+#else
+    printf("[affinity]:\tNUMA placement is not supported on this system\n");
+    return -1;
+#endif
+}
+
+//+----------------------------------------------------------------------------+
+//| Put pages of range on node (on others once it is full)                     |
+//+----------------------------------------------------------------------------+
+
+int placeMemory(void *addr, size_t len, int node) {
+
+#ifdef __linux__
+    if (node < 0 || node >= MAX_NODES)
+        return -1;
+
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_mbind, addr, len, POLICY_PREFERRED, &mask, MAX_NODES + 1, 0) == -1) {
+        std::cout << "[mbind]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+#else
+    printf("[affinity]:\tNUMA placement is not supported on this system\n");
+    return -1;
+#endif
+}
+
+//+----------------------------------------------------------------------------+
+//| Spread later allocations of calling process over all nodes                 |
+//+----------------------------------------------------------------------------+
+
+int interleaveProcessMemory() {
+
+#ifdef __linux__
+    unsigned long mask = nodeEntries("/sys/devices/system/node");
+    if (!mask)
+        return 0;
+
+    if (syscall(SYS_set_mempolicy, POLICY_INTERLEAVE, &mask, MAX_NODES + 1) == -1) {
+        std::cout << "[set_mempolicy]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+#else
+    printf("[affinity]:\tNUMA placement is not supported on this system\n");
+    return -1;
+#endif
+}
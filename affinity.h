@@ -0,0 +1,39 @@
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* Placement of segment pages */
+enum {
+    NUMA_DEFAULT = 0,  /* first touch */
+    NUMA_INTERLEAVE,   /* spread over all nodes */
+    NUMA_PARTITION     /* partition on node of its owner's CPU */
+};
+
+//+----------------------------------------------------------------------------+
+//| CPU pinning and NUMA placement (Linux; elsewhere they only report)         |
+//+----------------------------------------------------------------------------+
+
+/* Parse "0-3,8,10-11", returns -1 if list is bad */
+int parseCpuList(const std::string &list, std::vector<int> *cpus);
+
+/* Run calling process on these CPUs only */
+int pinProcess(const std::vector<int> &cpus);
+
+/* CPUs calling process may run on now */
+int processCpus(std::vector<int> *cpus);
+
+/* NUMA node of CPU (0 without NUMA), node count (1 without NUMA) */
+int cpuNode(int cpu);
+int numaNodes();
+
+/* Place pages of range, before anyone touches them */
+int interleaveMemory(void *addr, size_t len);
+int placeMemory(void *addr, size_t len, int node);
+
+/* Placement of memory the calling process allocates from now on */
+int interleaveProcessMemory();
+
+#endif /* __AFFINITY_H__ */
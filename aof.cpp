@@ -0,0 +1,328 @@
+#include "aof.h"
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+//+----------------------------------------------------------------------------+
+//| Write whole buffer                                                         |
+//+----------------------------------------------------------------------------+
+
+static int writeAll(int fd, const char *data, size_t size) {
+
+    size_t done = 0;
+    while (done < size) {
+        ssize_t len = write(fd, data + done, size - done);
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            std::cout << "[write]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+        done += len;
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Take next sequence number (partition owners log concurrently)              |
+//+----------------------------------------------------------------------------+
+
+static uint64_t nextSequence(SegmentHeader *hdr) {
+
+    return __atomic_add_fetch(&hdr->aofSequence, 1, __ATOMIC_RELAXED);
+}
+
+//+----------------------------------------------------------------------------+
+//| Append-only log destructor                                                 |
+//+----------------------------------------------------------------------------+
+
+AppendLog::~AppendLog() {
+
+    if (fd != -1)
+        close(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Open current log file                                                      |
+//+----------------------------------------------------------------------------+
+
+int AppendLog::reopen(uint64_t gen) {
+
+    if (fd != -1)
+        close(fd);
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    generation = gen;
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Buffer set record                                                          |
+//+----------------------------------------------------------------------------+
+
+void AppendLog::logSet(SegmentHeader *hdr, int ttl, std::string key, std::string value) {
+
+    /* Absolute expiry keeps TTLs right no matter when the log is replayed */
+    long long expireAt = static_cast<long long>(time(nullptr)) + ttl;
+
+    buffer.append(std::to_string(nextSequence(hdr)));
+    buffer.append(" set ");
+    buffer.append(std::to_string(expireAt));
+    buffer.append(" ");
+    buffer.append(key);
+    buffer.append(" ");
+    buffer.append(value);
+    buffer.append("\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Buffer delete record                                                       |
+//+----------------------------------------------------------------------------+
+
+void AppendLog::logRemove(SegmentHeader *hdr, std::string key) {
+
+    buffer.append(std::to_string(nextSequence(hdr)));
+    buffer.append(" del ");
+    buffer.append(key);
+    buffer.append("\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Group commit                                                               |
+//+----------------------------------------------------------------------------+
+
+int AppendLog::commit(SegmentHeader *hdr, sem_t *semaphore, int partition) {
+
+    if (buffer.empty())
+        return 0;
+
+    /* Write under the lock so a concurrent rewrite can't lose the batch
+       (rewrite takes every partition, so owners only need their own) */
+    if (partition >= 0) {
+        shmLock(&hdr->partitionLocks[partition]);
+    } else if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Owners append concurrently and a torn batch may end the file:
+       every batch starts on a new line */
+    int result = 0;
+    if (fd == -1 || generation != hdr->aofGeneration || failed)
+        result = reopen(hdr->aofGeneration);
+    if (result == 0 && (failed || partition >= 0))
+        result = writeAll(fd, "\n", 1);
+    if (result == 0)
+        result = writeAll(fd, buffer.data(), buffer.size());
+
+    if (partition >= 0)
+        shmUnlock(&hdr->partitionLocks[partition]);
+    else if (sem_post(semaphore) == -1)
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+
+    /* One fsync covers every record of the batch */
+    if (result == 0 && fsync(fd) == -1) {
+        std::cout << "[fsync]:\t" << strerror(errno) << std::endl;
+        result = -1;
+    }
+
+    /* Pages of a failed fsync may be dropped: the whole batch is written again */
+    failed = (result == -1);
+    if (!failed)
+        buffer.clear();
+    return result;
+}
+
+//+----------------------------------------------------------------------------+
+//| Replay log into table                                                      |
+//+----------------------------------------------------------------------------+
+
+struct LogRecord {
+    uint64_t    seq;
+    bool        remove;
+    long long   expireAt;
+    std::string key;
+    std::string value;
+
+    bool operator<(const LogRecord &other) const { return seq < other.seq; }
+};
+
+int AppendLog::replay(std::string path, CHashTable *hTable, SegmentHeader *hdr) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        if (errno != ENOENT)
+            std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Read whole log */
+    std::string data;
+    char buf[64 * 1024];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, len);
+    close(fd);
+    if (len == -1) {
+        std::cout << "[read]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Parse complete lines; a torn tail from a crash is ignored */
+    std::vector<LogRecord> records;
+    size_t   bad = 0;
+    size_t   pos = 0;
+    uint64_t maxSeq = hdr->aofSequence;
+
+    for (size_t nl = data.find('\n'); nl != std::string::npos; nl = data.find('\n', pos)) {
+        std::string line = data.substr(pos, nl - pos);
+        pos = nl + 1;
+        if (line.empty())
+            continue;
+
+        char op[4], key[256], value[1024];
+        unsigned long long seq;
+        long long expireAt;
+        LogRecord rec;
+
+        if (sscanf(line.c_str(), "%llu set %lld %255s %1023s", &seq, &expireAt, key, value) == 4) {
+            rec.remove   = false;
+            rec.expireAt = expireAt;
+            rec.value    = value;
+        } else if (sscanf(line.c_str(), "%llu %3s %255s", &seq, op, key) == 3 &&
+                   strcmp(op, "del") == 0) {
+            rec.remove   = true;
+            rec.expireAt = 0;
+        } else {
+            ++bad;
+            continue;
+        }
+        rec.seq = seq;
+        rec.key = key;
+        records.push_back(rec);
+        maxSeq = std::max<uint64_t>(maxSeq, seq);
+    }
+
+    /* Apply in table order */
+    std::stable_sort(records.begin(), records.end());
+    long long now = time(nullptr);
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        const LogRecord &rec = records[i];
+        if (rec.remove || rec.expireAt <= now)
+            hTable->remove(rec.key);
+        else
+            hTable->put(static_cast<int>(rec.expireAt - now), rec.key, rec.value);
+    }
+
+    hdr->aofSequence = maxSeq;
+    printf("[aof]:\t\treplayed %lu records from %s (%lu skipped)\n",
+           records.size(), path.c_str(), bad);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Rewrite log from table contents                                            |
+//+----------------------------------------------------------------------------+
+
+off_t AppendLog::rewrite(std::string path, CHashTable *hTable, SegmentHeader *hdr,
+                         sem_t *semaphore) {
+
+    std::string tmpPath = path + ".rewrite";
+    std::string image;
+    struct stat st;
+    off_t       offset;
+
+    /* Capture live entries and the log position they correspond to */
+    if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    lockPartitions(hdr);
+    offset = (stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+    std::string seq = std::to_string(hdr->aofSequence);
+    long long   now = time(nullptr);
+
+    std::string key, value;
+    int ttl;
+    for (size_t i = 0; i < hTable->getTableSize(); ++i) {
+        if (!hTable->readEntry(i, &key, &value, &ttl))
+            continue;
+        image.append(seq);
+        image.append(" set ");
+        image.append(std::to_string(now + ttl));
+        image.append(" ");
+        image.append(key);
+        image.append(" ");
+        image.append(value);
+        image.append("\n");
+    }
+    unlockPartitions(hdr);
+
+    if (sem_post(semaphore) == -1) {
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Write compacted log without holding the lock */
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (writeAll(fd, image.data(), image.size()) == -1 || fsync(fd) == -1) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+
+    /* Append what workers committed meanwhile and switch files */
+    if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+    lockPartitions(hdr);
+
+    int result = 0;
+    int src = open(path.c_str(), O_RDONLY);
+    if (src != -1) {
+        char buf[64 * 1024];
+        ssize_t len;
+        if (lseek(src, offset, SEEK_SET) == -1)
+            result = -1;
+        while (result == 0 && (len = read(src, buf, sizeof(buf))) > 0)
+            result = writeAll(fd, buf, len);
+        close(src);
+    }
+    if (result == 0 && fsync(fd) == -1)
+        result = -1;
+    if (result == 0 && rename(tmpPath.c_str(), path.c_str()) == -1) {
+        std::cout << "[rename]:\t" << strerror(errno) << std::endl;
+        result = -1;
+    }
+    if (result == 0) {
+        /* Workers reopen the log on their next commit */
+        hdr->aofGeneration++;
+    }
+    unlockPartitions(hdr);
+
+    if (sem_post(semaphore) == -1)
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+
+    off_t size = (result == 0 && fstat(fd, &st) == 0) ? st.st_size : -1;
+    close(fd);
+    if (result == -1)
+        unlink(tmpPath.c_str());
+
+    return size;
+}
@@ -0,0 +1,50 @@
+#ifndef __AOF_H__
+#define __AOF_H__
+
+#include "htable.h"
+#include "segment.h"
+#include <semaphore.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+
+//+----------------------------------------------------------------------------+
+//| Append-only mutation log                                                   |
+//|                                                                            |
+//| Every worker buffers records and writes them in batches (group commit).    |
+//| Records carry a global sequence number taken under the table lock, so      |
+//| replay restores the order in which mutations hit the table.                |
+//| Format: "<seq> set <expireAt> <key> <value>\n" or "<seq> del <key>\n".     |
+//+----------------------------------------------------------------------------+
+
+class AppendLog {
+    std::string path;
+    int         fd;
+    uint64_t    generation;
+    std::string buffer;
+    bool        failed;
+
+    int reopen(uint64_t gen);
+
+public:
+    AppendLog(std::string path) : path(path), fd(-1), generation(0), failed(false) {}
+    ~AppendLog();
+
+    /* Buffer record (caller holds the table lock) */
+    void logSet(SegmentHeader *hdr, int ttl, std::string key, std::string value);
+    void logRemove(SegmentHeader *hdr, std::string key);
+    bool empty() const { return buffer.empty(); }
+
+    /* Write buffered records and fsync them (failed batch stays buffered);
+       partition owners pass their partition to lock instead of the table */
+    int  commit(SegmentHeader *hdr, sem_t *semaphore, int partition = -1);
+
+    /* Load log into table at startup */
+    static int   replay(std::string path, CHashTable *hTable, SegmentHeader *hdr);
+
+    /* Replace log with live table contents, returns new size */
+    static off_t rewrite(std::string path, CHashTable *hTable, SegmentHeader *hdr,
+                         sem_t *semaphore);
+};
+
+#endif /* __AOF_H__ */
@@ -0,0 +1,582 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int BUF_SIZE = 64 * 1024;
+
+/* Histogram: 2^SUB_BITS linear sub-buckets per power of two (~3% error) */
+static const int SUB_BITS    = 5;
+static const int SUB_BUCKETS = 1 << SUB_BITS;
+static const int MAGNITUDES  = 64 - SUB_BITS;
+
+//+----------------------------------------------------------------------------+
+//| Benchmark parameters                                                       |
+//+----------------------------------------------------------------------------+
+
+struct BenchConfig {
+    std::string host;
+    uint16_t    port;
+    std::string unixPath;    /* local socket instead of TCP if set */
+    int         connections;
+    int         threads;
+    int         pipeline;
+    double      duration;
+    double      warmup;
+    double      rate;        /* requests per second over all connections, 0 = closed loop */
+    double      getRatio;
+    long        keys;
+    int         valueMin;
+    int         valueMax;
+    int         ttl;
+    bool        zipf;
+    double      zipfS;
+    bool        preload;
+
+    BenchConfig()
+        : host("127.0.0.1"), port(8080), connections(50), threads(4), pipeline(1),
+          duration(10), warmup(1), rate(0), getRatio(0.9), keys(100000),
+          valueMin(16), valueMax(64), ttl(3600), zipf(false), zipfS(0.99),
+          preload(false) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Monotonic time in nanoseconds                                              |
+//+----------------------------------------------------------------------------+
+
+static uint64_t nowNs() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+//+----------------------------------------------------------------------------+
+//| Log-linear latency histogram                                               |
+//+----------------------------------------------------------------------------+
+
+class Histogram {
+    std::vector<uint64_t> counts;
+    uint64_t              total;
+    uint64_t              maxValue;
+
+    static size_t index(uint64_t value) {
+        if (value < SUB_BUCKETS)
+            return value;
+        int magnitude = 63 - __builtin_clzll(value) - SUB_BITS + 1;
+        return magnitude * SUB_BUCKETS + ((value >> magnitude) & (SUB_BUCKETS - 1));
+    }
+
+    /* Largest value of bucket: sub keeps its top bit above magnitude 0 */
+    static uint64_t upper(size_t i) {
+        size_t magnitude = i / SUB_BUCKETS;
+        uint64_t sub = i % SUB_BUCKETS;
+        if (magnitude == 0)
+            return sub;
+        return ((sub + 1) << magnitude) - 1;
+    }
+
+public:
+    Histogram() : counts((MAGNITUDES + 1) * SUB_BUCKETS, 0), total(0), maxValue(0) {}
+
+    void record(uint64_t value) {
+        counts[index(value)]++;
+        total++;
+        maxValue = std::max(maxValue, value);
+    }
+
+    void merge(const Histogram &other) {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max()   const { return maxValue; }
+
+    uint64_t percentile(double p) const {
+        if (!total)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= std::max<uint64_t>(rank, 1))
+                return std::min(upper(i), maxValue);
+        }
+        return maxValue;
+    }
+};
+
+//+----------------------------------------------------------------------------+
+//| Key popularity                                                             |
+//+----------------------------------------------------------------------------+
+
+class KeyChooser {
+    long                keys;
+    std::vector<double> cdf;   /* Zipf only */
+
+public:
+    KeyChooser(long keys, bool zipf, double s) : keys(keys) {
+        if (!zipf)
+            return;
+        cdf.resize(keys);
+        double sum = 0;
+        for (long i = 0; i < keys; ++i) {
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cdf[i] = sum;
+        }
+        for (long i = 0; i < keys; ++i)
+            cdf[i] /= sum;
+    }
+
+    long next(std::mt19937_64 &rng) const {
+        if (cdf.empty())
+            return std::uniform_int_distribution<long>(0, keys - 1)(rng);
+
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        long rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+
+        /* Scatter popular ranks over the key space */
+        return static_cast<long>((static_cast<uint64_t>(std::min(rank, keys - 1)) *
+                                  0x9e3779b97f4a7c15ULL) % keys);
+    }
+};
+
+//+----------------------------------------------------------------------------+
+//| Connection state                                                           |
+//+----------------------------------------------------------------------------+
+
+struct Conn {
+    int                  fd;
+    std::string          outBuf;
+    std::deque<uint64_t> intended;   /* start times of requests in flight */
+    uint64_t             nextSend;
+    std::string          line;       /* partial reply line */
+};
+
+//+----------------------------------------------------------------------------+
+//| Results of one thread                                                      |
+//+----------------------------------------------------------------------------+
+
+struct ThreadResult {
+    Histogram latency;
+    uint64_t  requests;
+    uint64_t  errors;
+    uint64_t  misses;
+
+    ThreadResult() : requests(0), errors(0), misses(0) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Connect to server                                                          |
+//+----------------------------------------------------------------------------+
+
+static int connectServer(const BenchConfig &config) {
+
+    if (!config.unixPath.empty()) {
+        struct sockaddr_un uAddr;
+        memset(&uAddr, 0, sizeof(uAddr));
+        uAddr.sun_family = AF_UNIX;
+        strncpy(uAddr.sun_path, config.unixPath.c_str(), sizeof(uAddr.sun_path) - 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&uAddr, sizeof(uAddr)) == -1) {
+            std::cout << "[connect]:\t" << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct sockaddr_in sAddr;
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port   = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &(sAddr.sin_addr)) != 1) {
+        printf("[bench]:\tIP address is not parseable\n");
+        close(fd);
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[connect]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    return fd;
+}
+
+//+----------------------------------------------------------------------------+
+//| Build one request                                                          |
+//+----------------------------------------------------------------------------+
+
+static void addRequest(std::string *out, const BenchConfig &config, const KeyChooser &chooser,
+                       std::mt19937_64 &rng) {
+
+    long key = chooser.next(rng);
+    bool get = std::uniform_real_distribution<double>(0.0, 1.0)(rng) < config.getRatio;
+
+    if (get) {
+        out->append("get k");
+        out->append(std::to_string(key));
+        out->append("\n");
+        return;
+    }
+
+    int size = std::uniform_int_distribution<int>(config.valueMin, config.valueMax)(rng);
+    out->append("set ");
+    out->append(std::to_string(config.ttl));
+    out->append(" k");
+    out->append(std::to_string(key));
+    out->append(" ");
+    out->append(size, 'v');
+    out->append("\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Consume replies: one line per request (server ends batches with '\0')      |
+//+----------------------------------------------------------------------------+
+
+static void readReplies(Conn *conn, const char *data, size_t len, uint64_t now,
+                        uint64_t measureFrom, ThreadResult *result) {
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (c == '\0')
+            continue;
+        if (c != '\n') {
+            if (conn->line.size() < 32)
+                conn->line.push_back(c);
+            continue;
+        }
+
+        if (!conn->intended.empty()) {
+            uint64_t start = conn->intended.front();
+            conn->intended.pop_front();
+
+            if (start >= measureFrom) {
+                result->latency.record(now - start);
+                result->requests++;
+                if (conn->line.compare(0, 25, "error (key doesn't exist)") == 0)
+                    result->misses++;
+                else if (conn->line.compare(0, 5, "error") == 0)
+                    result->errors++;
+            }
+        }
+        conn->line.clear();
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Drive connections of one thread                                            |
+//+----------------------------------------------------------------------------+
+
+static void runThread(const BenchConfig &config, const KeyChooser &chooser, int id,
+                      std::vector<int> fds, uint64_t begin, ThreadResult *result) {
+
+    std::mt19937_64 rng(0x5eed + id);
+    std::vector<Conn> conns(fds.size());
+    std::vector<struct pollfd> pfds(fds.size());
+
+    /* Open loop: every connection gets an equal share of the rate */
+    uint64_t interval = config.rate > 0
+        ? static_cast<uint64_t>(1e9 * config.connections / config.rate) : 0;
+
+    for (size_t i = 0; i < conns.size(); ++i) {
+        conns[i].fd = fds[i];
+        conns[i].nextSend = begin + (interval ? interval * i / conns.size() : 0);
+        pfds[i].fd = fds[i];
+    }
+
+    uint64_t measureFrom = begin + static_cast<uint64_t>(config.warmup * 1e9);
+    uint64_t end         = measureFrom + static_cast<uint64_t>(config.duration * 1e9);
+    char     buf[BUF_SIZE];
+
+    for (uint64_t now = nowNs(); now < end; now = nowNs()) {
+        uint64_t wake = end;
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            Conn &conn = conns[i];
+
+            /* Latency counts from when a request should have been sent */
+            while (conn.intended.size() < static_cast<size_t>(config.pipeline) &&
+                   (!interval || conn.nextSend <= now)) {
+                addRequest(&conn.outBuf, config, chooser, rng);
+                conn.intended.push_back(interval ? conn.nextSend : now);
+                conn.nextSend += interval;
+            }
+            if (interval)
+                wake = std::min(wake, conn.nextSend);
+
+            if (!conn.outBuf.empty()) {
+                ssize_t sent = send(conn.fd, conn.outBuf.data(), conn.outBuf.size(), MSG_DONTWAIT);
+                if (sent > 0)
+                    conn.outBuf.erase(0, sent);
+                else if (sent == -1 && errno != EAGAIN && errno != EINTR) {
+                    std::cout << "[send]:\t" << strerror(errno) << std::endl;
+                    return;
+                }
+            }
+
+            pfds[i].events = POLLIN | (conn.outBuf.empty() ? 0 : POLLOUT);
+        }
+
+        /* Round down: spin on the last millisecond rather than send late */
+        int timeout = 100;
+        if (interval)
+            timeout = wake > now ? static_cast<int>((wake - now) / 1000000) : 0;
+
+        if (poll(pfds.data(), pfds.size(), timeout) <= 0)
+            continue;
+
+        now = nowNs();
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (!(pfds[i].revents & (POLLIN | POLLERR | POLLHUP)))
+                continue;
+
+            ssize_t len = recv(conns[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (len == 0 || (len == -1 && errno != EAGAIN && errno != EINTR)) {
+                printf("[bench]:\tconnection closed by server\n");
+                return;
+            }
+            if (len > 0)
+                readReplies(&conns[i], buf, len, now, measureFrom, result);
+        }
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Fill every key once so gets hit                                            |
+//+----------------------------------------------------------------------------+
+
+static int preload(const BenchConfig &config) {
+
+    int fd = connectServer(config);
+    if (fd == -1)
+        return -1;
+
+    std::string batch;
+    std::string value(config.valueMin, 'v');
+    char buf[BUF_SIZE];
+
+    for (long key = 0; key < config.keys; key += 100) {
+        long last = std::min(config.keys, key + 100);
+        batch.clear();
+        for (long k = key; k < last; ++k)
+            batch += "set " + std::to_string(config.ttl) + " k" + std::to_string(k) + " " + value + "\n";
+        if (send(fd, batch.data(), batch.size(), 0) != static_cast<ssize_t>(batch.size()))
+            break;
+
+        /* Wait for every reply of the batch */
+        long replies = 0;
+        while (replies < last - key) {
+            ssize_t len = recv(fd, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                close(fd);
+                return -1;
+            }
+            replies += std::count(buf, buf + len, '\n');
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Print usage                                                                |
+//+----------------------------------------------------------------------------+
+
+static void usage(const char *name) {
+
+    BenchConfig d;
+    printf("usage: %s [options]\n", name);
+    printf("  --host <addr>          server address (default %s)\n", d.host.c_str());
+    printf("  --port <port>          server port (default %d)\n", d.port);
+    printf("  --unix <path>          connect to unix socket instead\n");
+    printf("  --connections <n>      connections (default %d)\n", d.connections);
+    printf("  --threads <n>          client threads (default %d)\n", d.threads);
+    printf("  --pipeline <n>         requests in flight per connection (default %d)\n", d.pipeline);
+    printf("  --duration <sec>       measured time (default %.0f)\n", d.duration);
+    printf("  --warmup <sec>         unmeasured time before it (default %.0f)\n", d.warmup);
+    printf("  --rate <req/s>         open loop at fixed total rate (default: closed loop)\n");
+    printf("  --get-ratio <0..1>     share of gets (default %.2f)\n", d.getRatio);
+    printf("  --keys <n>             key count (default %ld)\n", d.keys);
+    printf("  --value-size <a[-b]>   value size range (default %d-%d)\n", d.valueMin, d.valueMax);
+    printf("  --ttl <sec>            TTL of sets (default %d)\n", d.ttl);
+    printf("  --zipf <s>             Zipfian keys with exponent s (default uniform)\n");
+    printf("  --preload              set every key before measuring\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse command line                                                         |
+//+----------------------------------------------------------------------------+
+
+static int parseArgs(int argc, char *argv[], BenchConfig *config) {
+
+    enum {
+        OPT_HOST = 1, OPT_PORT, OPT_UNIX, OPT_CONNECTIONS, OPT_THREADS, OPT_PIPELINE,
+        OPT_DURATION, OPT_WARMUP, OPT_RATE, OPT_GET_RATIO, OPT_KEYS,
+        OPT_VALUE_SIZE, OPT_TTL, OPT_ZIPF, OPT_PRELOAD
+    };
+
+    static struct option options[] = {
+        { "host",        required_argument, nullptr, OPT_HOST        },
+        { "port",        required_argument, nullptr, OPT_PORT        },
+        { "unix",        required_argument, nullptr, OPT_UNIX        },
+        { "connections", required_argument, nullptr, OPT_CONNECTIONS },
+        { "threads",     required_argument, nullptr, OPT_THREADS     },
+        { "pipeline",    required_argument, nullptr, OPT_PIPELINE    },
+        { "duration",    required_argument, nullptr, OPT_DURATION    },
+        { "warmup",      required_argument, nullptr, OPT_WARMUP      },
+        { "rate",        required_argument, nullptr, OPT_RATE        },
+        { "get-ratio",   required_argument, nullptr, OPT_GET_RATIO   },
+        { "keys",        required_argument, nullptr, OPT_KEYS        },
+        { "value-size",  required_argument, nullptr, OPT_VALUE_SIZE  },
+        { "ttl",         required_argument, nullptr, OPT_TTL         },
+        { "zipf",        required_argument, nullptr, OPT_ZIPF        },
+        { "preload",     no_argument,       nullptr, OPT_PRELOAD     },
+        { nullptr,       0,                 nullptr, 0               }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_HOST:        config->host = optarg;               break;
+        case OPT_PORT:        config->port = atoi(optarg);         break;
+        case OPT_UNIX:        config->unixPath = optarg;           break;
+        case OPT_CONNECTIONS: config->connections = atoi(optarg);  break;
+        case OPT_THREADS:     config->threads = atoi(optarg);      break;
+        case OPT_PIPELINE:    config->pipeline = atoi(optarg);     break;
+        case OPT_DURATION:    config->duration = atof(optarg);     break;
+        case OPT_WARMUP:      config->warmup = atof(optarg);       break;
+        case OPT_RATE:        config->rate = atof(optarg);         break;
+        case OPT_GET_RATIO:   config->getRatio = atof(optarg);     break;
+        case OPT_KEYS:        config->keys = atol(optarg);         break;
+        case OPT_TTL:         config->ttl = atoi(optarg);          break;
+        case OPT_PRELOAD:     config->preload = true;              break;
+        case OPT_ZIPF:
+            config->zipf  = true;
+            config->zipfS = atof(optarg);
+            break;
+        case OPT_VALUE_SIZE:
+            if (sscanf(optarg, "%d-%d", &config->valueMin, &config->valueMax) == 1)
+                config->valueMax = config->valueMin;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (config->connections <= 0 || config->threads <= 0 || config->pipeline <= 0 ||
+        config->duration <= 0 || config->warmup < 0 || config->rate < 0 ||
+        config->getRatio < 0 || config->getRatio > 1 || config->keys <= 0 ||
+        config->valueMin <= 0 || config->valueMax < config->valueMin || config->ttl <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    config->threads = std::min(config->threads, config->connections);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Main benchmark function                                                    |
+//+----------------------------------------------------------------------------+
+
+int main(int argc, char *argv[]) {
+
+    BenchConfig config;
+    if (parseArgs(argc, argv, &config) == -1)
+        return 1;
+
+    if (config.preload && preload(config) == -1) {
+        printf("[bench]:\tpreload failed\n");
+        return 1;
+    }
+
+    KeyChooser chooser(config.keys, config.zipf, config.zipfS);
+
+    /* Connect everything before the clock starts */
+    std::vector<std::vector<int>> fds(config.threads);
+    for (int i = 0; i < config.connections; ++i) {
+        int fd = connectServer(config);
+        if (fd == -1)
+            return 1;
+        fds[i % config.threads].push_back(fd);
+    }
+
+    uint64_t begin = nowNs();
+    std::vector<ThreadResult> results(config.threads);
+    std::vector<std::thread>  threads;
+    for (int i = 0; i < config.threads; ++i)
+        threads.push_back(std::thread(runThread, std::cref(config), std::cref(chooser), i,
+                                      fds[i], begin, &results[i]));
+
+    ThreadResult total;
+    for (int i = 0; i < config.threads; ++i) {
+        threads[i].join();
+        total.latency.merge(results[i].latency);
+        total.requests += results[i].requests;
+        total.errors   += results[i].errors;
+        total.misses   += results[i].misses;
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+        for (size_t j = 0; j < fds[i].size(); ++j)
+            close(fds[i][j]);
+
+    /* Report */
+    printf("connections %d, threads %d, pipeline %d, get ratio %.2f, keys %ld (%s)\n",
+           config.connections, config.threads, config.pipeline, config.getRatio, config.keys,
+           config.zipf ? "zipf" : "uniform");
+    if (config.rate > 0)
+        printf("open loop at %.0f req/s: latency counts from intended send time\n", config.rate);
+    else
+        printf("closed loop: latency counts from actual send time\n");
+
+    printf("requests %llu in %.1f s: %.0f req/s, misses %llu, errors %llu\n",
+           (unsigned long long)total.requests, config.duration, total.requests / config.duration,
+           (unsigned long long)total.misses, (unsigned long long)total.errors);
+
+    const double points[] = { 50, 75, 90, 95, 99, 99.9, 99.99, 99.999 };
+    printf("latency (us):\n");
+    for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); ++i)
+        printf("  p%-8g %12.1f\n", points[i], total.latency.percentile(points[i]) / 1000.0);
+    printf("  max       %12.1f\n", total.latency.max() / 1000.0);
+
+    return 0;
+}
@@ -0,0 +1,476 @@
+#include "compress.h"
+#include "htable.h"
+#include "snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//+----------------------------------------------------------------------------+
+//| Loader parameters                                                          |
+//+----------------------------------------------------------------------------+
+
+struct LoadConfig {
+    std::string output;
+    size_t      partitions;
+    size_t      threads;
+    int         ttl;
+    size_t      compressThreshold;
+    std::vector<std::string> inputs;
+
+    LoadConfig()
+        : partitions(1), threads(std::max(1U, std::thread::hardware_concurrency())),
+          ttl(3600), compressThreshold(0) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Parsed record (ttl <= 0 removes key)                                       |
+//+----------------------------------------------------------------------------+
+
+struct LoadRecord {
+    size_t      file;
+    uint64_t    order;     /* sequence of AOF records, offset of other lines */
+    std::string key;
+    std::string value;
+    int         ttl;
+
+    bool operator<(const LoadRecord &other) const {
+        return file != other.file ? file < other.file : order < other.order;
+    }
+};
+
+//+----------------------------------------------------------------------------+
+//| Lines of one input given to one parser thread                              |
+//+----------------------------------------------------------------------------+
+
+struct LoadChunk {
+    size_t      file;
+    const char  *data;
+    size_t      begin;
+    size_t      end;
+
+    /* Records by partition, in input order */
+    std::vector<std::vector<LoadRecord>> buckets;
+    size_t      records;
+    size_t      bad;
+};
+
+//+----------------------------------------------------------------------------+
+//| Totals of insert threads                                                   |
+//+----------------------------------------------------------------------------+
+
+struct LoadResult {
+    size_t stored;
+    size_t removed;
+    size_t noSpace;
+    size_t tooBig;
+
+    LoadResult() : stored(0), removed(0), noSpace(0), tooBig(0) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Position of field value in JSONL record                                    |
+//+----------------------------------------------------------------------------+
+
+static size_t jsonField(const std::string &line, const char *name) {
+
+    size_t pos = line.find(std::string("\"") + name + "\"");
+    if (pos == std::string::npos)
+        return std::string::npos;
+
+    pos = line.find_first_not_of(" \t", pos + strlen(name) + 2);
+    if (pos == std::string::npos || line[pos] != ':')
+        return std::string::npos;
+
+    return line.find_first_not_of(" \t", pos + 1);
+}
+
+//+----------------------------------------------------------------------------+
+//| String field of JSONL record                                               |
+//+----------------------------------------------------------------------------+
+
+static bool jsonString(const std::string &line, const char *name, std::string *out) {
+
+    size_t pos = jsonField(line, name);
+    if (pos == std::string::npos || line[pos] != '"')
+        return false;
+
+    out->clear();
+    for (size_t i = pos + 1; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '"')
+            return true;
+        if (c != '\\') {
+            out->push_back(c);
+            continue;
+        }
+        if (++i == line.size())
+            return false;
+        switch (line[i]) {
+        case 'n': out->push_back('\n'); break;
+        case 'r': out->push_back('\r'); break;
+        case 't': out->push_back('\t'); break;
+        case 'u':
+            if (i + 4 >= line.size())
+                return false;
+            out->push_back(static_cast<char>(strtol(line.substr(i + 1, 4).c_str(), nullptr, 16)));
+            i += 4;
+            break;
+        default:
+            out->push_back(line[i]);
+        }
+    }
+
+    return false;
+}
+
+//+----------------------------------------------------------------------------+
+//| Protocol token: no separators, no terminator                               |
+//+----------------------------------------------------------------------------+
+
+static bool validToken(const std::string &s) {
+
+    return !s.empty() && s.find_first_of(std::string(" \t\r\n\0", 5)) == std::string::npos;
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse "set <ttl> <key> <value>", AOF record or JSONL record                |
+//+----------------------------------------------------------------------------+
+
+static bool parseRecord(const std::string &line, const LoadConfig &config, time_t now,
+                        LoadRecord *rec) {
+
+    std::string text = line;
+    if (!line.empty() && line[0] == '{') {
+        /* Request trace: the query is a protocol line */
+        if (!jsonString(line, "query", &text)) {
+            if (!jsonString(line, "key", &rec->key) || !jsonString(line, "value", &rec->value))
+                return false;
+            size_t pos = jsonField(line, "ttl");
+            rec->ttl = (pos == std::string::npos) ? config.ttl : atoi(line.c_str() + pos);
+            return validToken(rec->key) && validToken(rec->value);
+        }
+    }
+
+    std::vector<std::string> args;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t space = text.find(' ', pos);
+        if (space == std::string::npos)
+            space = text.size();
+        if (space > pos)
+            args.push_back(text.substr(pos, space - pos));
+        pos = space + 1;
+    }
+
+    if (args.size() == 4 && args[0] == "set") {
+        rec->ttl   = atoi(args[1].c_str());
+        rec->key   = args[2];
+        rec->value = args[3];
+        return rec->ttl > 0;
+    }
+
+    /* Append-only log: "<seq> set <expireAt> <key> <value>" or "<seq> del <key>" */
+    char *end;
+    uint64_t seq = strtoull(args.empty() ? "" : args[0].c_str(), &end, 10);
+    if (args.empty() || *end)
+        return false;
+
+    if (args.size() == 5 && args[1] == "set") {
+        long long expireAt = atoll(args[2].c_str());
+        rec->order = seq;
+        rec->ttl   = expireAt > now ? static_cast<int>(expireAt - now) : 0;
+        rec->key   = args[3];
+        rec->value = args[4];
+        return true;
+    }
+    if (args.size() == 3 && args[1] == "del") {
+        rec->order = seq;
+        rec->ttl   = 0;
+        rec->key   = args[2];
+        return true;
+    }
+
+    return false;
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse lines of chunk into per-partition buckets (parser thread)            |
+//+----------------------------------------------------------------------------+
+
+static void parseChunk(LoadChunk *chunk, const LoadConfig &config, const CHashTable &geometry,
+                       time_t now) {
+
+    chunk->buckets.assign(config.partitions, std::vector<LoadRecord>());
+    chunk->records = 0;
+    chunk->bad     = 0;
+
+    size_t pos = chunk->begin;
+    while (pos < chunk->end) {
+        const char *nl = static_cast<const char *>(memchr(chunk->data + pos, '\n', chunk->end - pos));
+        size_t lineEnd = nl ? nl - chunk->data : chunk->end;
+        std::string line(chunk->data + pos, lineEnd - pos);
+
+        LoadRecord rec;
+        rec.file  = chunk->file;
+        rec.order = pos;
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        if (line.empty()) {
+            /* Nothing */
+        } else if (!parseRecord(line, config, now, &rec)) {
+            chunk->bad++;
+        } else {
+            /* Codec work is spread over parser threads too */
+            if (config.compressThreshold && rec.value.size() >= config.compressThreshold &&
+                rec.value.size() <= MAX_RAW_VALUE)
+                rec.value = compressValue(rec.value);
+
+            chunk->buckets[geometry.partitionOf(rec.key)].push_back(rec);
+            chunk->records++;
+        }
+
+        pos = lineEnd + 1;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Insert records of partition into image (insert thread)                     |
+//+----------------------------------------------------------------------------+
+
+static void fillPartition(size_t p, std::vector<LoadChunk> &chunks, const LoadConfig &config,
+                          char *image, LoadResult *result) {
+
+    /* Own view of the image: partitions share no slots, so no locking */
+    CHashTable table;
+    table.allocate(image);
+    if (config.partitions > 1)
+        table.setPartitions(config.partitions);
+
+    std::vector<LoadRecord> records;
+    for (size_t c = 0; c < chunks.size(); ++c)
+        records.insert(records.end(), chunks[c].buckets[p].begin(), chunks[c].buckets[p].end());
+
+    /* Later records win; log records go by their sequence */
+    std::stable_sort(records.begin(), records.end());
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        const LoadRecord &rec = records[i];
+        if (rec.ttl <= 0) {
+            if (table.remove(rec.key) == HT_OK)
+                result->removed++;
+            continue;
+        }
+
+        switch (table.put(rec.ttl, rec.key, rec.value)) {
+        case HT_OK:
+            result->stored++;
+            break;
+        case HT_NO_SPACE:
+            result->noSpace++;
+            break;
+        default:
+            result->tooBig++;
+            break;
+        }
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Map input file                                                             |
+//+----------------------------------------------------------------------------+
+
+static const char *mapInput(const std::string &path, size_t *size) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        std::cout << "[fstat]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    *size = st.st_size;
+    if (*size == 0) {
+        close(fd);
+        return "";
+    }
+
+    void *data = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "[mmap]:\t" << strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    return static_cast<const char *>(data);
+}
+
+//+----------------------------------------------------------------------------+
+//| Print usage                                                                |
+//+----------------------------------------------------------------------------+
+
+static void usage(const char *name) {
+
+    LoadConfig d;
+    printf("usage: %s [options] --output <image> <input>...\n", name);
+    printf("  inputs hold lines \"set <ttl> <key> <value>\", append-only log records,\n");
+    printf("  or JSONL records {\"key\":..,\"value\":..,\"ttl\":..} or {\"query\":\"set ...\"}\n");
+    printf("  --output <file>             table image for mycache --image\n");
+    printf("  --partitions <n>            build for --partitioned --workers n (default off)\n");
+    printf("  --threads <n>               parser and insert threads (default %lu)\n", d.threads);
+    printf("  --ttl <sec>                 TTL of JSONL records without one (default %d)\n", d.ttl);
+    printf("  --compress-threshold <len>  store values of at least len bytes compressed\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Main loader function                                                       |
+//+----------------------------------------------------------------------------+
+
+int main(int argc, char *argv[]) {
+
+    enum { OPT_OUTPUT = 1, OPT_PARTITIONS, OPT_THREADS, OPT_TTL, OPT_COMPRESS_THRESHOLD };
+
+    static struct option options[] = {
+        { "output",             required_argument, nullptr, OPT_OUTPUT             },
+        { "partitions",         required_argument, nullptr, OPT_PARTITIONS         },
+        { "threads",            required_argument, nullptr, OPT_THREADS            },
+        { "ttl",                required_argument, nullptr, OPT_TTL                },
+        { "compress-threshold", required_argument, nullptr, OPT_COMPRESS_THRESHOLD },
+        { nullptr,              0,                 nullptr, 0                      }
+    };
+
+    LoadConfig config;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_OUTPUT:             config.output = optarg;                    break;
+        case OPT_PARTITIONS:         config.partitions = atoi(optarg);          break;
+        case OPT_THREADS:            config.threads = atoi(optarg);             break;
+        case OPT_TTL:                config.ttl = atoi(optarg);                 break;
+        case OPT_COMPRESS_THRESHOLD: config.compressThreshold = atoi(optarg);   break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    for (int i = optind; i < argc; ++i)
+        config.inputs.push_back(argv[i]);
+
+    if (config.output.empty() || config.inputs.empty() || config.partitions < 1 ||
+        config.partitions > MAX_WORKERS || config.threads < 1 || config.ttl <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    /* Server geometry: the image is the table the server maps */
+    std::vector<char> image;
+    CHashTable geometry;
+    image.assign(geometry.imageSize(), 0);
+    geometry.allocate(image.data());
+    if (config.partitions > 1)
+        geometry.setPartitions(config.partitions);
+
+    /* Cut every input into line-aligned chunks, about one per thread */
+    std::vector<std::pair<const char *, size_t>> maps;
+    std::vector<LoadChunk> chunks;
+    for (size_t f = 0; f < config.inputs.size(); ++f) {
+        size_t size;
+        const char *data = mapInput(config.inputs[f], &size);
+        if (!data)
+            return 1;
+        maps.push_back(std::make_pair(data, size));
+
+        size_t step = size / config.threads + 1;
+        for (size_t begin = 0; begin < size; ) {
+            size_t end = std::min(size, begin + step);
+            const char *nl = static_cast<const char *>(memchr(data + end - 1, '\n', size - end + 1));
+            end = nl ? nl - data + 1 : size;
+
+            LoadChunk chunk;
+            chunk.file  = f;
+            chunk.data  = data;
+            chunk.begin = begin;
+            chunk.end   = end;
+            chunk.records = 0;
+            chunk.bad     = 0;
+            chunks.push_back(chunk);
+            begin = end;
+        }
+    }
+
+    /* Parse in parallel */
+    time_t now = time(nullptr);
+    for (size_t first = 0; first < chunks.size(); first += config.threads) {
+        std::vector<std::thread> threads;
+        for (size_t c = first; c < std::min(chunks.size(), first + config.threads); ++c)
+            threads.push_back(std::thread(parseChunk, &chunks[c], std::cref(config),
+                                          std::cref(geometry), now));
+        for (size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+    }
+
+    size_t records = 0, bad = 0;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        records += chunks[c].records;
+        bad     += chunks[c].bad;
+    }
+
+    /* Fill partitions in parallel */
+    std::vector<LoadResult> results(config.partitions);
+    for (size_t first = 0; first < config.partitions; first += config.threads) {
+        std::vector<std::thread> threads;
+        for (size_t p = first; p < std::min(config.partitions, first + config.threads); ++p)
+            threads.push_back(std::thread(fillPartition, p, std::ref(chunks), std::cref(config),
+                                          image.data(), &results[p]));
+        for (size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+    }
+
+    for (size_t m = 0; m < maps.size(); ++m) {
+        if (maps[m].second)
+            munmap(const_cast<char *>(maps[m].first), maps[m].second);
+    }
+
+    LoadResult total;
+    for (size_t p = 0; p < results.size(); ++p) {
+        total.stored  += results[p].stored;
+        total.removed += results[p].removed;
+        total.noSpace += results[p].noSpace;
+        total.tooBig  += results[p].tooBig;
+    }
+
+    /* TTLs count down from now: server ages them by the image's age at startup */
+    Snapshot snap(config.output);
+    if (snap.write(&geometry, image.data(), time(nullptr)) == -1)
+        return 1;
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("records %lu (%lu unparsable), stored %lu, removed %lu, no space %lu, too big %lu\n",
+           records, bad, total.stored, total.removed, total.noSpace, total.tooBig);
+    printf("image %s: %lu slots, %lu partitions, built in %.3f s\n", config.output.c_str(),
+           geometry.getTableSize(), config.partitions, elapsed);
+
+    return total.noSpace ? 2 : 0;
+}
@@ -0,0 +1,419 @@
+#include "cacheclient.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+/* Lost connection must not kill the application (macOS has SO_NOSIGPIPE) */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//+----------------------------------------------------------------------------+
+//| Hash of ring points and keys (same on every platform, unlike std::hash)    |
+//+----------------------------------------------------------------------------+
+
+static uint32_t ringHash(const std::string &s) {
+
+    /* FNV-1a, then murmur3 finalizer: similar point names spread evenly */
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < s.size(); ++i) {
+        h ^= static_cast<uint8_t>(s[i]);
+        h *= 16777619U;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+//+----------------------------------------------------------------------------+
+//| Connection destructor                                                      |
+//+----------------------------------------------------------------------------+
+
+CacheConn::~CacheConn() {
+
+    if (readEvent)
+        event_free(readEvent);
+    if (writeEvent)
+        event_free(writeEvent);
+    if (fd != -1)
+        close(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Client destructor (pending callbacks are dropped)                          |
+//+----------------------------------------------------------------------------+
+
+CacheClient::~CacheClient() {
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (size_t j = 0; j < nodes[i].pool.size(); ++j)
+            delete nodes[i].pool[j];
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Add node and its points on ring                                            |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::addNode(const std::string &host, uint16_t port) {
+
+    CacheNode node;
+    node.host    = host;
+    node.port    = port;
+    node.retryAt = 0;
+
+    size_t id = nodes.size();
+    for (int i = 0; i < poolSize; ++i)
+        node.pool.push_back(new CacheConn(this, id));
+    nodes.push_back(node);
+
+    /* Points depend on the address only: clients agree whatever the order */
+    std::string name = host + ":" + std::to_string(port);
+    for (int i = 0; i < KETAMA_POINTS; ++i)
+        ring.push_back(std::make_pair(ringHash(name + "-" + std::to_string(i)), id));
+    std::sort(ring.begin(), ring.end());
+}
+
+//+----------------------------------------------------------------------------+
+//| Node owning key: first live node clockwise from its hash                   |
+//+----------------------------------------------------------------------------+
+
+size_t CacheClient::nodeOf(const std::string &key) const {
+
+    if (ring.empty())
+        return 0;
+
+    auto it = std::lower_bound(ring.begin(), ring.end(), std::make_pair(ringHash(key), (size_t)0));
+    size_t first = (it == ring.end()) ? 0 : it - ring.begin();
+
+    time_t now = time(nullptr);
+    for (size_t i = 0; i < ring.size(); ++i) {
+        size_t node = ring[(first + i) % ring.size()].second;
+        if (nodes[node].retryAt <= now)
+            return node;
+    }
+
+    /* Everything is down: try the owner again */
+    return ring[first].second;
+}
+
+//+----------------------------------------------------------------------------+
+//| Connection of key's node that carries key                                  |
+//+----------------------------------------------------------------------------+
+
+CacheConn *CacheClient::pick(const std::string &key) {
+
+    if (nodes.empty())
+        return nullptr;
+
+    /* Ring position picked the node, the other hash bits pick the connection */
+    CacheNode &node = nodes[nodeOf(key)];
+    CacheConn *best = node.pool[(ringHash(key) >> 16) % node.pool.size()];
+
+    if (best->fd == -1 && connect(best) == -1)
+        return nullptr;
+
+    return best;
+}
+
+//+----------------------------------------------------------------------------+
+//| Start non-blocking connect                                                 |
+//+----------------------------------------------------------------------------+
+
+int CacheClient::connect(CacheConn *conn) {
+
+    CacheNode &node = nodes[conn->node];
+
+    struct sockaddr_in sAddr;
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port   = htons(node.port);
+    if (inet_pton(AF_INET, node.host.c_str(), &(sAddr.sin_addr)) != 1) {
+        printf("[client]:\tIP address %s is not parseable\n", node.host.c_str());
+        node.retryAt = time(nullptr) + CLIENT_RETRY_SEC;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    evutil_make_socket_nonblocking(fd);
+
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &optval, sizeof(optval));
+#endif
+
+    if (::connect(fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1 && errno != EINPROGRESS) {
+        std::cout << "[connect]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        node.retryAt = time(nullptr) + CLIENT_RETRY_SEC;
+        return -1;
+    }
+
+    /* Writable once connected: queued requests go out then */
+    conn->fd         = fd;
+    conn->connected  = false;
+    conn->readEvent  = event_new(base, fd, EV_READ | EV_PERSIST, client_read_cb, (void *)conn);
+    conn->writeEvent = event_new(base, fd, EV_WRITE | EV_PERSIST, client_write_cb, (void *)conn);
+    event_add(conn->readEvent, nullptr);
+    event_add(conn->writeEvent, nullptr);
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Queue request on connection                                                |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::send(CacheConn *conn, const std::string &request, const ReplyCallback &done) {
+
+    conn->outBuf.append(request);
+    conn->inflight.push_back(done);
+
+    /* Loop writes everything queued until then in one go */
+    if (conn->connected)
+        event_add(conn->writeEvent, nullptr);
+}
+
+//+----------------------------------------------------------------------------+
+//| Key or value is a single protocol token                                    |
+//+----------------------------------------------------------------------------+
+
+bool CacheClient::validKey(const std::string &key) {
+
+    return !key.empty() && key.find_first_of(std::string(" \r\n\0", 4)) == std::string::npos;
+}
+
+//+----------------------------------------------------------------------------+
+//| Get key                                                                    |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::get(const std::string &key, const ReplyCallback &done) {
+
+    CacheConn *conn = validKey(key) ? pick(key) : nullptr;
+    if (!conn) {
+        done(CLIENT_FAILED, "");
+        return;
+    }
+
+    send(conn, "get " + key + "\n", done);
+}
+
+//+----------------------------------------------------------------------------+
+//| Set key                                                                    |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::set(int ttl, const std::string &key, const std::string &value,
+                      const ReplyCallback &done) {
+
+    CacheConn *conn = (validKey(key) && validKey(value)) ? pick(key) : nullptr;
+    if (!conn) {
+        done(CLIENT_FAILED, "");
+        return;
+    }
+
+    send(conn, "set " + std::to_string(ttl) + " " + key + " " + value + "\n", done);
+}
+
+//+----------------------------------------------------------------------------+
+//| Send protocol line about key                                               |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::query(const std::string &key, const std::string &line,
+                        const ReplyCallback &done) {
+
+    CacheConn *conn = validKey(key) ? pick(key) : nullptr;
+    if (!conn) {
+        done(CLIENT_FAILED, "");
+        return;
+    }
+
+    send(conn, line + "\n", done);
+}
+
+//+----------------------------------------------------------------------------+
+//| Get several keys, grouped per node into batches                            |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::multiGet(const std::vector<std::string> &keys, const MultiCallback &done) {
+
+    struct Batch {
+        std::map<std::string, std::string> values;
+        size_t failed;
+        size_t left;
+        MultiCallback done;
+    };
+
+    if (keys.empty()) {
+        done(std::map<std::string, std::string>(), 0);
+        return;
+    }
+
+    std::shared_ptr<Batch> batch(new Batch);
+    batch->failed = 0;
+    batch->left   = keys.size();
+    batch->done   = done;
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string key = keys[i];
+        get(key, [batch, key](int status, const std::string &value) {
+            if (status == CLIENT_OK)
+                batch->values[key] = value;
+            else if (status != CLIENT_MISS)
+                batch->failed++;
+            if (--batch->left == 0)
+                batch->done(batch->values, batch->failed);
+        });
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Write queued requests                                                      |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::onWritable(CacheConn *conn) {
+
+    if (!conn->connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            std::cout << "[connect]:\t" << strerror(err) << std::endl;
+            fail(conn);
+            return;
+        }
+        conn->connected = true;
+    }
+
+    while (conn->outPos < conn->outBuf.size()) {
+        ssize_t sent = ::send(conn->fd, conn->outBuf.data() + conn->outPos,
+                              conn->outBuf.size() - conn->outPos, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EINTR)
+                return;
+            std::cout << "[send]:\t" << strerror(errno) << std::endl;
+            fail(conn);
+            return;
+        }
+        conn->outPos += sent;
+    }
+
+    conn->outBuf.clear();
+    conn->outPos = 0;
+    event_del(conn->writeEvent);
+}
+
+//+----------------------------------------------------------------------------+
+//| Match replies to pending requests                                          |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::onReadable(CacheConn *conn) {
+
+    char buf[CLIENT_READ_SIZE];
+    ssize_t len = recv(conn->fd, buf, sizeof(buf), 0);
+    if (len == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (len <= 0) {
+        fail(conn);
+        return;
+    }
+
+    for (ssize_t i = 0; i < len; ++i) {
+        /* Server ends each batch of replies with '\0' */
+        if (buf[i] == '\0')
+            continue;
+        if (buf[i] != '\n') {
+            conn->line.push_back(buf[i]);
+            continue;
+        }
+
+        if (conn->inflight.empty()) {
+            printf("[client]:\tunexpected reply from %s:%d\n",
+                   nodes[conn->node].host.c_str(), nodes[conn->node].port);
+            fail(conn);
+            return;
+        }
+
+        /* Reply is "ok <key> <value>" or "error (<reason>)" */
+        int status = CLIENT_ERROR;
+        std::string value = conn->line;
+        size_t space = conn->line.find(' ', 3);
+        if (conn->line.compare(0, 3, "ok ") == 0 && space != std::string::npos) {
+            status = CLIENT_OK;
+            value  = conn->line.substr(space + 1);
+        } else if (conn->line == "error (key doesn't exist)") {
+            status = CLIENT_MISS;
+        }
+        conn->line.clear();
+
+        /* Callback may queue more requests on this connection */
+        ReplyCallback done = conn->inflight.front();
+        conn->inflight.pop_front();
+        done(status, value);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Drop connection, fail its requests and rest node for a while               |
+//+----------------------------------------------------------------------------+
+
+void CacheClient::fail(CacheConn *conn) {
+
+    event_free(conn->readEvent);
+    event_free(conn->writeEvent);
+    conn->readEvent  = nullptr;
+    conn->writeEvent = nullptr;
+    close(conn->fd);
+    conn->fd        = -1;
+    conn->connected = false;
+    conn->outBuf.clear();
+    conn->outPos = 0;
+    conn->line.clear();
+
+    nodes[conn->node].retryAt = time(nullptr) + CLIENT_RETRY_SEC;
+
+    /* Retries from callbacks go to the next node on the ring */
+    std::deque<ReplyCallback> failed;
+    failed.swap(conn->inflight);
+    for (size_t i = 0; i < failed.size(); ++i)
+        failed[i](CLIENT_FAILED, "");
+}
+
+//+----------------------------------------------------------------------------+
+//| Read callback                                                              |
+//+----------------------------------------------------------------------------+
+
+void client_read_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a connection object */
+    CacheConn *conn = (CacheConn *)ptr;
+
+    conn->owner->onReadable(conn);
+}
+
+//+----------------------------------------------------------------------------+
+//| Write callback                                                             |
+//+----------------------------------------------------------------------------+
+
+void client_write_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a connection object */
+    CacheConn *conn = (CacheConn *)ptr;
+
+    conn->owner->onWritable(conn);
+}
@@ -0,0 +1,128 @@
+#ifndef __CACHECLIENT_H__
+#define __CACHECLIENT_H__
+
+#include <event.h>
+#include <stdint.h>
+#include <time.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Points of every node on the hash ring */
+static const int    KETAMA_POINTS       = 160;
+
+static const int    CLIENT_POOL         = 2;
+static const int    CLIENT_RETRY_SEC    = 1;
+static const size_t CLIENT_READ_SIZE    = 64 * 1024;
+
+/* Result of a request */
+enum {
+    CLIENT_OK = 0,
+    CLIENT_MISS,       /* key doesn't exist */
+    CLIENT_ERROR,      /* server answered with an error */
+    CLIENT_FAILED      /* no answer: bad key, node down or connection lost */
+};
+
+typedef std::function<void(int status, const std::string &value)> ReplyCallback;
+typedef std::function<void(const std::map<std::string, std::string> &values,
+                           size_t failed)> MultiCallback;
+
+class CacheClient;
+
+//+----------------------------------------------------------------------------+
+//| Pipelined connection to one node                                           |
+//+----------------------------------------------------------------------------+
+
+class CacheConn {
+public:
+    CacheClient  *owner;
+    size_t       node;
+    int          fd;
+    bool         connected;
+    struct event *readEvent;
+    struct event *writeEvent;
+
+    /* Requests not yet sent start at outPos */
+    std::string  outBuf;
+    size_t       outPos;
+    std::string  line;
+
+    /* Callbacks of sent requests, in order of their replies */
+    std::deque<ReplyCallback> inflight;
+
+    CacheConn(CacheClient *owner, size_t node)
+        : owner(owner), node(node), fd(-1), connected(false), readEvent(nullptr),
+          writeEvent(nullptr), outPos(0) {}
+    ~CacheConn();
+};
+
+//+----------------------------------------------------------------------------+
+//| Cache node                                                                 |
+//+----------------------------------------------------------------------------+
+
+struct CacheNode {
+    std::string host;
+    uint16_t    port;
+    std::vector<CacheConn *> pool;
+
+    /* Failed node gets no requests until then */
+    time_t      retryAt;
+};
+
+//+----------------------------------------------------------------------------+
+//| Asynchronous client of several cache nodes                                 |
+//|                                                                            |
+//| Runs on the caller's event base. Keys map to nodes on a ketama ring, so    |
+//| adding or removing a node moves only its share of keys, and keys of a      |
+//| failed node move to the next node on the ring until it comes back.         |
+//| Every node has a small pool of connections. A key always uses the same     |
+//| one, so requests on a key keep their order, and they are pipelined.        |
+//| Requests made before the loop runs again are written together, so a        |
+//| multi-key get costs one write per node. Callbacks run from the loop, or    |
+//| at once if the request can't be sent.                                      |
+//+----------------------------------------------------------------------------+
+
+class CacheClient {
+    struct event_base *base;
+    int               poolSize;
+    std::vector<CacheNode> nodes;
+    std::vector<std::pair<uint32_t, size_t>> ring;
+
+    CacheConn *pick(const std::string &key);
+    int        connect(CacheConn *conn);
+    void       send(CacheConn *conn, const std::string &request, const ReplyCallback &done);
+    static bool validKey(const std::string &key);
+
+public:
+    CacheClient(struct event_base *base, int poolSize = CLIENT_POOL)
+        : base(base), poolSize(poolSize) {}
+    ~CacheClient();
+
+    /* Add node before first request */
+    void addNode(const std::string &host, uint16_t port);
+    size_t nodeOf(const std::string &key) const;
+
+    void get(const std::string &key, const ReplyCallback &done);
+    void set(int ttl, const std::string &key, const std::string &value, const ReplyCallback &done);
+    void multiGet(const std::vector<std::string> &keys, const MultiCallback &done);
+
+    /* Protocol line about key, sent as is (proxies) */
+    void query(const std::string &key, const std::string &line, const ReplyCallback &done);
+
+    /* Connection events */
+    void onReadable(CacheConn *conn);
+    void onWritable(CacheConn *conn);
+    void fail(CacheConn *conn);
+};
+
+//+----------------------------------------------------------------------------+
+//| Callbacks                                                                  |
+//+----------------------------------------------------------------------------+
+
+void client_read_cb (evutil_socket_t evs, short events, void *ptr);
+void client_write_cb(evutil_socket_t evs, short events, void *ptr);
+
+#endif /* __CACHECLIENT_H__ */
@@ -0,0 +1,271 @@
+#include "capture.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+
+//+----------------------------------------------------------------------------+
+//| Write remaining records and close trace                                    |
+//+----------------------------------------------------------------------------+
+
+Capture::~Capture() {
+
+    if (fd == -1)
+        return;
+
+    /* Writer takes what is left before it exits */
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        pending.append(buffer);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    writer.join();
+
+    if (dropped)
+        printf("[capture]:\t%llu records dropped\n", (unsigned long long)dropped);
+    close(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Open trace file of calling process                                         |
+//+----------------------------------------------------------------------------+
+
+int Capture::open() {
+
+    pid = getpid();
+    std::string name = path + "." + std::to_string(pid);
+
+    fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct stat st;
+    if (binary && fstat(fd, &st) == 0 && st.st_size == 0)
+        buffer.append(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+
+    srandom(pid);
+    writer = std::thread(&Capture::write, this);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Decide whether new connection gets traced                                  |
+//+----------------------------------------------------------------------------+
+
+bool Capture::sample() {
+
+    return fd != -1 && random() < rate * RAND_MAX;
+}
+
+//+----------------------------------------------------------------------------+
+//| Buffer request of traced connection                                        |
+//+----------------------------------------------------------------------------+
+
+void Capture::record(uint32_t conn, const std::string &query) {
+
+    if (buffer.size() >= CAPTURE_BUFFER) {
+        dropped++;
+        return;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    uint64_t ts = static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+
+    if (binary) {
+        uint32_t id = pid;
+        uint32_t length = query.size();
+        buffer.append(reinterpret_cast<const char *>(&ts), sizeof(ts));
+        buffer.append(reinterpret_cast<const char *>(&id), sizeof(id));
+        buffer.append(reinterpret_cast<const char *>(&conn), sizeof(conn));
+        buffer.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        buffer.append(query);
+        return;
+    }
+
+    char head[96];
+    snprintf(head, sizeof(head), "{\"ts\":%llu,\"pid\":%u,\"conn\":%u,\"query\":\"",
+             (unsigned long long)ts, (unsigned)pid, conn);
+    buffer.append(head);
+
+    for (size_t i = 0; i < query.size(); ++i) {
+        unsigned char c = query[i];
+        if (c == '"' || c == '\\') {
+            buffer.push_back('\\');
+            buffer.push_back(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            buffer.append(esc);
+        } else {
+            buffer.push_back(c);
+        }
+    }
+    buffer.append("\"}\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Hand buffered records to the writer unless it is still busy                |
+//+----------------------------------------------------------------------------+
+
+void Capture::flush() {
+
+    if (fd == -1 || buffer.empty())
+        return;
+
+    /* Busy writer: records keep collecting until the buffer cap drops them */
+    std::unique_lock<std::mutex> guard(mutex, std::try_to_lock);
+    if (!guard.owns_lock() || !pending.empty())
+        return;
+
+    pending.swap(buffer);
+    guard.unlock();
+    wakeup.notify_one();
+}
+
+//+----------------------------------------------------------------------------+
+//| Writer thread: write batches handed over by the event loop                 |
+//+----------------------------------------------------------------------------+
+
+void Capture::write() {
+
+    std::string batch;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            wakeup.wait(guard, [this] { return stopping || !pending.empty(); });
+
+            /* Batch is taken only after it is written: flush waits till then */
+            if (pending.empty())
+                return;
+            batch = pending;
+        }
+
+        size_t done = 0;
+        while (done < batch.size()) {
+            ssize_t written = ::write(fd, batch.data() + done, batch.size() - done);
+            if (written == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::cout << "[write]:\t" << strerror(errno) << std::endl;
+                break;
+            }
+            done += written;
+        }
+
+        std::lock_guard<std::mutex> guard(mutex);
+        pending.erase(0, batch.size());
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse unsigned number following "name": in JSONL record                    |
+//+----------------------------------------------------------------------------+
+
+static bool jsonNumber(const std::string &line, const char *name, uint64_t *value) {
+
+    size_t pos = line.find(std::string("\"") + name + "\":");
+    if (pos == std::string::npos)
+        return false;
+
+    *value = strtoull(line.c_str() + pos + strlen(name) + 3, nullptr, 10);
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse "query" string of JSONL record                                       |
+//+----------------------------------------------------------------------------+
+
+static bool jsonQuery(const std::string &line, std::string *query) {
+
+    size_t pos = line.find("\"query\":\"");
+    if (pos == std::string::npos)
+        return false;
+
+    query->clear();
+    for (size_t i = pos + 9; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '"')
+            return true;
+        if (c != '\\') {
+            query->push_back(c);
+            continue;
+        }
+        if (++i == line.size())
+            return false;
+        if (line[i] == 'u' && i + 4 < line.size()) {
+            query->push_back(static_cast<char>(strtol(line.substr(i + 1, 4).c_str(), nullptr, 16)));
+            i += 4;
+        } else {
+            query->push_back(line[i]);
+        }
+    }
+
+    return false;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read trace file of either format                                           |
+//+----------------------------------------------------------------------------+
+
+bool Capture::load(std::string path, std::vector<CaptureRecord> *records) {
+
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) {
+        printf("[capture]:\tcannot open %s\n", path.c_str());
+        return false;
+    }
+
+    char magic[sizeof(CAPTURE_MAGIC)];
+    bool binary = in.read(magic, sizeof(magic)) &&
+                  memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0;
+
+    if (binary) {
+        CaptureRecord rec;
+        uint32_t length;
+        while (in.read(reinterpret_cast<char *>(&rec.ts), sizeof(rec.ts)) &&
+               in.read(reinterpret_cast<char *>(&rec.pid), sizeof(rec.pid)) &&
+               in.read(reinterpret_cast<char *>(&rec.conn), sizeof(rec.conn)) &&
+               in.read(reinterpret_cast<char *>(&length), sizeof(length))) {
+            rec.query.resize(length);
+            if (length && !in.read(&rec.query[0], length))
+                break;
+            records->push_back(rec);
+        }
+        return true;
+    }
+
+    in.clear();
+    in.seekg(0);
+
+    std::string line;
+    size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        if (line.empty())
+            continue;
+
+        CaptureRecord rec;
+        uint64_t pid, conn;
+        if (!jsonNumber(line, "ts", &rec.ts) || !jsonNumber(line, "pid", &pid) ||
+            !jsonNumber(line, "conn", &conn) || !jsonQuery(line, &rec.query)) {
+            printf("[capture]:\t%s:%lu: bad record\n", path.c_str(), lineNo);
+            return false;
+        }
+        rec.pid  = pid;
+        rec.conn = conn;
+        records->push_back(rec);
+    }
+
+    return true;
+}
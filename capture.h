@@ -0,0 +1,82 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Flush period and cap of unwritten records (records past it are dropped) */
+static const int    CAPTURE_FLUSH_MS = 100;
+static const size_t CAPTURE_BUFFER   = 4 * 1024 * 1024;
+
+/* Binary trace starts with this tag */
+static const char   CAPTURE_MAGIC[8] = { 'M', 'C', 'T', 'R', 'A', 'C', 'E', '1' };
+
+//+----------------------------------------------------------------------------+
+//| One captured request                                                       |
+//+----------------------------------------------------------------------------+
+
+struct CaptureRecord {
+    uint64_t    ts;      /* wall clock, microseconds */
+    uint32_t    pid;     /* worker process */
+    uint32_t    conn;    /* connection id inside worker */
+    std::string query;
+};
+
+//+----------------------------------------------------------------------------+
+//| Sampled request trace of one worker                                        |
+//|                                                                            |
+//| Each worker appends to "<path>.<pid>" so files have a single writer.       |
+//| Records are buffered and handed to a writer thread from a timer; a slow    |
+//| disk costs dropped records, never a stalled event loop. Whole connections  |
+//| are sampled so a replay sees complete per-connection request sequences.    |
+//| JSONL: {"ts":<us>,"pid":<pid>,"conn":<id>,"query":"<escaped>"}             |
+//| Binary: magic, then per record ts u64, pid u32, conn u32, length u32 and   |
+//| query bytes, native byte order.                                            |
+//+----------------------------------------------------------------------------+
+
+class Capture {
+    std::string path;
+    bool        binary;
+    double      rate;
+    int         fd;
+    pid_t       pid;
+    std::string buffer;
+    uint64_t    dropped;
+
+    /* Writer thread takes pending batches (the event loop never writes) */
+    std::thread             writer;
+    std::mutex              mutex;
+    std::condition_variable wakeup;
+    std::string             pending;
+    bool                    stopping;
+
+    void write();
+
+public:
+    Capture(std::string path, bool binary, double rate)
+        : path(path), binary(binary), rate(rate), fd(-1), pid(0), dropped(0),
+          stopping(false) {}
+    ~Capture();
+
+    /* Open trace file of calling process */
+    int  open();
+
+    /* Decide whether new connection gets traced */
+    bool sample();
+
+    /* Buffer request of traced connection */
+    void record(uint32_t conn, const std::string &query);
+
+    /* Hand buffered records to the writer unless it is still busy */
+    void flush();
+
+    /* Read trace file of either format, false on bad file */
+    static bool load(std::string path, std::vector<CaptureRecord> *records);
+};
+
+#endif /* __CAPTURE_H__ */
@@ -1,4 +1,5 @@
 #include "cleaner.h"
+#include <sys/stat.h>
 
 //+----------------------------------------------------------------------------+
 //| Cleaner destructor                                                         |
@@ -6,14 +7,13 @@
 
 Cleaner::~Cleaner() {
 
-    close(shmFile);
-    if (shm_unlink(shmFilename.c_str()) == -1)
-        std::cout << "[shm_unlink]:\t" << strerror(errno) << std::endl;
-
     if (sem_close(semaphore) == -1)
         std::cout << "[sem_close]:\t" << strerror(errno) << std::endl;
 
+    for (size_t i = 0; i < spaces.size(); ++i)
+        delete spaces[i];
     delete hTable;
+    delete segment;
 }
 
 //+----------------------------------------------------------------------------+
@@ -23,14 +23,16 @@ Cleaner::~Cleaner() {
 void Cleaner::start() {
 
     /* Open hash table */
-    shmFile = shm_open(shmFilename.c_str(), O_RDWR);
-    if (shmFile == -1) {
-        std::cout << "[shm_open]:\t" << strerror(errno) << std::endl;
+    segment = new Segment(shmFilename);
+    if (segment->attach() == -1)
         return;
-    }
     hTable = new CHashTable();
-    if (hTable->allocate(shmFile) == -1)
+    if (segment->attachTable(hTable) == -1)
         return;
+    stats = segment->stats(segment->header()->generation, STATS_CLEANER);
+    hTable->setStats(stats);
+    for (size_t i = 0; i < segment->namespaces(); ++i)
+        spaces.push_back(segment->namespaceTable(i));
 
     /* Open semaphore */
     semaphore = sem_open(semFile.c_str(), 0);
@@ -40,22 +42,100 @@ void Cleaner::start() {
     }
 
     /* Run cleaner */
-    while (true) {
+    for (long tick = 1; ; ++tick) {
 
-        /* Lock semaphore */
-        if (sem_wait(semaphore) == -1) {
-            std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
-            return;
+        if (hTable->getPartitions() > 1) {
+            /* Owners only wait for the sweep of their own partition */
+            for (size_t p = 0; p < hTable->getPartitions(); ++p) {
+                segment->lockPartition(p);
+                uint64_t start = readTSC();
+                hTable->checkTTL(p);
+                recordLatency(stats, LAT_SWEEP_HOLD, start);
+                segment->unlockPartition(p);
+            }
+
+        } else {
+            /* Lock semaphore */
+            if (sem_wait(semaphore) == -1) {
+                std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+                return;
+            }
+
+            uint64_t start = readTSC();
+            hTable->checkTTL();
+            recordLatency(stats, LAT_SWEEP_HOLD, start);
+
+            /* Unlock semaphore */
+            if (sem_post(semaphore) == -1) {
+                std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+                return;
+            }
+        }
+
+        for (size_t i = 0; i < spaces.size(); ++i) {
+            for (size_t s = 0; s < spaces[i]->getPartitions(); ++s) {
+                segment->lockStripe(i, s);
+                uint64_t start = readTSC();
+                spaces[i]->checkTTL(s);
+                recordLatency(stats, LAT_SWEEP_HOLD, start);
+                segment->unlockStripe(i, s);
+            }
         }
 
-        hTable->checkTTL();
+        /* Periodic snapshot */
+        if (!snapshotPath.empty() && tick % snapshotInterval == 0)
+            snapshot();
+
+        /* Keep replay time bounded */
+        if (!aofPath.empty())
+            compactLog();
+
+        sleep(1);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Write snapshot unless previous one is still being written                  |
+//+----------------------------------------------------------------------------+
 
-        /* Unlock semaphore */
-        if (sem_post(semaphore) == -1) {
-            std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+void Cleaner::snapshot() {
+
+    if (snapshotWriter != -1) {
+        int status;
+        pid_t pid = waitpid(snapshotWriter, &status, WNOHANG);
+        if (pid == 0) {
+            printf("[cleaner]:\tprevious snapshot still in progress\n");
             return;
         }
+        if (pid == snapshotWriter && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+            printf("[cleaner]:\tsnapshot writer failed\n");
+        snapshotWriter = -1;
+    }
 
-        sleep(1);
+    Snapshot snap(snapshotPath);
+    snapshotWriter = snap.save(hTable, segment->header(), semaphore);
+}
+
+//+----------------------------------------------------------------------------+
+//| Rewrite append-only log once it doubled since last rewrite                 |
+//+----------------------------------------------------------------------------+
+
+void Cleaner::compactLog() {
+
+    struct stat st;
+    if (stat(aofPath.c_str(), &st) == -1)
+        return;
+
+    if (st.st_size < aofRewriteSize || st.st_size < 2 * aofLastSize)
+        return;
+
+    off_t size = AppendLog::rewrite(aofPath, hTable, segment->header(), semaphore);
+    if (size == -1) {
+        printf("[cleaner]:\tappend-only log rewrite failed\n");
+        return;
     }
+
+    printf("[cleaner]:\tappend-only log rewritten: %lld -> %lld bytes\n",
+           (long long)st.st_size, (long long)size);
+    aofLastSize = size;
 }
\ No newline at end of file
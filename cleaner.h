@@ -1,9 +1,14 @@
 #ifndef __CLEANER_H__
 #define __CLEANER_H__
 
+#include "aof.h"
+#include "config.h"
 #include "htable.h"
+#include "segment.h"
+#include "snapshot.h"
 #include <sys/mman.h>
 #include <semaphore.h>
+#include <sys/wait.h> /* waitpid */
 #include <unistd.h> /*  close, sleep */
 
 //+----------------------------------------------------------------------------+
@@ -13,16 +18,38 @@
 class Cleaner {
     /* Shared memory */
     std::string shmFilename;
-    int         shmFile;
+    Segment     *segment;
     CHashTable  *hTable;
+    Stats       *stats;
+
+    /* Named tables, swept one stripe at a time */
+    std::vector<CHashTable *> spaces;
 
     /* Semaphore */
     std::string semFile;
     sem_t       *semaphore;
 
+    /* Snapshots */
+    std::string snapshotPath;
+    int         snapshotInterval;
+    pid_t       snapshotWriter;
+
+    /* Append-only log compaction */
+    std::string aofPath;
+    long        aofRewriteSize;
+    off_t       aofLastSize;
+
+    void snapshot();
+    void compactLog();
+
 public:
-    Cleaner(std::string shmFilename, std::string semFile)
-        : shmFilename(shmFilename), semFile(semFile) {}
+    Cleaner(const Config &config)
+        : shmFilename(config.shmFilename), segment(nullptr), hTable(nullptr), stats(nullptr),
+          semFile(config.semFile), semaphore(nullptr),
+          snapshotPath(config.snapshotPath),
+          snapshotInterval(config.snapshotInterval), snapshotWriter(-1),
+          aofPath(config.aofPath), aofRewriteSize(config.aofRewriteSize),
+          aofLastSize(0) {}
     ~Cleaner();
 
     void start();
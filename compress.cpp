@@ -0,0 +1,248 @@
+#include "compress.h"
+#include <string.h>
+#include <vector>
+
+static const int    HASH_BITS     = 12;
+static const size_t MIN_MATCH     = 4;
+static const size_t MAX_OFFSET    = 65535;
+
+/* Matches start at least this far from the end, last bytes are literals */
+static const size_t MATCH_LIMIT   = 12;
+static const size_t LAST_LITERALS = 5;
+
+static const char   ESCAPE        = '\x02';
+
+//+----------------------------------------------------------------------------+
+//| Read 4 bytes                                                               |
+//+----------------------------------------------------------------------------+
+
+static uint32_t read32(const std::string &s, size_t pos) {
+
+    uint32_t v;
+    memcpy(&v, s.data() + pos, sizeof(v));
+    return v;
+}
+
+//+----------------------------------------------------------------------------+
+//| Append length continuation bytes                                           |
+//+----------------------------------------------------------------------------+
+
+static void putLength(std::string *dst, size_t length) {
+
+    while (length >= 255) {
+        dst->push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    dst->push_back(static_cast<char>(length));
+}
+
+//+----------------------------------------------------------------------------+
+//| Append one sequence (offset 0: literals only, ends block)                  |
+//+----------------------------------------------------------------------------+
+
+static void putSequence(std::string *dst, const std::string &src, size_t literalStart,
+                        size_t literals, size_t offset, size_t match) {
+
+    size_t matchCode = offset ? match - MIN_MATCH : 0;
+    uint8_t token = (literals < 15 ? literals : 15) << 4 | (matchCode < 15 ? matchCode : 15);
+    dst->push_back(static_cast<char>(token));
+
+    if (literals >= 15)
+        putLength(dst, literals - 15);
+    dst->append(src, literalStart, literals);
+
+    if (!offset)
+        return;
+
+    dst->push_back(static_cast<char>(offset & 0xff));
+    dst->push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15)
+        putLength(dst, matchCode - 15);
+}
+
+//+----------------------------------------------------------------------------+
+//| Compress block                                                             |
+//+----------------------------------------------------------------------------+
+
+std::string lzCompress(const std::string &src) {
+
+    std::string dst;
+    std::vector<int32_t> table(1 << HASH_BITS, -1);
+    size_t n = src.size();
+    size_t anchor = 0, ip = 0;
+
+    if (n > MATCH_LIMIT) {
+        size_t limit    = n - MATCH_LIMIT;
+        size_t matchEnd = n - LAST_LITERALS;
+
+        while (ip < limit) {
+            uint32_t seq = read32(src, ip);
+            uint32_t h   = (seq * 2654435761U) >> (32 - HASH_BITS);
+            int32_t  ref = table[h];
+            table[h] = ip;
+
+            if (ref < 0 || ip - ref > MAX_OFFSET || read32(src, ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            size_t match = MIN_MATCH;
+            while (ip + match < matchEnd && src[ref + match] == src[ip + match])
+                match++;
+
+            putSequence(&dst, src, anchor, ip - anchor, ip - ref, match);
+            ip += match;
+            anchor = ip;
+        }
+    }
+
+    putSequence(&dst, src, anchor, n - anchor, 0, 0);
+    return dst;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read length continuation bytes                                             |
+//+----------------------------------------------------------------------------+
+
+static bool getLength(const std::string &src, size_t *pos, size_t *length) {
+
+    uint8_t b;
+    do {
+        if (*pos >= src.size())
+            return false;
+        b = src[(*pos)++];
+        *length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Decompress block of known raw size (every read and copy bounds-checked)    |
+//+----------------------------------------------------------------------------+
+
+bool lzDecompress(const std::string &src, size_t rawSize, std::string *dst) {
+
+    size_t i = 0, n = src.size();
+    dst->clear();
+    dst->reserve(rawSize);
+
+    while (i < n) {
+        uint8_t token = src[i++];
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !getLength(src, &i, &literals))
+            return false;
+        if (literals > n - i || dst->size() + literals > rawSize)
+            return false;
+        dst->append(src, i, literals);
+        i += literals;
+
+        /* Last sequence has no match */
+        if (i == n)
+            break;
+
+        if (n - i < 2)
+            return false;
+        size_t offset = static_cast<uint8_t>(src[i]) | static_cast<uint8_t>(src[i + 1]) << 8;
+        i += 2;
+        if (!offset || offset > dst->size())
+            return false;
+
+        size_t match = token & 15;
+        if (match == 15 && !getLength(src, &i, &match))
+            return false;
+        match += MIN_MATCH;
+        if (dst->size() + match > rawSize)
+            return false;
+
+        /* Overlapping copy repeats the last offset bytes */
+        size_t from = dst->size() - offset;
+        for (size_t k = 0; k < match; ++k)
+            dst->push_back((*dst)[from + k]);
+    }
+
+    return dst->size() == rawSize;
+}
+
+//+----------------------------------------------------------------------------+
+//| Byte the table or the protocol cannot carry                                |
+//+----------------------------------------------------------------------------+
+
+static bool needsEscape(char c) {
+
+    return c == '\0' || c == ' ' || c == '\r' || c == '\n' || c == ESCAPE;
+}
+
+//+----------------------------------------------------------------------------+
+//| Stored form if it is shorter than value, value itself otherwise            |
+//+----------------------------------------------------------------------------+
+
+std::string compressValue(const std::string &value) {
+
+    std::string payload;
+    size_t size = value.size();
+    do {
+        payload.push_back(static_cast<char>((size & 0x7f) | (size > 0x7f ? 0x80 : 0)));
+        size >>= 7;
+    } while (size);
+    payload += lzCompress(value);
+
+    std::string stored(1, COMPRESSED_MARKER);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        if (needsEscape(payload[i])) {
+            stored.push_back(ESCAPE);
+            stored.push_back(payload[i] ^ 0x40);
+        } else {
+            stored.push_back(payload[i]);
+        }
+    }
+
+    return stored.size() < value.size() ? stored : value;
+}
+
+//+----------------------------------------------------------------------------+
+//| Value is in compressed stored form                                         |
+//+----------------------------------------------------------------------------+
+
+bool isCompressed(const std::string &stored) {
+
+    return !stored.empty() && stored[0] == COMPRESSED_MARKER;
+}
+
+//+----------------------------------------------------------------------------+
+//| Raw value of stored form                                                   |
+//+----------------------------------------------------------------------------+
+
+bool expandValue(const std::string &stored, std::string *value) {
+
+    if (!isCompressed(stored)) {
+        *value = stored;
+        return true;
+    }
+
+    std::string payload;
+    for (size_t i = 1; i < stored.size(); ++i) {
+        if (stored[i] != ESCAPE) {
+            payload.push_back(stored[i]);
+        } else if (++i < stored.size()) {
+            payload.push_back(stored[i] ^ 0x40);
+        } else {
+            return false;
+        }
+    }
+
+    size_t size = 0, pos = 0;
+    for (int shift = 0; ; shift += 7) {
+        if (pos >= payload.size() || shift > 28)
+            return false;
+        uint8_t b = payload[pos++];
+        size |= static_cast<size_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+    if (size > MAX_RAW_VALUE)
+        return false;
+
+    return lzDecompress(payload.substr(pos), size, value);
+}
@@ -0,0 +1,41 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stdint.h>
+#include <string>
+
+/* First byte of a stored compressed value (clients never send control bytes) */
+static const char   COMPRESSED_MARKER = '\x01';
+
+/* Largest value accepted from a client when it gets compressed */
+static const size_t MAX_RAW_VALUE     = 64 * 1024;
+
+//+----------------------------------------------------------------------------+
+//| LZ77 block codec in LZ4 block format                                       |
+//|                                                                            |
+//| Sequences of token (literal length, match length - 4), literals and a      |
+//| 16-bit offset; lengths of 15 continue in 255-valued bytes. The last        |
+//| sequence has literals only.                                                |
+//+----------------------------------------------------------------------------+
+
+std::string lzCompress(const std::string &src);
+bool        lzDecompress(const std::string &src, size_t rawSize, std::string *dst);
+
+//+----------------------------------------------------------------------------+
+//| Stored form of values                                                      |
+//|                                                                            |
+//| Marker, then varint raw length and LZ block with the bytes the table and   |
+//| the line protocol cannot carry (NUL, space, CR, LF and the escape itself)  |
+//| escaped. Stored values stay valid tokens for the AOF, replication and      |
+//| passthrough clients.                                                       |
+//+----------------------------------------------------------------------------+
+
+/* Stored form if it is shorter than value, value itself otherwise */
+std::string compressValue(const std::string &value);
+
+bool        isCompressed(const std::string &stored);
+
+/* Raw value of stored form, false if it is corrupt */
+bool        expandValue(const std::string &stored, std::string *value);
+
+#endif /* __COMPRESS_H__ */
@@ -0,0 +1,403 @@
+#include "config.h"
+#include "affinity.h"
+#include "segment.h"
+#include "stats.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//+----------------------------------------------------------------------------+
+//| Default namespace: geometry of the default table, no cap, no eviction      |
+//+----------------------------------------------------------------------------+
+
+NamespaceConfig::NamespaceConfig()
+    : keySize(MAX_KEY_SIZE - 1),
+      valueSize(MAX_VALUE_SIZE - 1),
+      memory(MAX_CACHE_SIZE),
+      stripes(1),
+      maxTTL(0),
+      evict(false) {}
+
+//+----------------------------------------------------------------------------+
+//| Default configuration                                                      |
+//+----------------------------------------------------------------------------+
+
+Config::Config()
+    : ip(DEFAULT_IP),
+      port(DEFAULT_PORT),
+      numWorkers(NUM_WORKERS),
+      shmFilename(SHM_FILE),
+      semFile(SEM_FILE),
+      snapshotInterval(SNAPSHOT_INTERVAL),
+      controlPath(CONTROL_PATH),
+      upgrade(false),
+      drainTimeout(DRAIN_TIMEOUT),
+      aofCommitMs(AOF_COMMIT_MS),
+      aofRewriteSize(AOF_REWRITE_SIZE),
+      replPort(0),
+      replIntervalMs(REPL_INTERVAL_MS),
+      partitioned(false),
+      metricsPort(0),
+      captureRate(1.0),
+      captureBinary(false),
+      nearCache(0),
+      hotKeys(HOT_KEYS),
+      compressThreshold(0),
+      proxyConns(PROXY_CONNS),
+      outputSoftLimit(OUTPUT_SOFT_LIMIT),
+      outputHardLimit(OUTPUT_HARD_LIMIT),
+      numaPolicy(NUMA_DEFAULT) {}
+
+//+----------------------------------------------------------------------------+
+//| Print usage                                                                |
+//+----------------------------------------------------------------------------+
+
+static void usage(const char *name) {
+
+    printf("usage: %s [options]\n", name);
+    printf("  --ip <addr>                 listen address (default %s)\n", DEFAULT_IP.c_str());
+    printf("  --port <port>               listen port (default %d)\n", DEFAULT_PORT);
+    printf("  --unix <path>               also accept local clients on unix socket\n");
+    printf("  --workers <n>               number of worker processes (default %d, at most %lu)\n",
+           NUM_WORKERS, MAX_WORKERS);
+    printf("  --shm <name>                shared memory segment name (default %s)\n", SHM_FILE.c_str());
+    printf("  --sem <name>                semaphore name (default %s)\n", SEM_FILE.c_str());
+    printf("  --snapshot <file>           load table from and periodically save it to file\n");
+    printf("  --snapshot-interval <sec>   seconds between snapshots (default %d)\n", SNAPSHOT_INTERVAL);
+    printf("  --image <file>              start from table image built by mycache-load\n");
+    printf("  --control <path>            control socket for hot upgrades (default %s)\n", CONTROL_PATH.c_str());
+    printf("  --upgrade                   take over table and listener of running server\n");
+    printf("  --drain-timeout <sec>       how long old workers serve clients (default %d)\n", DRAIN_TIMEOUT);
+    printf("  --aof <file>                log mutations to file and replay it on start\n");
+    printf("  --aof-commit-ms <ms>        group commit interval (default %d)\n", AOF_COMMIT_MS);
+    printf("  --aof-rewrite-size <bytes>  compact log when it grows past size (default %ld)\n", AOF_REWRITE_SIZE);
+    printf("  --repl-port <port>          accept replicas on port\n");
+    printf("  --repl-interval-ms <ms>     batch interval of replication feed (default %d)\n", REPL_INTERVAL_MS);
+    printf("  --replica-of <host:port>    run as read-only replica of primary\n");
+    printf("  --partitioned               one table partition per worker, forward other keys\n");
+    printf("  --metrics-port <port>       serve Prometheus metrics over HTTP on port\n");
+    printf("  --capture <path>            trace requests to <path>.<worker pid>\n");
+    printf("  --capture-rate <0..1>       share of connections traced (default 1)\n");
+    printf("  --capture-format <fmt>      jsonl or binary (default jsonl)\n");
+    printf("  --near-cache <entries>      per-worker cache of hot keys (default off)\n");
+    printf("  --hot-keys <counters>       per-worker heavy hitter sketch, 0 = off (default %d)\n", HOT_KEYS);
+    printf("  --compress-threshold <len>  store values of at least len bytes compressed (default off)\n");
+    printf("  --proxy <host:port,...>     run as proxy sharding keys over these servers\n");
+    printf("  --proxy-conns <n>           connections per backend in proxy mode (default %d)\n", PROXY_CONNS);
+    printf("  --output-soft-limit <bytes> stop reading from client with more unsent replies\n");
+    printf("                              (default %ld, 0 = never)\n", OUTPUT_SOFT_LIMIT);
+    printf("  --output-hard-limit <bytes> drop client with more unsent replies (default %ld, 0 = never)\n",
+           OUTPUT_HARD_LIMIT);
+    printf("  --worker-cpus <list>        pin workers to CPUs of list like 2-7,10, one CPU each\n");
+    printf("  --service-cpus <list>       run server, cleaner and replication on these CPUs\n");
+    printf("  --numa <policy>             segment pages: default (first touch), interleave, or\n");
+    printf("                              partition (node of owner's CPU, needs --partitioned;\n");
+    printf("                              named tables interleaved)\n");
+    printf("  --namespace <name>[:opts]   add named table, opts are comma separated: key=<len>,\n");
+    printf("                              value=<len>,memory=<bytes>[k|m|g],stripes=<n>,\n");
+    printf("                              max-ttl=<sec>,evict (repeat for up to %lu tables)\n",
+           MAX_NAMESPACES);
+}
+
+//+----------------------------------------------------------------------------+
+//| Size with optional k, m or g suffix                                        |
+//+----------------------------------------------------------------------------+
+
+static size_t parseSize(const std::string &s) {
+
+    char *end;
+    size_t size = strtoull(s.c_str(), &end, 10);
+
+    switch (*end) {
+    case 'k': case 'K': size <<= 10; end++; break;
+    case 'm': case 'M': size <<= 20; end++; break;
+    case 'g': case 'G': size <<= 30; end++; break;
+    }
+
+    return (*end || s.empty()) ? 0 : size;
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse "<name>[:key=..,value=..,memory=..,stripes=..,max-ttl=..,evict]"     |
+//+----------------------------------------------------------------------------+
+
+static int parseNamespace(const std::string &spec, NamespaceConfig *ns) {
+
+    size_t colon = spec.find(':');
+    ns->name = spec.substr(0, colon);
+    if (ns->name.empty() || ns->name.size() >= NAMESPACE_NAME_SIZE || ns->name == "default" ||
+        ns->name.find_first_of(" \t\r\n") != std::string::npos)
+        return -1;
+
+    std::string opts = (colon == std::string::npos) ? "" : spec.substr(colon + 1);
+    size_t pos = 0;
+    while (pos < opts.size()) {
+        size_t comma = opts.find(',', pos);
+        if (comma == std::string::npos)
+            comma = opts.size();
+        std::string opt = opts.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t eq = opt.find('=');
+        std::string name  = opt.substr(0, eq);
+        std::string value = (eq == std::string::npos) ? "" : opt.substr(eq + 1);
+
+        if (name == "key")
+            ns->keySize = parseSize(value);
+        else if (name == "value")
+            ns->valueSize = parseSize(value);
+        else if (name == "memory")
+            ns->memory = parseSize(value);
+        else if (name == "stripes")
+            ns->stripes = parseSize(value);
+        else if (name == "max-ttl")
+            ns->maxTTL = atoi(value.c_str());
+        else if (name == "evict" && eq == std::string::npos)
+            ns->evict = true;
+        else
+            return -1;
+    }
+
+    if (ns->keySize < 1 || ns->valueSize < 1 || ns->maxTTL < 0 ||
+        ns->stripes < 1 || ns->stripes > MAX_STRIPES)
+        return -1;
+
+    CHashTable geometry(ns->memory, ns->keySize + 1, ns->valueSize + 1);
+    if (geometry.getTableSize() < ns->stripes)
+        return -1;
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse command line                                                         |
+//+----------------------------------------------------------------------------+
+
+int Config::parse(int argc, char *argv[]) {
+
+    enum {
+        OPT_IP = 1,
+        OPT_PORT,
+        OPT_UNIX,
+        OPT_WORKERS,
+        OPT_SHM,
+        OPT_SEM,
+        OPT_SNAPSHOT,
+        OPT_SNAPSHOT_INTERVAL,
+        OPT_IMAGE,
+        OPT_CONTROL,
+        OPT_UPGRADE,
+        OPT_DRAIN_TIMEOUT,
+        OPT_AOF,
+        OPT_AOF_COMMIT_MS,
+        OPT_AOF_REWRITE_SIZE,
+        OPT_REPL_PORT,
+        OPT_REPL_INTERVAL_MS,
+        OPT_REPLICA_OF,
+        OPT_PARTITIONED,
+        OPT_METRICS_PORT,
+        OPT_CAPTURE,
+        OPT_CAPTURE_RATE,
+        OPT_CAPTURE_FORMAT,
+        OPT_NEAR_CACHE,
+        OPT_HOT_KEYS,
+        OPT_COMPRESS_THRESHOLD,
+        OPT_PROXY,
+        OPT_PROXY_CONNS,
+        OPT_OUTPUT_SOFT_LIMIT,
+        OPT_OUTPUT_HARD_LIMIT,
+        OPT_WORKER_CPUS,
+        OPT_SERVICE_CPUS,
+        OPT_NUMA,
+        OPT_NAMESPACE,
+        OPT_HELP
+    };
+
+    static struct option options[] = {
+        { "ip",                 required_argument, nullptr, OPT_IP                 },
+        { "port",               required_argument, nullptr, OPT_PORT               },
+        { "unix",               required_argument, nullptr, OPT_UNIX               },
+        { "workers",            required_argument, nullptr, OPT_WORKERS            },
+        { "shm",                required_argument, nullptr, OPT_SHM                },
+        { "sem",                required_argument, nullptr, OPT_SEM                },
+        { "snapshot",           required_argument, nullptr, OPT_SNAPSHOT           },
+        { "snapshot-interval",  required_argument, nullptr, OPT_SNAPSHOT_INTERVAL  },
+        { "image",              required_argument, nullptr, OPT_IMAGE              },
+        { "control",            required_argument, nullptr, OPT_CONTROL            },
+        { "upgrade",            no_argument,       nullptr, OPT_UPGRADE            },
+        { "drain-timeout",      required_argument, nullptr, OPT_DRAIN_TIMEOUT      },
+        { "aof",                required_argument, nullptr, OPT_AOF                },
+        { "aof-commit-ms",      required_argument, nullptr, OPT_AOF_COMMIT_MS      },
+        { "aof-rewrite-size",   required_argument, nullptr, OPT_AOF_REWRITE_SIZE   },
+        { "repl-port",          required_argument, nullptr, OPT_REPL_PORT          },
+        { "repl-interval-ms",   required_argument, nullptr, OPT_REPL_INTERVAL_MS   },
+        { "replica-of",         required_argument, nullptr, OPT_REPLICA_OF         },
+        { "partitioned",        no_argument,       nullptr, OPT_PARTITIONED        },
+        { "metrics-port",       required_argument, nullptr, OPT_METRICS_PORT       },
+        { "capture",            required_argument, nullptr, OPT_CAPTURE            },
+        { "capture-rate",       required_argument, nullptr, OPT_CAPTURE_RATE       },
+        { "capture-format",     required_argument, nullptr, OPT_CAPTURE_FORMAT     },
+        { "near-cache",         required_argument, nullptr, OPT_NEAR_CACHE         },
+        { "hot-keys",           required_argument, nullptr, OPT_HOT_KEYS           },
+        { "compress-threshold", required_argument, nullptr, OPT_COMPRESS_THRESHOLD },
+        { "proxy",              required_argument, nullptr, OPT_PROXY              },
+        { "proxy-conns",        required_argument, nullptr, OPT_PROXY_CONNS        },
+        { "output-soft-limit",  required_argument, nullptr, OPT_OUTPUT_SOFT_LIMIT  },
+        { "output-hard-limit",  required_argument, nullptr, OPT_OUTPUT_HARD_LIMIT  },
+        { "worker-cpus",        required_argument, nullptr, OPT_WORKER_CPUS        },
+        { "service-cpus",       required_argument, nullptr, OPT_SERVICE_CPUS       },
+        { "numa",               required_argument, nullptr, OPT_NUMA               },
+        { "namespace",          required_argument, nullptr, OPT_NAMESPACE          },
+        { "help",               no_argument,       nullptr, OPT_HELP               },
+        { nullptr,             0,                 nullptr, 0                     }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_IP:
+            ip = optarg;
+            break;
+        case OPT_PORT:
+            port = atoi(optarg);
+            break;
+        case OPT_UNIX:
+            unixPath = optarg;
+            break;
+        case OPT_WORKERS:
+            numWorkers = atoi(optarg);
+            break;
+        case OPT_SHM:
+            shmFilename = optarg;
+            break;
+        case OPT_SEM:
+            semFile = optarg;
+            break;
+        case OPT_SNAPSHOT:
+            snapshotPath = optarg;
+            break;
+        case OPT_SNAPSHOT_INTERVAL:
+            snapshotInterval = atoi(optarg);
+            break;
+        case OPT_IMAGE:
+            imagePath = optarg;
+            break;
+        case OPT_CONTROL:
+            controlPath = optarg;
+            break;
+        case OPT_UPGRADE:
+            upgrade = true;
+            break;
+        case OPT_DRAIN_TIMEOUT:
+            drainTimeout = atoi(optarg);
+            break;
+        case OPT_AOF:
+            aofPath = optarg;
+            break;
+        case OPT_AOF_COMMIT_MS:
+            aofCommitMs = atoi(optarg);
+            break;
+        case OPT_AOF_REWRITE_SIZE:
+            aofRewriteSize = atol(optarg);
+            break;
+        case OPT_REPL_PORT:
+            replPort = atoi(optarg);
+            break;
+        case OPT_REPL_INTERVAL_MS:
+            replIntervalMs = atoi(optarg);
+            break;
+        case OPT_REPLICA_OF:
+            replicaOf = optarg;
+            break;
+        case OPT_PARTITIONED:
+            partitioned = true;
+            break;
+        case OPT_METRICS_PORT:
+            metricsPort = atoi(optarg);
+            break;
+        case OPT_CAPTURE:
+            capturePath = optarg;
+            break;
+        case OPT_CAPTURE_RATE:
+            captureRate = atof(optarg);
+            break;
+        case OPT_CAPTURE_FORMAT:
+            if (std::string(optarg) == "binary") {
+                captureBinary = true;
+            } else if (std::string(optarg) != "jsonl") {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case OPT_NEAR_CACHE:
+            nearCache = atoi(optarg);
+            break;
+        case OPT_HOT_KEYS:
+            hotKeys = atoi(optarg);
+            break;
+        case OPT_COMPRESS_THRESHOLD:
+            compressThreshold = atoi(optarg);
+            break;
+        case OPT_PROXY:
+            proxyBackends = optarg;
+            break;
+        case OPT_PROXY_CONNS:
+            proxyConns = atoi(optarg);
+            break;
+        case OPT_OUTPUT_SOFT_LIMIT:
+            outputSoftLimit = atol(optarg);
+            break;
+        case OPT_OUTPUT_HARD_LIMIT:
+            outputHardLimit = atol(optarg);
+            break;
+        case OPT_WORKER_CPUS:
+        case OPT_SERVICE_CPUS:
+            if (parseCpuList(optarg, opt == OPT_WORKER_CPUS ? &workerCpus : &serviceCpus) == -1) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case OPT_NUMA:
+            if (std::string(optarg) == "interleave") {
+                numaPolicy = NUMA_INTERLEAVE;
+            } else if (std::string(optarg) == "partition") {
+                numaPolicy = NUMA_PARTITION;
+            } else if (std::string(optarg) != "default") {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case OPT_NAMESPACE: {
+            NamespaceConfig ns;
+            if (parseNamespace(optarg, &ns) == -1 || namespaces.size() == MAX_NAMESPACES) {
+                printf("[config]:\tbad namespace %s\n", optarg);
+                return -1;
+            }
+            for (size_t i = 0; i < namespaces.size(); ++i) {
+                if (namespaces[i].name == ns.name) {
+                    printf("[config]:\tnamespace %s given twice\n", optarg);
+                    return -1;
+                }
+            }
+            namespaces.push_back(ns);
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (numWorkers <= 0 || snapshotInterval <= 0 || drainTimeout < 0 ||
+        aofCommitMs <= 0 || aofRewriteSize <= 0 || replIntervalMs <= 0 ||
+        (size_t)numWorkers > MAX_WORKERS || captureRate < 0 || captureRate > 1 ||
+        nearCache < 0 || hotKeys < 0 || compressThreshold < 0 || proxyConns <= 0 ||
+        outputSoftLimit < 0 || outputHardLimit < 0 ||
+        (outputHardLimit && outputSoftLimit > outputHardLimit) ||
+        (numaPolicy == NUMA_PARTITION && (!partitioned || workerCpus.empty()))) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static const std::string SHM_FILE          = "shared_ht";
+static const std::string SEM_FILE          = "mycache_sem";
+static const std::string DEFAULT_IP        = "127.0.0.1";
+static const uint16_t    DEFAULT_PORT      = 8080;
+static const int         NUM_WORKERS       = 4;
+static const int         SNAPSHOT_INTERVAL = 60;
+static const std::string CONTROL_PATH      = "/tmp/mycache.ctl";
+static const int         DRAIN_TIMEOUT     = 30;
+static const int         AOF_COMMIT_MS     = 10;
+static const long        AOF_REWRITE_SIZE  = 16 * 1024 * 1024;
+static const int         REPL_INTERVAL_MS  = 10;
+static const int         HOT_KEYS          = 128;
+static const int         PROXY_CONNS       = 2;
+static const long        OUTPUT_SOFT_LIMIT = 1024 * 1024;
+static const long        OUTPUT_HARD_LIMIT = 32 * 1024 * 1024;
+
+//+----------------------------------------------------------------------------+
+//| Named table next to the default one                                        |
+//+----------------------------------------------------------------------------+
+
+struct NamespaceConfig {
+    std::string name;
+    size_t      keySize;    /* longest key */
+    size_t      valueSize;  /* longest value */
+    size_t      memory;     /* bytes of table */
+    size_t      stripes;    /* lock stripes, keys probe inside their own */
+    int         maxTTL;     /* longer TTLs are cut to this (0 = no cap) */
+    bool        evict;      /* full stripe evicts entry nearest to expiry */
+
+    NamespaceConfig();
+};
+
+//+----------------------------------------------------------------------------+
+//| Server configuration                                                       |
+//+----------------------------------------------------------------------------+
+
+struct Config {
+    /* Listener */
+    std::string ip;
+    uint16_t    port;
+    int         numWorkers;
+
+    /* Local clients: unix stream socket next to TCP (disabled if path is empty) */
+    std::string unixPath;
+
+    /* Shared memory */
+    std::string shmFilename;
+    std::string semFile;
+
+    /* Snapshots (disabled if path is empty) */
+    std::string snapshotPath;
+    int         snapshotInterval;
+
+    /* Table image built offline, loaded when there is no snapshot yet */
+    std::string imagePath;
+
+    /* Hot upgrade: adopt running server via control socket */
+    std::string controlPath;
+    bool        upgrade;
+    int         drainTimeout;
+
+    /* Append-only log (disabled if path is empty) */
+    std::string aofPath;
+    int         aofCommitMs;
+    long        aofRewriteSize;
+
+    /* Replication: serve replicas on port (0 = off) or follow a primary */
+    uint16_t    replPort;
+    int         replIntervalMs;
+    std::string replicaOf;
+
+    /* Shared-nothing mode: each worker owns one partition of the table */
+    bool        partitioned;
+
+    /* Prometheus endpoint served by the server process (0 = off) */
+    uint16_t    metricsPort;
+
+    /* Request trace of sampled connections (disabled if path is empty) */
+    std::string capturePath;
+    double      captureRate;
+    bool        captureBinary;
+
+    /* Entries of per-worker near-cache for hot keys (0 = off) */
+    int         nearCache;
+
+    /* Counters of per-worker heavy hitter sketch (0 = off) */
+    int         hotKeys;
+
+    /* Values at least this long are stored compressed (0 = off) */
+    int         compressThreshold;
+
+    /* Proxy mode: shard over "host:port,..." with connections per backend */
+    std::string proxyBackends;
+    int         proxyConns;
+
+    /* Unsent replies of a client: reading pauses over soft, client is
+       dropped over hard limit (0 = no limit) */
+    long        outputSoftLimit;
+    long        outputHardLimit;
+
+    /* Placement: worker i runs on workerCpus[i % n], other processes on
+       serviceCpus (empty = anywhere), segment pages by NUMA_* policy */
+    std::vector<int> workerCpus;
+    std::vector<int> serviceCpus;
+    int         numaPolicy;
+
+    /* Named tables, selected by "use <name>" or "in <name> <query>" */
+    std::vector<NamespaceConfig> namespaces;
+
+    Config();
+
+    int parse(int argc, char *argv[]);
+};
+
+#endif /* __CONFIG_H__ */
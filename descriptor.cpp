@@ -0,0 +1,105 @@
+#include "descriptor.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+//+----------------------------------------------------------------------------+
+//| Send descriptor with one byte tag                                          |
+//+----------------------------------------------------------------------------+
+
+int sendDescriptor(int sock, int fd, char tag) {
+
+    const int BUF_LEN = 1;
+    char buf[BUF_LEN] = { tag };
+
+    /* Send fd in message */
+    ssize_t       size;
+    struct msghdr msg;
+    struct iovec  iov;
+    union {
+        struct cmsghdr cmsghdr;
+        char control[CMSG_SPACE(sizeof(int))];
+    } cmsgu;
+    struct cmsghdr *cmsg;
+
+    iov.iov_base = buf;
+    iov.iov_len  = BUF_LEN;
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov     = &iov;
+    msg.msg_iovlen  = 1;
+    msg.msg_flags   = 0;
+
+    msg.msg_control = cmsgu.control;
+    msg.msg_controllen = sizeof(cmsgu.control);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+
+    *((int *)CMSG_DATA(cmsg)) = fd;
+    size = sendmsg(sock, &msg, 0);
+
+    if (size == -1) {
+        std::cout << "[sendmsg]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Receive descriptor and its tag                                             |
+//+----------------------------------------------------------------------------+
+
+int receiveDescriptor(int sock, char *tag) {
+
+    ssize_t size;
+
+    const int BUF_LEN = 1;
+    char buf[BUF_LEN] = { 0 };
+
+    struct msghdr msg;
+    struct iovec  iov;
+    union {
+        struct cmsghdr cmsghdr;
+        char control[CMSG_SPACE(sizeof(int))];
+    } cmsgu;
+    struct cmsghdr *cmsg;
+
+    iov.iov_base = (void *)buf;
+    iov.iov_len  = BUF_LEN;
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov     = &iov;
+    msg.msg_iovlen  = 1;
+    msg.msg_flags   = 0;
+    msg.msg_control = cmsgu.control;
+    msg.msg_controllen = sizeof(cmsgu.control);
+
+    size = recvmsg(sock, &msg, 0);
+    if (size < 0) {
+        std::cout << "[recvmsg]:\t" << strerror(errno) << std::endl;
+        return -2;
+    }
+    if (tag)
+        *tag = buf[0];
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            printf("[recvmsg]:\tinvalid cmsg_level %d\n", cmsg->cmsg_level);
+            return -2;
+        }
+        if (cmsg->cmsg_type != SCM_RIGHTS) {
+            printf("[recvmsg]:\tinvalid cmsg_type %d\n", cmsg->cmsg_type);
+            return -2;
+        }
+        return *((int *)CMSG_DATA(cmsg));
+    }
+
+    return -1;
+}
@@ -0,0 +1,16 @@
+#ifndef __DESCRIPTOR_H__
+#define __DESCRIPTOR_H__
+
+#include <sys/socket.h>
+
+//+----------------------------------------------------------------------------+
+//| Pass descriptors over UNIX sockets (SCM_RIGHTS)                            |
+//+----------------------------------------------------------------------------+
+
+/* Returns 0 on success, -1 on error */
+int sendDescriptor(int sock, int fd, char tag = 0);
+
+/* Returns descriptor, -1 if message carried none, -2 on error */
+int receiveDescriptor(int sock, char *tag = nullptr);
+
+#endif /* __DESCRIPTOR_H__ */
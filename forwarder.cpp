@@ -0,0 +1,123 @@
+#include "forwarder.h"
+#include <errno.h>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+//+----------------------------------------------------------------------------+
+//| Forwarder constructor                                                      |
+//+----------------------------------------------------------------------------+
+
+Forwarder::Forwarder(Segment *segment, int set, size_t self,
+                     const std::vector<std::pair<int, int>> &pipes)
+    : self(self), peers(segment->partitions()), nextPeer(0),
+      overflow(peers), dirty(peers, false) {
+
+    for (size_t p = 0; p < peers; ++p) {
+        inbox.push_back(Ring(segment->ring(set, p, self), RING_SIZE));
+        outbox.push_back(Ring(segment->ring(set, self, p), RING_SIZE));
+        peerFds.push_back(pipes[p].second);
+    }
+    notifyFd = pipes[self].first;
+}
+
+//+----------------------------------------------------------------------------+
+//| Send message to partition owner                                            |
+//+----------------------------------------------------------------------------+
+
+bool Forwarder::send(size_t peer, uint32_t type, uint64_t token, const std::string &payload) {
+
+    /* Would block every later message to peer */
+    if (!outbox[peer].fits(payload.size()))
+        return false;
+
+    /* Keep order: nothing may overtake messages already waiting */
+    if (overflow[peer].empty() && outbox[peer].push(type, token, payload)) {
+        dirty[peer] = true;
+        return true;
+    }
+
+    ForwardMsg msg = { peer, type, token, payload };
+    overflow[peer].push_back(msg);
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Receive message from any peer (round robin)                                |
+//+----------------------------------------------------------------------------+
+
+bool Forwarder::receive(ForwardMsg *msg) {
+
+    for (size_t i = 0; i < peers; ++i) {
+        size_t p = (nextPeer + i) % peers;
+        if (p == self)
+            continue;
+        if (inbox[p].pop(&msg->type, &msg->token, &msg->payload)) {
+            msg->peer = p;
+            nextPeer = p + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+//+----------------------------------------------------------------------------+
+//| Retry overflow and notify peers                                            |
+//+----------------------------------------------------------------------------+
+
+void Forwarder::flush() {
+
+    for (size_t p = 0; p < peers; ++p) {
+        while (!overflow[p].empty()) {
+            const ForwardMsg &msg = overflow[p].front();
+            if (!outbox[p].push(msg.type, msg.token, msg.payload))
+                break;
+            overflow[p].pop_front();
+            dirty[p] = true;
+        }
+
+        /* One wake-up per peer per batch; a full pipe means it's awake anyway */
+        if (dirty[p]) {
+            char c = 0;
+            if (write(peerFds[p], &c, 1) == -1 && errno != EAGAIN)
+                std::cout << "[write]:\t" << strerror(errno) << std::endl;
+            dirty[p] = false;
+        }
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Check for messages waiting for ring space                                  |
+//+----------------------------------------------------------------------------+
+
+bool Forwarder::pending() const {
+
+    for (size_t p = 0; p < peers; ++p) {
+        if (!overflow[p].empty())
+            return true;
+    }
+    return false;
+}
+
+//+----------------------------------------------------------------------------+
+//| Count messages waiting for ring space                                      |
+//+----------------------------------------------------------------------------+
+
+size_t Forwarder::backlog() const {
+
+    size_t count = 0;
+    for (size_t p = 0; p < peers; ++p)
+        count += overflow[p].size();
+    return count;
+}
+
+//+----------------------------------------------------------------------------+
+//| Consume wake-ups                                                           |
+//+----------------------------------------------------------------------------+
+
+void Forwarder::drainNotify() {
+
+    char buf[256];
+    while (read(notifyFd, buf, sizeof(buf)) > 0)
+        ;
+}
@@ -0,0 +1,62 @@
+#ifndef __FORWARDER_H__
+#define __FORWARDER_H__
+
+#include "ring.h"
+#include "segment.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+/* Messages waiting for ring space before senders stop reading clients */
+static const size_t FORWARD_MAX_PENDING = 4096;
+
+//+----------------------------------------------------------------------------+
+//| Message between partition owners                                           |
+//+----------------------------------------------------------------------------+
+
+struct ForwardMsg {
+    size_t      peer;
+    uint32_t    type;
+    uint64_t    token;
+    std::string payload;
+};
+
+//+----------------------------------------------------------------------------+
+//| Forwarder class: rings to and from every other partition owner             |
+//+----------------------------------------------------------------------------+
+
+class Forwarder {
+    size_t                  self;
+    size_t                  peers;
+    size_t                  nextPeer;
+    std::vector<Ring>       inbox;
+    std::vector<Ring>       outbox;
+    std::vector<std::deque<ForwardMsg>> overflow;
+    std::vector<bool>       dirty;
+
+    /* Wake-up pipes: read own, write peers' */
+    int                     notifyFd;
+    std::vector<int>        peerFds;
+
+public:
+    Forwarder(Segment *segment, int set, size_t self,
+              const std::vector<std::pair<int, int>> &pipes);
+
+    /* Queue message (kept locally while peer's ring is full);
+       false if it never fits a ring and was not queued */
+    bool send(size_t peer, uint32_t type, uint64_t token, const std::string &payload);
+    bool fits(const std::string &payload) const { return outbox[self].fits(payload.size()); }
+
+    /* Next message from any peer */
+    bool receive(ForwardMsg *msg);
+
+    /* Retry overflow and wake peers that got messages */
+    void flush();
+    bool pending() const;
+    size_t backlog() const;
+
+    int  fd() const { return notifyFd; }
+    void drainNotify();
+};
+
+#endif /* __FORWARDER_H__ */
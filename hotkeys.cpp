@@ -0,0 +1,189 @@
+#include "hotkeys.h"
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+//+----------------------------------------------------------------------------+
+//| Restore heap order below counter i after its count grew                    |
+//+----------------------------------------------------------------------------+
+
+void HotKeys::siftDown(size_t i) {
+
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+
+        if (left < heap.size() && heap[left].count < heap[smallest].count)
+            smallest = left;
+        if (right < heap.size() && heap[right].count < heap[smallest].count)
+            smallest = right;
+        if (smallest == i)
+            return;
+
+        std::swap(heap[i], heap[smallest]);
+        index[heap[i].key] = i;
+        index[heap[smallest].key] = smallest;
+        i = smallest;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Count request for key moving bytes over the wire                           |
+//+----------------------------------------------------------------------------+
+
+void HotKeys::add(const std::string &key, size_t bytes) {
+
+    /* Halving keeps heap order, so no rebuild is needed */
+    time_t now = time(nullptr);
+    if (now - decayedAt >= HOT_KEYS_DECAY) {
+        for (size_t i = 0; i < heap.size(); ++i) {
+            heap[i].count >>= 1;
+            heap[i].error >>= 1;
+            heap[i].bytes >>= 1;
+        }
+        decayedAt = now;
+    }
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        Counter &c = heap[it->second];
+        c.count++;
+        c.bytes += bytes;
+        siftDown(it->second);
+        return;
+    }
+
+    if (heap.size() < capacity) {
+        /* New minimum-or-more counter with count 1 goes to the top */
+        Counter c = { key, 1, 0, bytes };
+        heap.push_back(c);
+        size_t i = heap.size() - 1;
+        index[key] = i;
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            std::swap(heap[i], heap[(i - 1) / 2]);
+            index[heap[i].key] = i;
+            index[heap[(i - 1) / 2].key] = (i - 1) / 2;
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+
+    /* Take over minimum counter */
+    Counter &min = heap[0];
+    index.erase(min.key);
+    min.error = min.count;
+    min.count++;
+    min.key   = key;
+    min.bytes = bytes;
+    index[key] = 0;
+    siftDown(0);
+}
+
+//+----------------------------------------------------------------------------+
+//| Copy top counters to shared memory                                         |
+//+----------------------------------------------------------------------------+
+
+void HotKeys::publish(HotKeySummary *summary) {
+
+    std::vector<const Counter *> top;
+    for (size_t i = 0; i < heap.size(); ++i)
+        top.push_back(&heap[i]);
+
+    size_t n = std::min(top.size(), HOT_KEYS_PUBLISHED);
+    std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                      [](const Counter *a, const Counter *b) { return a->count > b->count; });
+
+    __atomic_add_fetch(&summary->seq, 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (size_t i = 0; i < n; ++i) {
+        HotKey &k = summary->keys[i];
+        strncpy(k.key, top[i]->key.c_str(), MAX_KEY_SIZE - 1);
+        k.key[MAX_KEY_SIZE - 1] = '\0';
+        k.count = top[i]->count;
+        k.error = top[i]->error;
+        k.bytes = top[i]->bytes;
+    }
+    summary->size      = n;
+    summary->updatedAt = time(nullptr);
+
+    __atomic_add_fetch(&summary->seq, 1, __ATOMIC_RELEASE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Clear summary of slot before first publish                                 |
+//+----------------------------------------------------------------------------+
+
+void HotKeys::reset(HotKeySummary *summary) {
+
+    __atomic_add_fetch(&summary->seq, 1, __ATOMIC_RELEASE);
+    summary->size      = 0;
+    summary->updatedAt = 0;
+    __atomic_add_fetch(&summary->seq, 1, __ATOMIC_RELEASE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Read consistent copy of summary                                            |
+//+----------------------------------------------------------------------------+
+
+bool HotKeys::read(const HotKeySummary *summary, HotKeySummary *copy) {
+
+    /* Writer holds the slot for microseconds: a few tries are enough */
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        uint64_t before = __atomic_load_n(&summary->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+
+        memcpy(copy, summary, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&summary->seq, __ATOMIC_ACQUIRE) == before)
+            return copy->size > 0 && copy->size <= HOT_KEYS_PUBLISHED &&
+                   time(nullptr) - copy->updatedAt <= HOT_KEYS_STALE;
+    }
+
+    return false;
+}
+
+//+----------------------------------------------------------------------------+
+//| Merge summaries into report of n heaviest keys                             |
+//+----------------------------------------------------------------------------+
+
+std::string HotKeys::report(const std::vector<HotKeySummary> &summaries, size_t n) {
+
+    /* Counts of a key add up across workers, so do their error bounds */
+    std::map<std::string, HotKey> merged;
+    for (size_t s = 0; s < summaries.size(); ++s) {
+        for (size_t i = 0; i < summaries[s].size; ++i) {
+            const HotKey &k = summaries[s].keys[i];
+            auto it = merged.find(k.key);
+            if (it == merged.end()) {
+                merged[k.key] = k;
+            } else {
+                it->second.count += k.count;
+                it->second.error += k.error;
+                it->second.bytes += k.bytes;
+            }
+        }
+    }
+
+    std::vector<const HotKey *> top;
+    for (auto it = merged.begin(); it != merged.end(); ++it)
+        top.push_back(&it->second);
+    n = std::min(n, top.size());
+    std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                      [](const HotKey *a, const HotKey *b) { return a->count > b->count; });
+
+    std::string out;
+    for (size_t i = 0; i < n; ++i) {
+        out.append("hotkey ");
+        out.append(top[i]->key);
+        out.append(" count " + std::to_string(top[i]->count));
+        out.append(" error " + std::to_string(top[i]->error));
+        out.append(" bytes " + std::to_string(top[i]->bytes));
+        out.append("\n");
+    }
+    out.append("end\n");
+
+    return out;
+}
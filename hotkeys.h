@@ -0,0 +1,85 @@
+#ifndef __HOTKEYS_H__
+#define __HOTKEYS_H__
+
+#include "htable.h"
+#include "stats.h"
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Keys published per worker, publish period, age after which a summary is ignored */
+static const size_t HOT_KEYS_PUBLISHED = 32;
+static const int    HOT_KEYS_PUBLISH_MS = 1000;
+static const int    HOT_KEYS_STALE      = 5;
+
+/* Counts are halved this often so the report follows current traffic */
+static const int    HOT_KEYS_DECAY      = 60;
+
+//+----------------------------------------------------------------------------+
+//| Heavy hitter with its overestimation bound                                 |
+//+----------------------------------------------------------------------------+
+
+struct HotKey {
+    char     key[MAX_KEY_SIZE];
+    uint64_t count;
+    uint64_t error;
+    uint64_t bytes;
+};
+
+//+----------------------------------------------------------------------------+
+//| Summary published by one worker (seqlock: odd seq while being written)     |
+//+----------------------------------------------------------------------------+
+
+struct HotKeySummary {
+    uint64_t seq;
+    int64_t  updatedAt;
+    uint64_t size;
+    HotKey   keys[HOT_KEYS_PUBLISHED];
+} __attribute__((aligned(CACHE_LINE)));
+
+//+----------------------------------------------------------------------------+
+//| Space-Saving sketch of one worker                                          |
+//|                                                                            |
+//| Keeps capacity counters in a min-heap on count. A tracked key bumps its    |
+//| counter; an untracked one takes over the minimum counter and inherits its  |
+//| count as error, so counts overestimate by at most error. Both are          |
+//| O(log capacity).                                                           |
+//+----------------------------------------------------------------------------+
+
+class HotKeys {
+    struct Counter {
+        std::string key;
+        uint64_t    count;
+        uint64_t    error;
+        uint64_t    bytes;
+    };
+
+    size_t                                  capacity;
+    std::vector<Counter>                    heap;
+    std::unordered_map<std::string, size_t> index;
+    time_t                                  decayedAt;
+
+    void siftDown(size_t i);
+
+public:
+    HotKeys(size_t capacity) : capacity(capacity), decayedAt(time(nullptr)) {}
+
+    /* Count request for key moving bytes over the wire */
+    void add(const std::string &key, size_t bytes);
+
+    /* Copy top counters to shared memory */
+    void publish(HotKeySummary *summary);
+
+    /* Clear summary of slot before first publish */
+    static void reset(HotKeySummary *summary);
+
+    /* Read consistent copy of summary, false if empty or stale */
+    static bool read(const HotKeySummary *summary, HotKeySummary *copy);
+
+    /* Merge summaries into report of n heaviest keys */
+    static std::string report(const std::vector<HotKeySummary> &summaries, size_t n);
+};
+
+#endif /* __HOTKEYS_H__ */
@@ -1,18 +1,26 @@
 #include "htable.h"
+#include <algorithm>
 
 //+----------------------------------------------------------------------------+
 //| Hash table class constructor                                               |
 //+----------------------------------------------------------------------------+
 
 CHashTable::CHashTable(size_t cacheSize, size_t keySize, size_t valueSize)
-    : shmFile(-1),
-      hTable(nullptr),
-      cacheSize(cacheSize),
+    : cacheSize(cacheSize),
       keySize(keySize),
-      valueSize(valueSize) {
+      valueSize(valueSize),
+      hTable(nullptr),
+      stats(nullptr),
+      probes(0),
+      probeLimits(nullptr),
+      versions(nullptr),
+      changeHook(nullptr),
+      hookArg(nullptr) {
 
     entrySize = 2 * sizeof(bool) + (keySize + 1) + (valueSize + 1) + sizeof(size_t);
     tableSize = cacheSize / entrySize;
+    partitions = 1;
+    partSlots  = tableSize;
 
     #ifdef _DEBUG_MODE_
     printf("Entry size = %lu, max entries = %lu\n", entrySize, tableSize);
@@ -23,39 +31,154 @@ CHashTable::CHashTable(size_t cacheSize, size_t keySize, size_t valueSize)
 //| Hash table class destructor                                                |
 //+----------------------------------------------------------------------------+
 
-CHashTable::~CHashTable() {
-
-    if (munmap(nullptr, MAX_CACHE_SIZE) == -1)
-        std::cout << "[munmap]:\t" << strerror(errno) << std::endl;
-}
+CHashTable::~CHashTable() {}
 
 //+----------------------------------------------------------------------------+
-//| Map shared memory                                                          |
+//| Attach to table memory (mapped by the owner of the segment)                |
 //+----------------------------------------------------------------------------+
 
-int CHashTable::allocate(int shmFile) {
+int CHashTable::allocate(void *memory) {
 
-    hTable = mmap(nullptr, MAX_CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shmFile, 0);
-    if (!hTable) {
-        std::cout << "[mmap]:\t" << strerror(errno) << std::endl;
+    if (!memory)
         return -1;
-    }
+
+    hTable = memory;
     return 0;
 }
 
 //+----------------------------------------------------------------------------+
-//| Get hash table config                                                      |
+//| Attach probe limits (one per slot, kept next to the table)                 |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::setProbeLimits(void *memory) {
+
+    probeLimits = static_cast<uint32_t *>(memory);
+}
+
+//+----------------------------------------------------------------------------+
+//| Attach key versions (VERSION_STRIPES counters)                             |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::setVersions(void *memory) {
+
+    versions = static_cast<uint64_t *>(memory);
+}
+
+//+----------------------------------------------------------------------------+
+//| Version of stripe holding key (no lock needed)                             |
+//+----------------------------------------------------------------------------+
+
+uint64_t CHashTable::version(const std::string &key) const {
+
+    if (!versions)
+        return 0;
+
+    size_t stripe = hashFunc(key) % VERSION_STRIPES;
+    return __atomic_load_n(&versions[stripe], __ATOMIC_ACQUIRE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Invalidate cached copies of key (caller holds the lock)                    |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::bump(const char *key) {
+
+    if (!versions && !changeHook)
+        return;
+
+    size_t stripe = hashFunc(std::string(key)) % VERSION_STRIPES;
+    if (versions)
+        __atomic_add_fetch(&versions[stripe], 1, __ATOMIC_RELEASE);
+    if (changeHook)
+        changeHook(hookArg, stripe, key);
+}
+
+//+----------------------------------------------------------------------------+
+//| Invalidate every cached copy                                               |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::bumpAll() {
+
+    if (changeHook)
+        changeHook(hookArg, 0, nullptr);
+
+    if (!versions)
+        return;
+
+    for (size_t i = 0; i < VERSION_STRIPES; ++i)
+        __atomic_add_fetch(&versions[i], 1, __ATOMIC_RELEASE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Split table into partitions (slots past the last one stay unused)          |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::setPartitions(size_t n) {
+
+    assert(n > 0 && n <= tableSize);
+    partitions = n;
+    partSlots  = tableSize / n;
+}
+
+//+----------------------------------------------------------------------------+
+//| Partition owning key                                                       |
+//+----------------------------------------------------------------------------+
+
+size_t CHashTable::partitionOf(const std::string &key) const {
+
+    if (partitions == 1)
+        return 0;
+
+    /* Remix hash so partition and slot inside it are independent */
+    uint64_t x = hashFunc(key);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+
+    return x % partitions;
+}
+
+//+----------------------------------------------------------------------------+
+//| Partition holding slot                                                     |
+//+----------------------------------------------------------------------------+
+
+size_t CHashTable::slotPartition(size_t index) const {
+
+    /* Slots past the last full partition belong to it */
+    return std::min(index / partSlots, partitions - 1);
+}
+
+//+----------------------------------------------------------------------------+
+//| Decrement TTLs of whole table                                              |
 //+----------------------------------------------------------------------------+
 
 void CHashTable::checkTTL() {
 
-    for (size_t i = 0; i < tableSize; ++i) {
+    sweep(0, tableSize);
+}
+
+//+----------------------------------------------------------------------------+
+//| Decrement TTLs of one partition                                            |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::checkTTL(size_t partition) {
+
+    sweep(partition * partSlots, partSlots);
+}
+
+//+----------------------------------------------------------------------------+
+//| Decrement TTLs in slot range                                               |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::sweep(size_t first, size_t count) {
+
+    for (size_t i = first; i < first + count; ++i) {
 
         /* Fill pointers */
         void *entry  = static_cast<char *>(hTable) + i * entrySize;
         bool *isBusy = static_cast<bool *>(entry);
         bool *rip    = static_cast<bool *>(entry) + 1;
-        int  *pTTL   = static_cast<int *>(entry) + 2 + (keySize + 1) + (valueSize + 1);
+        int  *pTTL   = reinterpret_cast<int *>(static_cast<char *>(entry) + 2 + (keySize + 1) + (valueSize + 1));
 
         /* Check entry */
         if ((*isBusy) && !(*rip)) {
@@ -66,8 +189,7 @@ void CHashTable::checkTTL() {
 
             if (*pTTL == 0) {
                 /* Mark entry as RIP */
-                bool ripValue = true;
-                memcpy(rip, &ripValue, sizeof(ripValue));
+                retire(entry, true);
 
             } else {
                 /* Decrement TTL */
@@ -79,21 +201,148 @@ void CHashTable::checkTTL() {
 }
 
 //+----------------------------------------------------------------------------+
-//| Find place for key                                                         |
+//| Copy raw table image (caller holds the lock)                               |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::saveImage(void *dst) {
+
+    memcpy(dst, hTable, imageSize());
+}
+
+//+----------------------------------------------------------------------------+
+//| Replace table contents with raw image                                      |
+//+----------------------------------------------------------------------------+
+
+int CHashTable::loadImage(const void *src, size_t size) {
+
+    if (size != imageSize())
+        return -1;
+
+    countEntries(false);
+    memcpy(hTable, src, size);
+    countEntries(true);
+    rebuildProbeLimits();
+    bumpAll();
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Remove all entries                                                         |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::clear() {
+
+    countEntries(false);
+    memset(hTable, 0, imageSize());
+    if (probeLimits)
+        memset(probeLimits, 0, probeLimitsSize());
+    bumpAll();
+}
+
+//+----------------------------------------------------------------------------+
+//| Turn live entry into tombstone                                             |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::retire(void *entry, bool expired) {
+
+    bool *rip = static_cast<bool *>(entry) + 1;
+    *rip = true;
+    bump(static_cast<char *>(entry) + 2);
+
+    if (!stats)
+        return;
+
+    char *pKey   = static_cast<char *>(entry) + 2;
+    char *pValue = static_cast<char *>(entry) + 2 + (keySize + 1);
+
+    if (expired)
+        statAdd(&stats->expirations, 1);
+    statSub(&stats->live, 1);
+    statAdd(&stats->tombstones, 1);
+    statSub(&stats->bytes, strlen(pKey) + strlen(pValue));
+}
+
+//+----------------------------------------------------------------------------+
+//| Add (or subtract) whole table contents to gauges                           |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::countEntries(bool add) {
+
+    if (!stats)
+        return;
+
+    uint64_t live = 0, tombstones = 0, bytes = 0;
+
+    for (size_t i = 0; i < tableSize; ++i) {
+        char *entry = static_cast<char *>(hTable) + i * entrySize;
+        bool isBusy = entry[0];
+        bool rip    = entry[1];
+
+        if (isBusy && rip) {
+            tombstones++;
+        } else if (isBusy) {
+            live++;
+            bytes += strlen(entry + 2) + strlen(entry + 2 + (keySize + 1));
+        }
+    }
+
+    if (add) {
+        statAdd(&stats->live, live);
+        statAdd(&stats->tombstones, tombstones);
+        statAdd(&stats->bytes, bytes);
+    } else {
+        statSub(&stats->live, live);
+        statSub(&stats->tombstones, tombstones);
+        statSub(&stats->bytes, bytes);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Subtract elapsed seconds from every TTL                                    |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::ageTTL(int elapsed) {
+
+    for (size_t i = 0; i < tableSize; ++i) {
+
+        /* Fill pointers */
+        void *entry  = static_cast<char *>(hTable) + i * entrySize;
+        bool *isBusy = static_cast<bool *>(entry);
+        bool *rip    = static_cast<bool *>(entry) + 1;
+        int  *pTTL   = reinterpret_cast<int *>(static_cast<char *>(entry) + 2 + (keySize + 1) + (valueSize + 1));
+
+        if (!(*isBusy) || *rip)
+            continue;
+
+        if (*pTTL < elapsed) {
+            /* Expired while we were down: keep probe chains intact */
+            retire(entry, true);
+        } else {
+            *pTTL -= elapsed;
+        }
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Find place for key (first free or tombstoned cell of its chain)            |
 //+----------------------------------------------------------------------------+
 
-size_t CHashTable::findPlace(std::string key) {
+size_t CHashTable::findPlace(std::string key, size_t *home) {
 
-    size_t index = hashFunc(key) % tableSize;
+    size_t first = partitionOf(key) * partSlots;
+    size_t last  = first + partSlots - 1;
+    size_t index = first + hashFunc(key) % partSlots;
     /* Where key is supposed to be */
     void *entry = static_cast<char *>(hTable) + index * entrySize;
     bool isBusy = *static_cast<bool *>(entry);
     bool rip = *(static_cast<bool *>(entry) + 1);
 
-    /* Check entry */
+    /* Check entry: tombstones are reused, caller made sure key is absent */
     size_t nextIndex = index;
-    while (isBusy || rip) {
-        nextIndex = (nextIndex < tableSize - 1) ? nextIndex + 1 : 0;
+    probes = 1;
+    while (isBusy && !rip) {
+        nextIndex = (nextIndex < last) ? nextIndex + 1 : first;
+        probes++;
         if (nextIndex == index) {
             /* No empty cells in hash table */
             nextIndex = tableSize;
@@ -106,6 +355,7 @@ size_t CHashTable::findPlace(std::string key) {
         }
     }
 
+    *home = index;
     return nextIndex;
 }
 
@@ -115,16 +365,23 @@ size_t CHashTable::findPlace(std::string key) {
 
 size_t CHashTable::findEntry(std::string key) {
 
-    size_t index = hashFunc(key) % tableSize;
+    size_t first = partitionOf(key) * partSlots;
+    size_t last  = first + partSlots - 1;
+    size_t index = first + hashFunc(key) % partSlots;
     /* Where key is supposed to be */
     void *entry;
     bool isBusy = 1;
     bool rip = 1;
 
+    /* Keys of this home slot lie no farther than its limit */
+    size_t limit = probeLimits ? probeLimits[index] : partSlots;
+
     /* Check entry */
     size_t nextIndex = index;
+    probes = 0;
     while (isBusy || rip) {
         /* Read next cell */
+        probes++;
         entry = static_cast<char *>(hTable) + nextIndex * entrySize;
         isBusy = *static_cast<bool *>(entry);
         rip = *(static_cast<bool *>(entry) + 1);
@@ -135,15 +392,15 @@ size_t CHashTable::findEntry(std::string key) {
             break;
         }
         if (!rip) {
-            /* Check key */
+            /* Check key (terminator included: no prefix matches) */
             char *pKey = static_cast<char *>(entry) + 2;
-            if (strncmp(pKey, key.c_str(), key.size()) == 0) {
+            if (strncmp(pKey, key.c_str(), key.size() + 1) == 0) {
                 /* Key found in hash table */
                 break;
             }
         }
-        nextIndex = (nextIndex < tableSize - 1) ? nextIndex + 1 : 0;
-        if (nextIndex == index) {
+        nextIndex = (nextIndex < last) ? nextIndex + 1 : first;
+        if (nextIndex == index || probes > limit) {
             /* No such key in hash table */
             nextIndex = tableSize;
             break;
@@ -153,16 +410,47 @@ size_t CHashTable::findEntry(std::string key) {
     return nextIndex;
 }
 
+//+----------------------------------------------------------------------------+
+//| Recompute probe limits from table contents                                 |
+//+----------------------------------------------------------------------------+
+
+void CHashTable::rebuildProbeLimits() {
+
+    if (!probeLimits)
+        return;
+
+    memset(probeLimits, 0, probeLimitsSize());
+
+    for (size_t i = 0; i < partitions * partSlots; ++i) {
+        char *entry = static_cast<char *>(hTable) + i * entrySize;
+        if (!entry[0] || entry[1])
+            continue;
+
+        std::string key(entry + 2);
+        size_t first = partitionOf(key) * partSlots;
+        size_t home  = first + hashFunc(key) % partSlots;
+        size_t dist  = (i >= home) ? i - home : i + partSlots - home;
+        if (dist > probeLimits[home])
+            probeLimits[home] = dist;
+    }
+}
+
 //+----------------------------------------------------------------------------+
 //| Get value for key                                                          |
 //+----------------------------------------------------------------------------+
 
-std::string CHashTable::get(std::string key) {
+std::string CHashTable::get(std::string key, int *status) {
 
-    if (key.size() >= keySize)
+    if (key.size() >= keySize) {
+        if (status)
+            *status = HT_KEY_TOO_BIG;
         return std::string("error (too big key)\n");
+    }
 
     size_t index = findEntry(key);
+    if (status)
+        *status = (index == tableSize) ? HT_NOT_FOUND : HT_OK;
+
     if (index == tableSize) {
 
         #ifdef _DEBUG_MODE_
@@ -175,7 +463,7 @@ std::string CHashTable::get(std::string key) {
     /* Fill pointers */
     void *cell   = static_cast<char *>(hTable) + index * entrySize;
     char *pValue = static_cast<char *>(cell) + 2 + (keySize + 1);
-    int  *pTTL   = static_cast<int *>(cell) + 2 + (keySize + 1) + (valueSize + 1);
+    int  *pTTL   = reinterpret_cast<int *>(static_cast<char *>(cell) + 2 + (keySize + 1) + (valueSize + 1));
 
     /* Get values */
     std::string value(pValue);
@@ -190,66 +478,237 @@ std::string CHashTable::get(std::string key) {
 }
 
 //+----------------------------------------------------------------------------+
-//| Set value and TTL for key                                                  |
+//| Get bare value of key (in-process clients)                                 |
 //+----------------------------------------------------------------------------+
 
-std::string CHashTable::set(int ttl, std::string key, std::string value) {
+int CHashTable::lookup(std::string key, std::string *value) {
 
     if (key.size() >= keySize)
+        return HT_KEY_TOO_BIG;
+
+    size_t index = findEntry(key);
+    if (index == tableSize)
+        return HT_NOT_FOUND;
+
+    char *pValue = static_cast<char *>(hTable) + index * entrySize + 2 + (keySize + 1);
+    value->assign(pValue);
+    return HT_OK;
+}
+
+//+----------------------------------------------------------------------------+
+//| Set value and TTL for key                                                  |
+//+----------------------------------------------------------------------------+
+
+std::string CHashTable::set(int ttl, std::string key, std::string value, int *status) {
+
+    int result = put(ttl, key, value);
+    if (status)
+        *status = result;
+
+    switch (result) {
+    case HT_OK:
+        return std::string("ok ") + std::string(key.c_str()) + std::string(" ") +
+               std::string(value.c_str()) + std::string("\n");
+    case HT_KEY_TOO_BIG:
         return std::string("error (too big key)\n");
+    case HT_VALUE_TOO_BIG:
+        return std::string("error (too big value)\n");
+    case HT_BAD_TTL:
+        return std::string("error (TTL is less than 1)\n");
+    default:
+        return std::string("error (no empty cells)\n");
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Store value and TTL for key                                                |
+//+----------------------------------------------------------------------------+
+
+int CHashTable::put(int ttl, std::string key, std::string value) {
+
+    if (key.size() >= keySize)
+        return HT_KEY_TOO_BIG;
 
     if (value.size() >= valueSize)
-        return std::string("error (too big value)\n");
+        return HT_VALUE_TOO_BIG;
 
     if (ttl <= 0)
-        return std::string("error (TTL is less than 1)\n");
+        return HT_BAD_TTL;
 
     size_t index = findEntry(key);
     if (index != tableSize) {
         /* Key already exists */
         void *emptyCell = static_cast<char *>(hTable) + index * entrySize;
         char *pValue    = static_cast<char *>(emptyCell) + 2 + (keySize + 1);
-        int  *pTTL      = static_cast<int *>(emptyCell) + 2 + (keySize + 1) + (valueSize + 1);
+        int  *pTTL      = reinterpret_cast<int *>(static_cast<char *>(emptyCell) + 2 + (keySize + 1) + (valueSize + 1));
+
+        if (stats)
+            statAdd(&stats->bytes, value.size() - strlen(pValue));
 
         /* Fill empty cell */
         strncpy(pValue, value.c_str(), value.size() + 1);
         memcpy(pTTL, &ttl, sizeof(ttl));
+        bump(key.c_str());
 
         #ifdef _DEBUG_MODE_
         printf("Set %lu:\t[%s, %s, %d] (replacing)\n", index, key.c_str(), value.c_str(), ttl);
         #endif /* _DEBUG_MODE_ */
 
-        return std::string("ok ") + std::string(key.c_str()) + std::string(" ") +
-               std::string(value.c_str()) + std::string("\n");
+        return HT_OK;
     }
 
-    index = findPlace(key);
+    size_t home;
+    index = findPlace(key, &home);
     if (index == tableSize) {
 
         #ifdef _DEBUG_MODE_
         printf("Set failed:\t[%s, %s, %d] (no memory)\n", key.c_str(), value.c_str(), ttl);
         #endif /* _DEBUG_MODE_ */
 
-        return std::string("error (no empty cells)\n");
+        return HT_NO_SPACE;
     }
 
     /* Fill pointers */
     void *emptyCell = static_cast<char *>(hTable) + index * entrySize;
     bool *isBusy    = static_cast<bool *>(emptyCell);
+    bool *rip       = static_cast<bool *>(emptyCell) + 1;
     char *pKey      = static_cast<char *>(emptyCell) + 2;
     char *pValue    = static_cast<char *>(emptyCell) + 2 + (keySize + 1);
-    int  *pTTL      = static_cast<int *>(emptyCell) + 2 + (keySize + 1) + (valueSize + 1);
+    int  *pTTL      = reinterpret_cast<int *>(static_cast<char *>(emptyCell) + 2 + (keySize + 1) + (valueSize + 1));
+    bool reused     = *isBusy && *rip;
 
     /* Fill empty cell */
     memset(isBusy, 1, 1);
+    *rip = false;
     strncpy(pKey, key.c_str(), key.size() + 1);
     strncpy(pValue, value.c_str(), value.size() + 1);
     memcpy(pTTL, &ttl, sizeof(ttl));
+    bump(key.c_str());
+
+    if (probeLimits) {
+        size_t dist = (index >= home) ? index - home : index + partSlots - home;
+        if (dist > probeLimits[home])
+            probeLimits[home] = dist;
+    }
+
+    if (stats) {
+        statAdd(&stats->live, 1);
+        statAdd(&stats->bytes, key.size() + value.size());
+        if (reused)
+            statSub(&stats->tombstones, 1);
+    }
 
     #ifdef _DEBUG_MODE_
     printf("Set %lu:\t[%s, %s, %d]\n", index, key.c_str(), value.c_str(), ttl);
     #endif /* _DEBUG_MODE_ */
 
-    return std::string("ok ") + std::string(key.c_str()) + std::string(" ") +
-           std::string(value.c_str()) + std::string("\n");
-}
\ No newline at end of file
+    return HT_OK;
+}
+
+//+----------------------------------------------------------------------------+
+//| Remove key (entry becomes a tombstone)                                     |
+//+----------------------------------------------------------------------------+
+
+int CHashTable::remove(std::string key) {
+
+    if (key.size() >= keySize)
+        return HT_KEY_TOO_BIG;
+
+    size_t index = findEntry(key);
+    if (index == tableSize)
+        return HT_NOT_FOUND;
+
+    void *entry = static_cast<char *>(hTable) + index * entrySize;
+    retire(entry, false);
+
+    return HT_OK;
+}
+
+//+----------------------------------------------------------------------------+
+//| Make room for key by retiring entry nearest to expiry                      |
+//+----------------------------------------------------------------------------+
+
+int CHashTable::evict(const std::string &key) {
+
+    size_t first = partitionOf(key) * partSlots;
+    size_t last  = first + partSlots - 1;
+    size_t index = first + hashFunc(key) % partSlots;
+
+    /* The tombstone lands where the key will probe first */
+    char *victim = nullptr;
+    int  least   = 0;
+    for (size_t i = 0; i < std::min(EVICT_SAMPLES, partSlots); ++i) {
+        char *entry = static_cast<char *>(hTable) + index * entrySize;
+        if (entry[0] && !entry[1]) {
+            int ttl;
+            memcpy(&ttl, entry + 2 + (keySize + 1) + (valueSize + 1), sizeof(ttl));
+            if (!victim || ttl < least) {
+                victim = entry;
+                least  = ttl;
+            }
+        }
+        index = (index < last) ? index + 1 : first;
+    }
+
+    if (!victim)
+        return HT_NOT_FOUND;
+
+    retire(victim, false);
+    return HT_OK;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read live entry by index                                                   |
+//+----------------------------------------------------------------------------+
+
+bool CHashTable::readEntry(size_t index, std::string *key, std::string *value, int *ttl) {
+
+    if (index >= tableSize)
+        return false;
+
+    /* Fill pointers */
+    void *entry  = static_cast<char *>(hTable) + index * entrySize;
+    bool isBusy  = *static_cast<bool *>(entry);
+    bool rip     = *(static_cast<bool *>(entry) + 1);
+
+    if (!isBusy || rip)
+        return false;
+
+    char *pKey   = static_cast<char *>(entry) + 2;
+    char *pValue = static_cast<char *>(entry) + 2 + (keySize + 1);
+    int  *pTTL   = reinterpret_cast<int *>(static_cast<char *>(entry) + 2 + (keySize + 1) + (valueSize + 1));
+
+    *key   = pKey;
+    *value = pValue;
+    *ttl   = *pTTL;
+
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Collect keys of next slots                                                 |
+//|                                                                            |
+//| Keys never move: sets update in place and removals leave tombstones. So    |
+//| walking slot numbers finds every key that stays in the table while the     |
+//| scan runs, however it changes between calls. Keys set or removed meanwhile |
+//| may or may not be seen.                                                    |
+//+----------------------------------------------------------------------------+
+
+size_t CHashTable::scan(size_t cursor, size_t count, std::vector<std::string> *keys) {
+
+    if (cursor >= tableSize)
+        return 0;
+
+    /* Caller holds the lock of one partition only */
+    size_t p   = slotPartition(cursor);
+    size_t end = (p + 1 < partitions) ? (p + 1) * partSlots : tableSize;
+    end = std::min(end, cursor + count);
+
+    for (size_t index = cursor; index < end; ++index) {
+        char *entry = static_cast<char *>(hTable) + index * entrySize;
+        if (entry[0] && !entry[1])
+            keys->push_back(std::string(entry + 2));
+    }
+
+    return end < tableSize ? end : 0;
+}
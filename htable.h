@@ -3,10 +3,13 @@
 
 //#define _DEBUG_MODE_
 
+#include "stats.h"
 #include <assert.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <string>
+#include <vector>
 #include <cstring>
 #include <iostream>
 
@@ -14,14 +17,30 @@ const size_t MAX_KEY_SIZE   = 32;
 const size_t MAX_VALUE_SIZE = 256;
 const size_t MAX_CACHE_SIZE = 1024 * 1024;
 
+/* Stripes of key versions (near-cache invalidation) */
+const size_t VERSION_STRIPES = 16 * 1024;
+
+/* Cells looked at for a victim when a full partition makes room */
+const size_t EVICT_SAMPLES = 16;
+
+/* Result codes of table operations */
+enum {
+    HT_OK = 0,
+    HT_KEY_TOO_BIG,
+    HT_VALUE_TOO_BIG,
+    HT_BAD_TTL,
+    HT_NO_SPACE,
+    HT_NOT_FOUND
+};
+
+/* Called on every change to a key under the table lock (null key: all keys) */
+typedef void (*ChangeHook)(void *arg, size_t stripe, const char *key);
+
 //+----------------------------------------------------------------------------+
 //| Hash table class                                                           |
 //+----------------------------------------------------------------------------+
 
 class CHashTable {
-    /* Shared mem */
-    int shmFile;
-
     /* Config */
     size_t cacheSize;
     size_t keySize;
@@ -29,13 +48,39 @@ class CHashTable {
     size_t entrySize;
     size_t tableSize;
 
+    /* Shared-nothing mode: key space split in equal slot ranges */
+    size_t partitions;
+    size_t partSlots;
+
     /* Hash table */
     void                   *hTable;
     std::hash<std::string> hashFunc;
 
+    /* Counters of calling process (optional) */
+    Stats                  *stats;
+
+    /* Cells inspected by last lookup */
+    size_t                 probes;
+
+    /* Per home slot: farthest distance of a key stored from it (optional) */
+    uint32_t               *probeLimits;
+
+    /* Per key stripe: bumped on every change to a key in it (optional) */
+    uint64_t               *versions;
+
+    /* Told about every change (optional) */
+    ChangeHook             changeHook;
+    void                   *hookArg;
+
     /* Private API */
-    size_t findPlace(std::string key);
+    size_t findPlace(std::string key, size_t *home);
     size_t findEntry(std::string key);
+    void   sweep(size_t first, size_t count);
+    void   retire(void *entry, bool expired);
+    void   countEntries(bool add);
+    void   rebuildProbeLimits();
+    void   bump(const char *key);
+    void   bumpAll();
 
 public:
     
@@ -44,10 +89,60 @@ public:
                size_t valueSize = MAX_VALUE_SIZE);
     ~CHashTable();
 
-    int         allocate(int shmFile);
+    int         allocate(void *memory);
     void        checkTTL();
-    std::string get(std::string key);
-    std::string set(int ttl, std::string key, std::string value);
+    void        checkTTL(size_t partition);
+    void        ageTTL(int elapsed);
+    void        clear();
+    std::string get(std::string key, int *status = nullptr);
+    int         lookup(std::string key, std::string *value);
+    std::string set(int ttl, std::string key, std::string value, int *status = nullptr);
+    int         put(int ttl, std::string key, std::string value);
+    int         remove(std::string key);
+
+    /* Full partition: retire entry nearest to expiry among first cells of key's chain */
+    int         evict(const std::string &key);
+    bool        readEntry(size_t index, std::string *key, std::string *value, int *ttl);
+
+    /* Keys in count slots from cursor (one partition at most), next cursor or 0 */
+    size_t      scan(size_t cursor, size_t count, std::vector<std::string> *keys);
+
+    /* Raw image of the table (snapshots) */
+    size_t      imageSize() const { return tableSize * entrySize; }
+    void        saveImage(void *dst);
+    int         loadImage(const void *src, size_t size);
+
+    /* Geometry */
+    size_t      getKeySize()   const { return keySize; }
+    size_t      getValueSize() const { return valueSize; }
+    size_t      getEntrySize() const { return entrySize; }
+    size_t      getTableSize() const { return tableSize; }
+
+    /* Table gauges and expirations go to these counters */
+    void        setStats(Stats *counters) { stats = counters; }
+
+    /* Probe length of last lookup or insert (benchmarks) */
+    size_t      lastProbes() const { return probes; }
+
+    /* Misses stop at the farthest key of the home slot instead of a free cell */
+    size_t      probeLimitsSize() const { return tableSize * sizeof(uint32_t); }
+    void        setProbeLimits(void *memory);
+
+    /* Near-caches check stripe versions instead of taking the lock */
+    static size_t versionsSize() { return VERSION_STRIPES * sizeof(uint64_t); }
+    void        setVersions(void *memory);
+    bool        hasVersions() const { return versions != nullptr; }
+    uint64_t    version(const std::string &key) const;
+    size_t      versionStripe(const std::string &key) const { return hashFunc(key) % VERSION_STRIPES; }
+
+    /* Invalidation tracking */
+    void        setChangeHook(ChangeHook hook, void *arg) { changeHook = hook; hookArg = arg; }
+
+    /* Partitions */
+    void        setPartitions(size_t n);
+    size_t      getPartitions() const { return partitions; }
+    size_t      partitionOf(const std::string &key) const;
+    size_t      slotPartition(size_t index) const;
 };
 
 #endif /* __HTABLE_H__ */
\ No newline at end of file
@@ -1,5 +1,6 @@
 /* Mac OS X */
 
+#include "proxy.h"
 #include "server.h"
 #include <iostream>
 
@@ -7,10 +8,26 @@
 //| Main                                                                       |
 //+----------------------------------------------------------------------------+
 
-int main() {
+int main(int argc, char *argv[]) {
+
+    /* Read options */
+    Config config;
+    if (config.parse(argc, argv) == -1)
+        return -1;
+
+    /* Proxy mode: no table, requests go to backends */
+    if (!config.proxyBackends.empty()) {
+        Proxy proxy(config);
+        if (proxy.configure() == -1) {
+            printf("error: configuring proxy failed\n");
+            return -1;
+        }
+        proxy.start();
+        return 0;
+    }
 
     /* Create server */
-    Server srv;
+    Server srv(config);
     if (srv.configure() == -1) {
         printf("error: configuring server failed\n");
         return -1;
@@ -0,0 +1,387 @@
+#include "metrics.h"
+#include <arpa/inet.h> /* inet_pton */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+
+//+----------------------------------------------------------------------------+
+//| Scrape connection destructor                                               |
+//+----------------------------------------------------------------------------+
+
+MetricsConn::~MetricsConn() {
+
+    if (readEvent) {
+        event_free(readEvent);
+        readEvent = nullptr;
+    }
+    if (writeEvent) {
+        event_free(writeEvent);
+        writeEvent = nullptr;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Metrics endpoint destructor                                                |
+//+----------------------------------------------------------------------------+
+
+Metrics::~Metrics() {
+
+    for (auto it = conns.begin(); it != conns.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    release();
+}
+
+//+----------------------------------------------------------------------------+
+//| Configure listening socket                                                 |
+//+----------------------------------------------------------------------------+
+
+int Metrics::configListener(const std::string &ip, uint16_t port) {
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Fill parameters */
+    struct sockaddr_in sAddr;
+    bzero(&sAddr, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &(sAddr.sin_addr)) != 1) {
+        printf("[metrics]:\tIP address is not parseable\n");
+        close(sock);
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *)&optval, sizeof(optval));
+    evutil_make_socket_nonblocking(sock);
+
+    if (bind(sock, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[bind]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+    if (listen(sock, SOMAXCONN) == -1) {
+        std::cout << "[listen]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+//+----------------------------------------------------------------------------+
+//| Start serving scrapes                                                      |
+//+----------------------------------------------------------------------------+
+
+void Metrics::start(int sock) {
+
+    listener = sock;
+    listenEvent = event_new(base, listener, EV_READ | EV_PERSIST, metrics_accept_cb, (void *)this);
+    event_add(listenEvent, nullptr);
+}
+
+//+----------------------------------------------------------------------------+
+//| Stop accepting and hand listening socket to caller                         |
+//+----------------------------------------------------------------------------+
+
+int Metrics::release() {
+
+    if (listenEvent) {
+        event_free(listenEvent);
+        listenEvent = nullptr;
+    }
+
+    int sock = listener;
+    listener = -1;
+    return sock;
+}
+
+//+----------------------------------------------------------------------------+
+//| Accept scraper                                                             |
+//+----------------------------------------------------------------------------+
+
+void Metrics::accept() {
+
+    int fd = ::accept(listener, 0, 0);
+    if (fd == -1)
+        return;
+    evutil_make_socket_nonblocking(fd);
+
+    MetricsConn *conn = new MetricsConn();
+    conn->readEvent = event_new(base, fd, EV_READ | EV_PERSIST, metrics_read_cb, (void *)this);
+    event_add(conn->readEvent, nullptr);
+    conns[fd] = conn;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read request until end of headers                                          |
+//+----------------------------------------------------------------------------+
+
+void Metrics::read(int fd) {
+
+    auto it = conns.find(fd);
+    if (it == conns.end())
+        return;
+    MetricsConn *conn = it->second;
+
+    char buf[1024];
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    if (len == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (len <= 0 || conn->inBuf.size() + len > METRICS_MAX_REQUEST) {
+        drop(fd);
+        return;
+    }
+
+    conn->inBuf.append(buf, len);
+    if (conn->inBuf.find("\r\n\r\n") == std::string::npos &&
+        conn->inBuf.find("\n\n") == std::string::npos)
+        return;
+
+    /* One request per connection */
+    event_free(conn->readEvent);
+    conn->readEvent = nullptr;
+    respond(fd, conn->inBuf);
+}
+
+//+----------------------------------------------------------------------------+
+//| Build HTTP response                                                        |
+//+----------------------------------------------------------------------------+
+
+void Metrics::respond(int fd, const std::string &request) {
+
+    MetricsConn *conn = conns[fd];
+
+    std::string line = request.substr(0, request.find_first_of("\r\n"));
+    std::string status = "200 OK";
+    std::string body;
+
+    if (line.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+        body   = "only GET is supported\n";
+    } else if (line.compare(4, 9, "/metrics ") != 0 && line != "GET /metrics") {
+        status = "404 Not Found";
+        body   = "try /metrics\n";
+    } else {
+        body = render();
+    }
+
+    conn->outBuf = "HTTP/1.1 " + status + "\r\n" +
+                   "Content-Type: text/plain; version=0.0.4\r\n" +
+                   "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                   "Connection: close\r\n\r\n" + body;
+
+    conn->writeEvent = event_new(base, fd, EV_WRITE | EV_PERSIST, metrics_write_cb, (void *)this);
+    event_add(conn->writeEvent, nullptr);
+}
+
+//+----------------------------------------------------------------------------+
+//| Send response, close when done                                             |
+//+----------------------------------------------------------------------------+
+
+void Metrics::write(int fd) {
+
+    auto it = conns.find(fd);
+    if (it == conns.end())
+        return;
+    MetricsConn *conn = it->second;
+
+    ssize_t sent = send(fd, conn->outBuf.data(), conn->outBuf.size(), 0);
+    if (sent == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (sent == -1) {
+        drop(fd);
+        return;
+    }
+
+    conn->outBuf.erase(0, sent);
+    if (conn->outBuf.empty())
+        drop(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Close scrape connection                                                    |
+//+----------------------------------------------------------------------------+
+
+void Metrics::drop(int fd) {
+
+    auto it = conns.find(fd);
+    if (it == conns.end())
+        return;
+
+    delete it->second;
+    conns.erase(it);
+    close(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Metric family helpers                                                      |
+//+----------------------------------------------------------------------------+
+
+static void family(std::string *out, const char *name, const char *type, const char *help) {
+
+    out->append("# HELP ");
+    out->append(name);
+    out->append(" ");
+    out->append(help);
+    out->append("\n# TYPE ");
+    out->append(name);
+    out->append(" ");
+    out->append(type);
+    out->append("\n");
+}
+
+static void sample(std::string *out, const char *name, const std::string &labels, double value) {
+
+    char num[64];
+    snprintf(num, sizeof(num), "%.17g", value);
+
+    out->append(name);
+    if (!labels.empty())
+        out->append("{" + labels + "}");
+    out->append(" ");
+    out->append(num);
+    out->append("\n");
+}
+
+static void perWorker(std::string *out, const std::vector<Stats> &workers,
+                      const char *name, const char *help, uint64_t Stats::*field) {
+
+    family(out, name, "counter", help);
+    for (size_t i = 0; i < workers.size(); ++i)
+        sample(out, name, "worker=\"" + std::to_string(i + 1) + "\"", workers[i].*field);
+}
+
+//+----------------------------------------------------------------------------+
+//| Render all metrics                                                         |
+//+----------------------------------------------------------------------------+
+
+std::string Metrics::render() {
+
+    SegmentHeader *hdr = segment->header();
+    std::string out;
+
+    /* Request counters are per worker; table gauges only make sense summed */
+    std::vector<Stats> workers(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i) {
+        memset(&workers[i], 0, sizeof(Stats));
+        for (int set = 0; set < STATS_SETS; ++set)
+            addStats(&workers[i], segment->stats(set, STATS_WORKERS + i));
+    }
+    Stats total;
+    segment->collectStats(&total);
+
+    perWorker(&out, workers, "mycache_gets_total", "Get requests.", &Stats::gets);
+    perWorker(&out, workers, "mycache_get_hits_total", "Gets that found the key.", &Stats::hits);
+    perWorker(&out, workers, "mycache_get_misses_total", "Gets that did not find the key.", &Stats::misses);
+    perWorker(&out, workers, "mycache_near_cache_hits_total", "Gets answered from the worker near-cache.", &Stats::nearHits);
+    perWorker(&out, workers, "mycache_sets_total", "Set requests.", &Stats::sets);
+    perWorker(&out, workers, "mycache_bad_queries_total", "Queries that could not be parsed.", &Stats::badQueries);
+    perWorker(&out, workers, "mycache_connections_total", "Accepted client connections.", &Stats::totalConnections);
+    perWorker(&out, workers, "mycache_output_pauses_total", "Reads paused over the soft output limit.", &Stats::outputPauses);
+    perWorker(&out, workers, "mycache_output_drops_total", "Clients dropped over the hard output limit.", &Stats::outputDrops);
+    perWorker(&out, workers, "mycache_invalidations_total", "Key-change notifications sent to tracking clients.", &Stats::invalidations);
+
+    family(&out, "mycache_set_failures_total", "counter", "Rejected sets by reason.");
+    struct { const char *reason; uint64_t Stats::*field; } failures[] = {
+        { "key_too_big",   &Stats::keyTooBig   },
+        { "value_too_big", &Stats::valueTooBig },
+        { "bad_ttl",       &Stats::badTTL      },
+        { "no_space",      &Stats::noSpace     }
+    };
+    for (size_t f = 0; f < sizeof(failures) / sizeof(failures[0]); ++f) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            sample(&out, "mycache_set_failures_total",
+                   "worker=\"" + std::to_string(i + 1) + "\",reason=\"" + failures[f].reason + "\"",
+                   workers[i].*failures[f].field);
+        }
+    }
+
+    family(&out, "mycache_current_connections", "gauge", "Open client connections.");
+    for (size_t i = 0; i < workers.size(); ++i) {
+        sample(&out, "mycache_current_connections", "worker=\"" + std::to_string(i + 1) + "\"",
+               static_cast<int64_t>(workers[i].connections));
+    }
+
+    family(&out, "mycache_expirations_total", "counter", "Entries expired by TTL.");
+    sample(&out, "mycache_expirations_total", "", total.expirations);
+    family(&out, "mycache_evictions_total", "counter", "Entries evicted from named tables.");
+    sample(&out, "mycache_evictions_total", "", total.evictions);
+    family(&out, "mycache_live_entries", "gauge", "Entries in the table.");
+    sample(&out, "mycache_live_entries", "", static_cast<int64_t>(total.live));
+    family(&out, "mycache_tombstones", "gauge", "Deleted or expired slots.");
+    sample(&out, "mycache_tombstones", "", static_cast<int64_t>(total.tombstones));
+    family(&out, "mycache_bytes_used", "gauge", "Key and value bytes of live entries.");
+    sample(&out, "mycache_bytes_used", "", static_cast<int64_t>(total.bytes));
+    family(&out, "mycache_table_slots", "gauge", "Slots in the table.");
+    sample(&out, "mycache_table_slots", "", hdr->tableSize);
+    family(&out, "mycache_uptime_seconds", "gauge", "Seconds since the segment was created.");
+    sample(&out, "mycache_uptime_seconds", "", hdr->createdAt ? time(nullptr) - hdr->createdAt : 0);
+
+    /* Histograms: bucket i holds durations below 2^i ticks */
+    double secPerTick = hdr->tscPerSec ? 1.0 / hdr->tscPerSec : 1e-9;
+    family(&out, "mycache_latency_seconds", "histogram", "Time spent per request stage.");
+    for (int stage = 0; stage < LAT_STAGES; ++stage) {
+        const Histogram &h = total.latency[stage];
+        std::string stageLabel = std::string("stage=\"") + stageName(stage) + "\"";
+        uint64_t cumulative = 0;
+        char le[64];
+
+        for (int i = 0; i < LAT_BUCKETS; ++i) {
+            cumulative += h.buckets[i];
+            snprintf(le, sizeof(le), "%.6g", (1ULL << i) * secPerTick);
+            sample(&out, "mycache_latency_seconds_bucket",
+                   stageLabel + ",le=\"" + le + "\"", cumulative);
+        }
+        sample(&out, "mycache_latency_seconds_bucket", stageLabel + ",le=\"+Inf\"", h.count);
+        sample(&out, "mycache_latency_seconds_sum", stageLabel, h.sum * secPerTick);
+        sample(&out, "mycache_latency_seconds_count", stageLabel, h.count);
+    }
+
+    return out;
+}
+
+//+----------------------------------------------------------------------------+
+//| Accept callback                                                            |
+//+----------------------------------------------------------------------------+
+
+void metrics_accept_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a metrics object */
+    Metrics *metrics = (Metrics *)ptr;
+
+    metrics->accept();
+}
+
+//+----------------------------------------------------------------------------+
+//| Read callback                                                              |
+//+----------------------------------------------------------------------------+
+
+void metrics_read_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a metrics object */
+    Metrics *metrics = (Metrics *)ptr;
+
+    metrics->read(evs);
+}
+
+//+----------------------------------------------------------------------------+
+//| Write callback                                                             |
+//+----------------------------------------------------------------------------+
+
+void metrics_write_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a metrics object */
+    Metrics *metrics = (Metrics *)ptr;
+
+    metrics->write(evs);
+}
@@ -0,0 +1,72 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "segment.h"
+#include "stats.h"
+#include <event.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+/* Scrapers send small requests; anything bigger is not one */
+static const size_t METRICS_MAX_REQUEST = 8192;
+
+//+----------------------------------------------------------------------------+
+//| Scrape connection                                                          |
+//+----------------------------------------------------------------------------+
+
+class MetricsConn {
+public:
+    struct event *readEvent;
+    struct event *writeEvent;
+    std::string  inBuf;
+    std::string  outBuf;
+
+    MetricsConn() : readEvent(nullptr), writeEvent(nullptr) {}
+    ~MetricsConn();
+};
+
+//+----------------------------------------------------------------------------+
+//| Metrics endpoint (HTTP, Prometheus text format)                            |
+//|                                                                            |
+//| Runs in the server's event loop and only reads the counter slots in the    |
+//| segment, so scraping costs workers nothing.                                |
+//+----------------------------------------------------------------------------+
+
+class Metrics {
+    struct event_base *base;
+    struct event  *listenEvent;
+    int           listener;
+    Segment       *segment;
+    size_t        numWorkers;
+    std::unordered_map<int, MetricsConn *> conns;
+
+    std::string render();
+    void        respond(int fd, const std::string &request);
+
+public:
+    Metrics(struct event_base *base, Segment *segment, size_t numWorkers)
+        : base(base), listenEvent(nullptr), listener(-1),
+          segment(segment), numWorkers(numWorkers) {}
+    ~Metrics();
+
+    /* Listen on socket (own or taken over from previous server) */
+    static int configListener(const std::string &ip, uint16_t port);
+    void start(int sock);
+    int  release();
+
+    void accept();
+    void read(int fd);
+    void write(int fd);
+    void drop(int fd);
+};
+
+//+----------------------------------------------------------------------------+
+//| Callbacks                                                                  |
+//+----------------------------------------------------------------------------+
+
+void metrics_accept_cb(evutil_socket_t evs, short events, void *ptr);
+void metrics_read_cb  (evutil_socket_t evs, short events, void *ptr);
+void metrics_write_cb (evutil_socket_t evs, short events, void *ptr);
+
+#endif /* __METRICS_H__ */
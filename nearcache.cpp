@@ -0,0 +1,50 @@
+#include "nearcache.h"
+
+//+----------------------------------------------------------------------------+
+//| Answer for key if still at version                                         |
+//+----------------------------------------------------------------------------+
+
+bool NearCache::lookup(const std::string &key, uint64_t version, std::string *answer) {
+
+    NearEntry &entry = entries[hashFunc(key) % entries.size()];
+
+    if (!entry.valid || entry.version != version || entry.key != key)
+        return false;
+
+    *answer = entry.answer;
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Count get of key, true once key is hot enough to store                     |
+//+----------------------------------------------------------------------------+
+
+bool NearCache::admit(const std::string &key) {
+
+    uint8_t &count = counts[(hashFunc(key) >> 16) % counts.size()];
+    if (count < UINT8_MAX)
+        count++;
+
+    /* Halve every count now and then so old popularity fades */
+    if (++increments >= 16 * counts.size()) {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] >>= 1;
+        increments = 0;
+    }
+
+    return count >= NEAR_CACHE_ADMIT;
+}
+
+//+----------------------------------------------------------------------------+
+//| Keep answer read at version                                                |
+//+----------------------------------------------------------------------------+
+
+void NearCache::store(const std::string &key, uint64_t version, const std::string &answer) {
+
+    NearEntry &entry = entries[hashFunc(key) % entries.size()];
+
+    entry.key     = key;
+    entry.answer  = answer;
+    entry.version = version;
+    entry.valid   = true;
+}
@@ -0,0 +1,55 @@
+#ifndef __NEARCACHE_H__
+#define __NEARCACHE_H__
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Gets of a key (decaying count) before it is worth a near-cache slot */
+static const uint8_t NEAR_CACHE_ADMIT = 4;
+
+//+----------------------------------------------------------------------------+
+//| Cached answer tagged with version of its key's stripe                      |
+//+----------------------------------------------------------------------------+
+
+struct NearEntry {
+    std::string key;
+    std::string answer;
+    uint64_t    version;
+    bool        valid;
+
+    NearEntry() : version(0), valid(false) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Worker-local cache of hot get answers                                      |
+//|                                                                            |
+//| Direct mapped. An entry is served only while the shm version of its key    |
+//| stripe still equals the one read under the lock when it was filled, so a   |
+//| set, removal or expiry anywhere in the stripe invalidates it. Keys are     |
+//| admitted after a few gets, counted in small decaying counters, so cold     |
+//| keys do not push hot ones out.                                             |
+//+----------------------------------------------------------------------------+
+
+class NearCache {
+    std::vector<NearEntry> entries;
+    std::vector<uint8_t>   counts;
+    uint64_t               increments;
+    std::hash<std::string> hashFunc;
+
+public:
+    NearCache(size_t capacity)
+        : entries(capacity), counts(4 * capacity, 0), increments(0) {}
+
+    /* Answer for key if still at version */
+    bool lookup(const std::string &key, uint64_t version, std::string *answer);
+
+    /* Count get of key, true once key is hot enough to store */
+    bool admit(const std::string &key);
+
+    /* Keep answer read at version */
+    void store(const std::string &key, uint64_t version, const std::string &answer);
+};
+
+#endif /* __NEARCACHE_H__ */
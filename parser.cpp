@@ -16,6 +16,29 @@ std::string CParser::cutSpaces(std::string line) {
     return line;
 }
 
+//+----------------------------------------------------------------------------+
+//| Split line into words                                                      |
+//+----------------------------------------------------------------------------+
+
+std::vector<std::string> CParser::split(std::string line) {
+
+    std::vector<std::string> words;
+    size_t pos = 0;
+
+    while (pos < line.size()) {
+        size_t start = line.find_first_not_of(" \r", pos);
+        if (start == std::string::npos)
+            break;
+        size_t end = line.find_first_of(" \r", start);
+        if (end == std::string::npos)
+            end = line.size();
+        words.push_back(line.substr(start, end - start));
+        pos = end;
+    }
+
+    return words;
+}
+
 //+----------------------------------------------------------------------------+
 //| Parse line                                                                 |
 //+----------------------------------------------------------------------------+
@@ -45,6 +68,9 @@ int CParser::parseLine(std::string line, std::string *key,
             cleanParams.push_back(params[i]);
     }
 
+    if (cleanParams.empty())
+        return 1;
+
     if (cleanParams[0] == "get") {
         if (cleanParams.size() != 2)
             return 1;
@@ -52,6 +78,14 @@ int CParser::parseLine(std::string line, std::string *key,
         *value = "";
         *ttl   = 0;
 
+    } else if (cleanParams[0] == "getraw") {
+        /* Get returning value as stored (compressed values stay compressed) */
+        if (cleanParams.size() != 2)
+            return 1;
+        *key   = cleanParams[1];
+        *value = "";
+        *ttl   = -1;
+
     } else if (cleanParams[0] == "set") {
         if (cleanParams.size() != 4)
             return 1;
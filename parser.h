@@ -14,6 +14,9 @@ class CParser {
 public:
     static int parseLine(std::string line, std::string *key,
                          std::string *value, int *ttl);
+
+    /* Words of line (service commands) */
+    static std::vector<std::string> split(std::string line);
 };
 
 #endif /* __PARSER_H__ */
\ No newline at end of file
@@ -0,0 +1,467 @@
+#include "proxy.h"
+#include "parser.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <iostream>
+
+//+----------------------------------------------------------------------------+
+//| Connection destructor                                                      |
+//+----------------------------------------------------------------------------+
+
+ProxyConn::~ProxyConn() {
+
+    if (readEvent)
+        event_free(readEvent);
+    if (writeEvent)
+        event_free(writeEvent);
+}
+
+//+----------------------------------------------------------------------------+
+//| Proxy destructor                                                           |
+//+----------------------------------------------------------------------------+
+
+Proxy::~Proxy() {
+
+    for (auto it = conns.begin(); it != conns.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+
+    delete backends;
+    if (listenEvent)
+        event_free(listenEvent);
+    if (listener != -1)
+        close(listener);
+    if (base)
+        event_base_free(base);
+}
+
+//+----------------------------------------------------------------------------+
+//| Configure listening socket                                                 |
+//+----------------------------------------------------------------------------+
+
+int Proxy::configListener() {
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Fill parameters */
+    struct sockaddr_in sAddr;
+    bzero(&sAddr, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port   = htons(config.port);
+    if (inet_pton(AF_INET, config.ip.c_str(), &(sAddr.sin_addr)) != 1) {
+        printf("[proxy]:\tIP address is not parseable\n");
+        close(sock);
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *)&optval, sizeof(optval));
+    evutil_make_socket_nonblocking(sock);
+
+    if (bind(sock, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[bind]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+    if (listen(sock, SOMAXCONN) == -1) {
+        std::cout << "[listen]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+//+----------------------------------------------------------------------------+
+//| Put backends of "host:port,host:port" on ring                              |
+//+----------------------------------------------------------------------------+
+
+int Proxy::addBackends() {
+
+    std::string list = config.proxyBackends;
+    size_t added = 0;
+
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string backend = list.substr(0, comma);
+        list = (comma == std::string::npos) ? "" : list.substr(comma + 1);
+
+        size_t colon = backend.rfind(':');
+        int port = (colon == std::string::npos) ? 0 : atoi(backend.c_str() + colon + 1);
+        if (port <= 0 || port > 65535) {
+            printf("[proxy]:\tbad backend %s, expected host:port\n", backend.c_str());
+            return -1;
+        }
+
+        backends->addNode(backend.substr(0, colon), port);
+        added++;
+    }
+
+    return added ? 0 : -1;
+}
+
+//+----------------------------------------------------------------------------+
+//| Configure proxy                                                            |
+//+----------------------------------------------------------------------------+
+
+int Proxy::configure() {
+
+    /* One process serves every application: a vanished peer must not kill it */
+    signal(SIGPIPE, SIG_IGN);
+
+    base = event_base_new();
+    backends = new CacheClient(base, config.proxyConns);
+    if (addBackends() == -1)
+        return -1;
+
+    listener = configListener();
+    if (listener == -1)
+        return -1;
+
+    listenEvent = event_new(base, listener, EV_READ | EV_PERSIST, proxy_accept_cb, (void *)this);
+    event_add(listenEvent, nullptr);
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Main proxy event loop                                                      |
+//+----------------------------------------------------------------------------+
+
+void Proxy::start() {
+
+    printf("[proxy]:\tstarted at %s:%d for %s\n", config.ip.c_str(), config.port,
+           config.proxyBackends.c_str());
+    event_base_dispatch(base);
+}
+
+//+----------------------------------------------------------------------------+
+//| Accept application connection                                              |
+//+----------------------------------------------------------------------------+
+
+void Proxy::accept() {
+
+    int fd = ::accept(listener, 0, 0);
+    if (fd == -1)
+        return;
+    evutil_make_socket_nonblocking(fd);
+
+    ProxyConn *conn = new ProxyConn(nextConnId++);
+    conn->readEvent  = event_new(base, fd, EV_READ | EV_PERSIST, proxy_read_cb, (void *)this);
+    conn->writeEvent = event_new(base, fd, EV_WRITE | EV_PERSIST, proxy_write_cb, (void *)this);
+    event_add(conn->readEvent, nullptr);
+
+    conns[fd] = conn;
+    connIds[conn->id] = fd;
+    totalConns++;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read queries                                                               |
+//+----------------------------------------------------------------------------+
+
+void Proxy::read(int fd) {
+
+    ProxyConn *conn = conns[fd];
+
+    char buf[PROXY_READ_SIZE];
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    if (len == -1) {
+        if (errno != EAGAIN && errno != EINTR)
+            drop(fd);
+        return;
+    }
+    if (len == 0) {
+        /* Answer what was asked, then close */
+        event_free(conn->readEvent);
+        conn->readEvent = nullptr;
+        closeIfDone(fd);
+        return;
+    }
+
+    conn->inBuf.append(buf, len);
+
+    size_t start = 0, end;
+    while ((end = conn->inBuf.find('\n', start)) != std::string::npos) {
+        route(conn, conn->inBuf.substr(start, end - start));
+        start = end + 1;
+    }
+    conn->inBuf.erase(0, start);
+}
+
+//+----------------------------------------------------------------------------+
+//| Send query to backend of its key or answer it here                         |
+//+----------------------------------------------------------------------------+
+
+void Proxy::route(ProxyConn *conn, const std::string &query) {
+
+    requests++;
+
+    std::string key, value;
+    int ttl;
+    uint32_t id  = conn->id;
+    uint32_t seq = expect(conn);
+
+    if (query.empty()) {
+        deliver(id, seq, "error (empty query)\n");
+        return;
+    }
+
+    /* Named table: backends only know the table of each query, not of connections */
+    std::string space = conn->space;
+    std::string named;
+    const std::string *q = &query;
+    if (query.compare(0, 4, "use ") == 0 || query.compare(0, 3, "in ") == 0) {
+        std::vector<std::string> args = CParser::split(query);
+        bool use = (args[0] == "use");
+        if (args.size() < 2 || (use && args.size() != 2)) {
+            deliver(id, seq, "error (bad query)\n");
+            return;
+        }
+
+        space = (args[1] == "default") ? "" : args[1];
+        if (use) {
+            conn->space = space;
+            deliver(id, seq, "ok use " + args[1] + "\n");
+            return;
+        }
+
+        for (size_t i = 2; i < args.size(); ++i)
+            named += (i > 2 ? " " : "") + args[i];
+        q = &named;
+    }
+
+    if (CParser::parseLine(*q, &key, &value, &ttl)) {
+        std::vector<std::string> args = CParser::split(query);
+        deliver(id, seq, (args.size() == 1 && args[0] == "stats") ? statsReport()
+                                                                  : "error (bad query)\n");
+        return;
+    }
+
+    if (value == "" && ttl == 0) {
+        forwardGet(space, key, id, seq);
+        return;
+    }
+
+    /* Gets sent after a set must see it */
+    if (value != "")
+        inflightGets.erase(space.empty() ? key : space + " " + key);
+
+    std::string line = space.empty() ? *q : "in " + space + " " + *q;
+    backends->query(key, line, [this, key, id, seq](int status, const std::string &reply) {
+        if (status == CLIENT_FAILED)
+            failures++;
+        if (status == CLIENT_OK)
+            deliver(id, seq, "ok " + key + " " + reply + "\n");
+        else
+            deliver(id, seq, status == CLIENT_FAILED ? "error (backend unavailable)\n"
+                                                     : reply + "\n");
+    });
+}
+
+//+----------------------------------------------------------------------------+
+//| Get key, or join get of key already in flight                              |
+//+----------------------------------------------------------------------------+
+
+void Proxy::forwardGet(const std::string &space, const std::string &key,
+                       uint32_t id, uint32_t seq) {
+
+    /* Keys can't hold spaces: "<table> <key>" never mixes tables up */
+    std::string joined = space.empty() ? key : space + " " + key;
+
+    auto it = inflightGets.find(joined);
+    if (it != inflightGets.end()) {
+        it->second->push_back(std::make_pair(id, seq));
+        coalesced++;
+        return;
+    }
+
+    std::shared_ptr<ProxyWaiters> waiters(new ProxyWaiters);
+    waiters->push_back(std::make_pair(id, seq));
+    inflightGets[joined] = waiters;
+
+    ReplyCallback done = [this, key, joined, waiters](int status, const std::string &value) {
+        /* A set may have replaced the entry with a newer get */
+        auto it = inflightGets.find(joined);
+        if (it != inflightGets.end() && it->second == waiters)
+            inflightGets.erase(it);
+
+        std::string resp;
+        if (status == CLIENT_OK) {
+            resp = "ok " + key + " " + value + "\n";
+        } else if (status == CLIENT_FAILED) {
+            failures++;
+            resp = "error (backend unavailable)\n";
+        } else {
+            resp = value + "\n";
+        }
+
+        for (size_t i = 0; i < waiters->size(); ++i)
+            deliver((*waiters)[i].first, (*waiters)[i].second, resp);
+    };
+
+    if (space.empty())
+        backends->get(key, done);
+    else
+        backends->query(key, "in " + space + " get " + key, done);
+}
+
+//+----------------------------------------------------------------------------+
+//| Reserve place of next reply                                                |
+//+----------------------------------------------------------------------------+
+
+uint32_t Proxy::expect(ProxyConn *conn) {
+
+    uint32_t seq = conn->pendingBase + conn->pending.size();
+    conn->pending.push_back(std::make_pair(false, std::string()));
+    return seq;
+}
+
+//+----------------------------------------------------------------------------+
+//| Fill in reply and send every reply that is next in order                   |
+//+----------------------------------------------------------------------------+
+
+void Proxy::deliver(uint32_t id, uint32_t seq, const std::string &resp) {
+
+    /* Application may have gone away meanwhile */
+    auto it = connIds.find(id);
+    if (it == connIds.end())
+        return;
+
+    int fd = it->second;
+    ProxyConn *conn = conns[fd];
+    conn->pending[seq - conn->pendingBase] = std::make_pair(true, resp);
+
+    bool ready = false;
+    while (!conn->pending.empty() && conn->pending.front().first) {
+        conn->outBuf.append(conn->pending.front().second);
+        conn->pending.pop_front();
+        conn->pendingBase++;
+        ready = true;
+    }
+
+    /* Batches end with '\0', as the server's do */
+    if (ready) {
+        conn->outBuf.push_back('\0');
+        event_add(conn->writeEvent, nullptr);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Write replies                                                              |
+//+----------------------------------------------------------------------------+
+
+void Proxy::write(int fd) {
+
+    ProxyConn *conn = conns[fd];
+
+    if (conn->outPos < conn->outBuf.size()) {
+        ssize_t sent = send(fd, conn->outBuf.data() + conn->outPos,
+                            conn->outBuf.size() - conn->outPos, 0);
+        if (sent == -1) {
+            if (errno != EAGAIN && errno != EINTR)
+                drop(fd);
+            return;
+        }
+        conn->outPos += sent;
+    }
+
+    if (conn->outPos == conn->outBuf.size()) {
+        conn->outBuf.clear();
+        conn->outPos = 0;
+        event_del(conn->writeEvent);
+        closeIfDone(fd);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Close connection that hung up once everything is answered                  |
+//+----------------------------------------------------------------------------+
+
+void Proxy::closeIfDone(int fd) {
+
+    ProxyConn *conn = conns[fd];
+    if (!conn->readEvent && conn->pending.empty() && conn->outBuf.empty())
+        drop(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Close connection                                                           |
+//+----------------------------------------------------------------------------+
+
+void Proxy::drop(int fd) {
+
+    auto it = conns.find(fd);
+    if (it == conns.end())
+        return;
+
+    connIds.erase(it->second->id);
+    delete it->second;
+    conns.erase(it);
+    close(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Proxy counters                                                             |
+//+----------------------------------------------------------------------------+
+
+std::string Proxy::statsReport() {
+
+    std::string out;
+    out.append("stat proxy_connections " + std::to_string(conns.size()) + "\n");
+    out.append("stat proxy_total_connections " + std::to_string(totalConns) + "\n");
+    out.append("stat proxy_requests " + std::to_string(requests) + "\n");
+    out.append("stat proxy_coalesced_gets " + std::to_string(coalesced) + "\n");
+    out.append("stat proxy_backend_failures " + std::to_string(failures) + "\n");
+    out.append("end\n");
+
+    return out;
+}
+
+//+----------------------------------------------------------------------------+
+//| Accept callback                                                            |
+//+----------------------------------------------------------------------------+
+
+void proxy_accept_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a proxy object */
+    Proxy *proxy = (Proxy *)ptr;
+
+    proxy->accept();
+}
+
+//+----------------------------------------------------------------------------+
+//| Read callback                                                              |
+//+----------------------------------------------------------------------------+
+
+void proxy_read_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a proxy object */
+    Proxy *proxy = (Proxy *)ptr;
+
+    proxy->read(evs);
+}
+
+//+----------------------------------------------------------------------------+
+//| Write callback                                                             |
+//+----------------------------------------------------------------------------+
+
+void proxy_write_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a proxy object */
+    Proxy *proxy = (Proxy *)ptr;
+
+    proxy->write(evs);
+}
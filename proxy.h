@@ -0,0 +1,116 @@
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include "cacheclient.h"
+#include "config.h"
+#include <event.h>
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+static const int PROXY_READ_SIZE = 16 * 1024;
+
+//+----------------------------------------------------------------------------+
+//| Application connection to proxy                                            |
+//+----------------------------------------------------------------------------+
+
+class ProxyConn {
+public:
+    struct event *readEvent;
+    struct event *writeEvent;
+    uint32_t     id;
+    std::string  inBuf;
+
+    /* Unsent replies start at outPos */
+    std::string  outBuf;
+    size_t       outPos;
+
+    /* Replies in query order; backend answers fill them in */
+    std::deque<std::pair<bool, std::string>> pending;
+    uint32_t     pendingBase;
+
+    /* Named table of "use" (empty = default table) */
+    std::string  space;
+
+    ProxyConn(uint32_t id)
+        : readEvent(nullptr), writeEvent(nullptr), id(id), outPos(0), pendingBase(0) {}
+    ~ProxyConn();
+};
+
+//+----------------------------------------------------------------------------+
+//| Replies owed for one backend get: (connection id, reply number)            |
+//+----------------------------------------------------------------------------+
+
+typedef std::vector<std::pair<uint32_t, uint32_t>> ProxyWaiters;
+
+//+----------------------------------------------------------------------------+
+//| Proxy class                                                                |
+//|                                                                            |
+//| Accepts application connections and shards their requests over backend     |
+//| nodes on a ketama ring. Every backend gets a few long-lived pipelined      |
+//| connections, however many applications come and go. A get of a key that    |
+//| is already on its way to the backend waits for that answer instead of      |
+//| sending another one; a set of the key stops later gets from joining it.    |
+//| Named tables ("use <name>", "in <name> <query>") go to the backends as     |
+//| "in <name> <query>"; gets only join gets of the same table.                |
+//+----------------------------------------------------------------------------+
+
+class Proxy {
+    struct event_base *base;
+    struct event  *listenEvent;
+    int           listener;
+    Config        config;
+    CacheClient   *backends;
+
+    std::unordered_map<int, ProxyConn *> conns;
+    std::unordered_map<uint32_t, int>    connIds;
+    uint32_t      nextConnId;
+
+    /* Gets in flight by key */
+    std::unordered_map<std::string, std::shared_ptr<ProxyWaiters>> inflightGets;
+
+    /* Counters of stats command */
+    uint64_t      requests;
+    uint64_t      coalesced;
+    uint64_t      failures;
+    uint64_t      totalConns;
+
+    int         configListener();
+    int         addBackends();
+    void        route(ProxyConn *conn, const std::string &query);
+    void        forwardGet(const std::string &space, const std::string &key,
+                           uint32_t id, uint32_t seq);
+    uint32_t    expect(ProxyConn *conn);
+    void        deliver(uint32_t id, uint32_t seq, const std::string &resp);
+    std::string statsReport();
+    void        closeIfDone(int fd);
+
+public:
+    Proxy(const Config &config)
+        : base(nullptr), listenEvent(nullptr), listener(-1), config(config),
+          backends(nullptr), nextConnId(0), requests(0), coalesced(0), failures(0),
+          totalConns(0) {}
+    ~Proxy();
+
+    int  configure();
+    void start();
+
+    void accept();
+    void read(int fd);
+    void write(int fd);
+    void drop(int fd);
+};
+
+//+----------------------------------------------------------------------------+
+//| Callbacks                                                                  |
+//+----------------------------------------------------------------------------+
+
+void proxy_accept_cb(evutil_socket_t evs, short events, void *ptr);
+void proxy_read_cb  (evutil_socket_t evs, short events, void *ptr);
+void proxy_write_cb (evutil_socket_t evs, short events, void *ptr);
+
+#endif /* __PROXY_H__ */
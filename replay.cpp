@@ -0,0 +1,326 @@
+#include "capture.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+static const int BUF_SIZE    = 64 * 1024;
+
+/* As fast as possible: requests in flight per connection */
+static const int FAST_WINDOW = 64;
+
+/* Give up on replies after this much silence */
+static const int IDLE_MS     = 5000;
+
+//+----------------------------------------------------------------------------+
+//| Replay parameters                                                          |
+//+----------------------------------------------------------------------------+
+
+struct ReplayConfig {
+    std::string host;
+    uint16_t    port;
+    bool        fast;
+    double      speed;
+
+    ReplayConfig() : host("127.0.0.1"), port(8080), fast(false), speed(1.0) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| One traced connection                                                      |
+//+----------------------------------------------------------------------------+
+
+struct ReplayConn {
+    int         fd;
+    std::string outBuf;
+    size_t      inflight;
+    std::string line;
+};
+
+//+----------------------------------------------------------------------------+
+//| Replay totals                                                              |
+//+----------------------------------------------------------------------------+
+
+struct ReplayResult {
+    uint64_t sent;
+    uint64_t replies;
+    uint64_t misses;
+    uint64_t errors;
+    uint64_t maxLateUs;
+
+    ReplayResult() : sent(0), replies(0), misses(0), errors(0), maxLateUs(0) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Monotonic time in microseconds                                             |
+//+----------------------------------------------------------------------------+
+
+static uint64_t nowUs() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+//+----------------------------------------------------------------------------+
+//| Connect to server                                                          |
+//+----------------------------------------------------------------------------+
+
+static int connectServer(const ReplayConfig &config) {
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct sockaddr_in sAddr;
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port   = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &(sAddr.sin_addr)) != 1) {
+        printf("[replay]:\tIP address is not parseable\n");
+        close(fd);
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[connect]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    return fd;
+}
+
+//+----------------------------------------------------------------------------+
+//| Consume replies: one line per request (server ends batches with '\0')      |
+//+----------------------------------------------------------------------------+
+
+static void readReplies(ReplayConn *conn, const char *data, size_t len, ReplayResult *result) {
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (c == '\0')
+            continue;
+        if (c != '\n') {
+            if (conn->line.size() < 32)
+                conn->line.push_back(c);
+            continue;
+        }
+
+        if (conn->inflight)
+            conn->inflight--;
+        result->replies++;
+        if (conn->line.compare(0, 25, "error (key doesn't exist)") == 0)
+            result->misses++;
+        else if (conn->line.compare(0, 5, "error") == 0)
+            result->errors++;
+        conn->line.clear();
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Feed trace to server                                                       |
+//+----------------------------------------------------------------------------+
+
+static int replay(const ReplayConfig &config, const std::vector<CaptureRecord> &records,
+                  ReplayResult *result) {
+
+    /* Traced (worker, connection) pairs map to our own connections */
+    std::map<std::pair<uint32_t, uint32_t>, size_t> connIndex;
+    std::vector<ReplayConn> conns;
+    std::vector<size_t> target(records.size());
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::pair<uint32_t, uint32_t> id(records[i].pid, records[i].conn);
+        auto it = connIndex.find(id);
+        if (it == connIndex.end()) {
+            ReplayConn conn;
+            conn.fd = connectServer(config);
+            if (conn.fd == -1)
+                return -1;
+            conn.inflight = 0;
+            it = connIndex.insert(std::make_pair(id, conns.size())).first;
+            conns.push_back(conn);
+        }
+        target[i] = it->second;
+    }
+
+    std::vector<struct pollfd> pfds(conns.size());
+    for (size_t i = 0; i < conns.size(); ++i)
+        pfds[i].fd = conns[i].fd;
+
+    uint64_t begin    = nowUs();
+    uint64_t traceT0  = records.empty() ? 0 : records[0].ts;
+    uint64_t lastRead = begin;
+    size_t   next     = 0;
+    char     buf[BUF_SIZE];
+
+    for (;;) {
+        uint64_t now = nowUs();
+        uint64_t due = 0;
+
+        /* Queue requests that are due (original timing) or fit the window */
+        while (next < records.size()) {
+            ReplayConn &conn = conns[target[next]];
+            if (config.fast) {
+                if (conn.inflight >= FAST_WINDOW)
+                    break;
+            } else {
+                due = begin + static_cast<uint64_t>((records[next].ts - traceT0) / config.speed);
+                if (due > now)
+                    break;
+                result->maxLateUs = std::max(result->maxLateUs, now - due);
+            }
+            conn.outBuf.append(records[next].query);
+            conn.outBuf.push_back('\n');
+            conn.inflight++;
+            result->sent++;
+            next++;
+        }
+
+        bool waiting = false;
+        for (size_t i = 0; i < conns.size(); ++i) {
+            ReplayConn &conn = conns[i];
+            if (!conn.outBuf.empty()) {
+                ssize_t sent = send(conn.fd, conn.outBuf.data(), conn.outBuf.size(), MSG_DONTWAIT);
+                if (sent > 0)
+                    conn.outBuf.erase(0, sent);
+                else if (sent == -1 && errno != EAGAIN && errno != EINTR) {
+                    std::cout << "[send]:\t" << strerror(errno) << std::endl;
+                    return -1;
+                }
+            }
+            waiting = waiting || conn.inflight;
+            pfds[i].events = POLLIN | (conn.outBuf.empty() ? 0 : POLLOUT);
+        }
+
+        if (next == records.size() && !waiting)
+            break;
+
+        /* Gaps of the trace are no silence of the server: count only while waiting */
+        if (!waiting)
+            lastRead = now;
+        if (now - lastRead > IDLE_MS * 1000ULL) {
+            printf("[replay]:\tno replies for %d ms, giving up\n", IDLE_MS);
+            break;
+        }
+
+        int timeout = 10;
+        if (!config.fast && next < records.size())
+            timeout = std::min<uint64_t>(10, (due - now) / 1000);
+
+        if (poll(pfds.data(), pfds.size(), timeout) <= 0)
+            continue;
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (!(pfds[i].revents & (POLLIN | POLLERR | POLLHUP)))
+                continue;
+
+            ssize_t len = recv(conns[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (len == 0 || (len == -1 && errno != EAGAIN && errno != EINTR)) {
+                printf("[replay]:\tconnection closed by server\n");
+                return -1;
+            }
+            if (len > 0) {
+                readReplies(&conns[i], buf, len, result);
+                lastRead = nowUs();
+            }
+        }
+    }
+
+    for (size_t i = 0; i < conns.size(); ++i)
+        close(conns[i].fd);
+
+    printf("connections %lu\n", conns.size());
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Print usage                                                                |
+//+----------------------------------------------------------------------------+
+
+static void usage(const char *name) {
+
+    printf("usage: %s [options] <trace>...\n", name);
+    printf("  --host <addr>      server address (default 127.0.0.1)\n");
+    printf("  --port <port>      server port (default 8080)\n");
+    printf("  --speed <factor>   replay at factor times original pace (default 1)\n");
+    printf("  --fast             ignore timestamps, send as fast as possible\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Main replay function                                                       |
+//+----------------------------------------------------------------------------+
+
+int main(int argc, char *argv[]) {
+
+    enum { OPT_HOST = 1, OPT_PORT, OPT_SPEED, OPT_FAST };
+
+    static struct option options[] = {
+        { "host",  required_argument, nullptr, OPT_HOST  },
+        { "port",  required_argument, nullptr, OPT_PORT  },
+        { "speed", required_argument, nullptr, OPT_SPEED },
+        { "fast",  no_argument,       nullptr, OPT_FAST  },
+        { nullptr, 0,                 nullptr, 0         }
+    };
+
+    ReplayConfig config;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_HOST:  config.host  = optarg;       break;
+        case OPT_PORT:  config.port  = atoi(optarg); break;
+        case OPT_SPEED: config.speed = atof(optarg); break;
+        case OPT_FAST:  config.fast  = true;         break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind == argc || config.speed <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Worker traces merge into one timeline */
+    std::vector<CaptureRecord> records;
+    for (int i = optind; i < argc; ++i)
+        if (!Capture::load(argv[i], &records))
+            return 1;
+    std::stable_sort(records.begin(), records.end(),
+                     [](const CaptureRecord &a, const CaptureRecord &b) { return a.ts < b.ts; });
+
+    ReplayResult result;
+    uint64_t start = nowUs();
+    if (replay(config, records, &result) == -1)
+        return 1;
+    double elapsed = (nowUs() - start) / 1e6;
+
+    printf("requests %llu, replies %llu in %.3f s: %.0f req/s, misses %llu, errors %llu\n",
+           (unsigned long long)result.sent, (unsigned long long)result.replies, elapsed,
+           elapsed > 0 ? result.replies / elapsed : 0.0,
+           (unsigned long long)result.misses, (unsigned long long)result.errors);
+    if (!config.fast)
+        printf("max lateness %.3f ms\n", result.maxLateUs / 1000.0);
+
+    return result.replies == result.sent ? 0 : 1;
+}
@@ -0,0 +1,618 @@
+#include "replication.h"
+#include <arpa/inet.h> /* inet_pton */
+#include <netdb.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+//+----------------------------------------------------------------------------+
+//| Append record to backlog                                                   |
+//+----------------------------------------------------------------------------+
+
+void Backlog::append(const std::string &record) {
+
+    lock();
+
+    uint64_t size = hdr->replBacklogSize;
+    uint64_t pos  = hdr->replOffset % size;
+
+    /* Record may wrap around the end of the ring */
+    size_t first = std::min<uint64_t>(record.size(), size - pos);
+    memcpy(ring + pos, record.data(), first);
+    memcpy(ring, record.data() + first, record.size() - first);
+
+    hdr->replOffset += record.size();
+
+    unlock();
+}
+
+//+----------------------------------------------------------------------------+
+//| Check that ring still holds everything from offset on (caller holds lock)  |
+//+----------------------------------------------------------------------------+
+
+bool Backlog::holds(uint64_t from) const {
+
+    uint64_t to = hdr->replOffset;
+    return from <= to && to - from <= hdr->replBacklogSize;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read backlog from offset up to the end                                     |
+//+----------------------------------------------------------------------------+
+
+int Backlog::read(uint64_t from, std::string *out) {
+
+    uint64_t size = hdr->replBacklogSize;
+    uint64_t to   = hdr->replOffset;
+
+    /* Part of the range was already overwritten */
+    if (!holds(from))
+        return -1;
+
+    while (from < to) {
+        uint64_t pos   = from % size;
+        size_t   chunk = std::min<uint64_t>(to - from, size - pos);
+        out->append(ring + pos, chunk);
+        from += chunk;
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Replica connection destructor                                              |
+//+----------------------------------------------------------------------------+
+
+ReplicaConn::~ReplicaConn() {
+
+    if (readEvent) {
+        event_free(readEvent);
+        readEvent = nullptr;
+    }
+    if (writeEvent) {
+        event_free(writeEvent);
+        writeEvent = nullptr;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Replicator destructor                                                      |
+//+----------------------------------------------------------------------------+
+
+Replicator::~Replicator() {
+
+    for (auto it = replicas.begin(); it != replicas.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+
+    if (listenEvent)
+        event_free(listenEvent);
+    if (feedTimer)
+        event_free(feedTimer);
+    if (base)
+        event_base_free(base);
+    if (listener != -1)
+        close(listener);
+
+    if (semaphore && sem_close(semaphore) == -1)
+        std::cout << "[sem_close]:\t" << strerror(errno) << std::endl;
+
+    delete backlog;
+    delete hTable;
+    delete segment;
+}
+
+//+----------------------------------------------------------------------------+
+//| Configure replication listener                                             |
+//+----------------------------------------------------------------------------+
+
+int Replicator::configListener() {
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Fill parameters */
+    struct sockaddr_in sAddr;
+    bzero(&sAddr, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &(sAddr.sin_addr)) != 1) {
+        printf("[replicator]:\tIP address is not parseable\n");
+        close(sock);
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *)&optval, sizeof(optval));
+    evutil_make_socket_nonblocking(sock);
+
+    if (bind(sock, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[bind]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+    if (listen(sock, SOMAXCONN) == -1) {
+        std::cout << "[listen]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+//+----------------------------------------------------------------------------+
+//| Start replicator process                                                   |
+//+----------------------------------------------------------------------------+
+
+void Replicator::start() {
+
+    /* Open hash table */
+    segment = new Segment(shmFilename);
+    if (segment->attach() == -1)
+        return;
+    if (!segment->backlog()) {
+        printf("[replicator]:\tsegment has no replication backlog\n");
+        return;
+    }
+    hTable = new CHashTable();
+    if (segment->attachTable(hTable) == -1)
+        return;
+    backlog = new Backlog(segment);
+
+    /* Open semaphore */
+    semaphore = sem_open(semFile.c_str(), 0);
+    if (semaphore == SEM_FAILED) {
+        std::cout << "[sem_open]:\t" << strerror(errno) << std::endl;
+        return;
+    }
+
+    /* Replicas of a previous replicator are gone */
+    if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        return;
+    }
+    segment->header()->replicas = 0;
+    sem_post(semaphore);
+
+    listener = configListener();
+    if (listener == -1)
+        return;
+
+    /* Create event base */
+    base = event_base_new();
+
+    listenEvent = event_new(base, listener, EV_READ | EV_PERSIST, repl_accept_cb, (void *)this);
+    event_add(listenEvent, nullptr);
+
+    /* Batch mutations: one backlog read per interval */
+    struct timeval tv = { interval / 1000, (interval % 1000) * 1000 };
+    feedTimer = event_new(base, -1, EV_PERSIST, repl_feed_cb, (void *)this);
+    event_add(feedTimer, &tv);
+
+    printf("[replicator]:\tlistening at %s:%d\n", ip.c_str(), port);
+    event_base_dispatch(base);
+}
+
+//+----------------------------------------------------------------------------+
+//| New replica: send full table, then stream backlog                          |
+//+----------------------------------------------------------------------------+
+
+void Replicator::addReplica(int fd) {
+
+    ReplicaConn *conn = new ReplicaConn();
+    conn->outBuf = "fullsync\n";
+
+    if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        delete conn;
+        return;
+    }
+
+    lockPartitions(segment->header());
+
+    std::string key, value;
+    int ttl;
+    for (size_t i = 0; i < hTable->getTableSize(); ++i) {
+        if (!hTable->readEntry(i, &key, &value, &ttl))
+            continue;
+        conn->outBuf.append("set " + std::to_string(ttl) + " " + key + " " + value + "\n");
+    }
+
+    /* Mutations after this point go to the backlog */
+    conn->offset = backlog->offset();
+    segment->header()->replicas++;
+
+    unlockPartitions(segment->header());
+
+    if (sem_post(semaphore) == -1)
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+
+    conn->outBuf.append("endsync\n");
+
+    /* Only EOF is expected from replica */
+    conn->readEvent = event_new(base, fd, EV_READ | EV_PERSIST, repl_read_cb, (void *)this);
+    event_add(conn->readEvent, nullptr);
+
+    replicas[fd] = conn;
+    enableWriting(fd);
+
+    printf("[replicator]:\treplica (%d) connected, full sync %lu bytes\n", fd, conn->outBuf.size());
+}
+
+//+----------------------------------------------------------------------------+
+//| Disconnect replica                                                         |
+//+----------------------------------------------------------------------------+
+
+void Replicator::dropReplica(int fd) {
+
+    auto it = replicas.find(fd);
+    if (it == replicas.end())
+        return;
+
+    delete it->second;
+    replicas.erase(it);
+    close(fd);
+
+    if (sem_wait(semaphore) == 0) {
+        if (segment->header()->replicas > 0)
+            segment->header()->replicas--;
+        sem_post(semaphore);
+    }
+
+    printf("[replicator]:\treplica (%d) disconnected\n", fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Copy new backlog data to every replica                                     |
+//+----------------------------------------------------------------------------+
+
+void Replicator::feed() {
+
+    if (replicas.empty())
+        return;
+
+    std::string data;
+    uint64_t    from, to;
+    std::vector<int> lagging;
+
+    backlog->lock();
+    to = backlog->offset();
+
+    /* Replicas the ring still covers read the same range, so copy it once */
+    from = to;
+    for (auto it = replicas.begin(); it != replicas.end(); ++it) {
+        if (backlog->holds(it->second->offset))
+            from = std::min(from, it->second->offset);
+    }
+    backlog->read(from, &data);
+    backlog->unlock();
+
+    for (auto it = replicas.begin(); it != replicas.end(); ++it) {
+        ReplicaConn *conn = it->second;
+
+        if (conn->offset == to)
+            continue;
+
+        /* Replica fell behind the ring: it must reconnect for full sync */
+        if (conn->offset < from || conn->offset > to || conn->outBuf.size() > REPL_MAX_PENDING) {
+            lagging.push_back(it->first);
+            continue;
+        }
+
+        conn->outBuf.append(data, conn->offset - from, std::string::npos);
+        conn->offset = to;
+        enableWriting(it->first);
+    }
+
+    for (size_t i = 0; i < lagging.size(); ++i) {
+        printf("[replicator]:\treplica (%d) is too slow\n", lagging[i]);
+        dropReplica(lagging[i]);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Start watching replica socket for writing                                  |
+//+----------------------------------------------------------------------------+
+
+void Replicator::enableWriting(int fd) {
+
+    ReplicaConn *conn = replicas[fd];
+    if (!conn->writeEvent) {
+        conn->writeEvent = event_new(base, fd, EV_WRITE | EV_PERSIST, repl_write_cb, (void *)this);
+        event_add(conn->writeEvent, nullptr);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Send pending stream to replica                                             |
+//+----------------------------------------------------------------------------+
+
+void Replicator::flush(int fd) {
+
+    auto it = replicas.find(fd);
+    if (it == replicas.end())
+        return;
+    ReplicaConn *conn = it->second;
+
+    ssize_t sent = send(fd, conn->outBuf.data(), conn->outBuf.size(), 0);
+    if (sent == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
+        std::cout << "[send]:\t" << strerror(errno) << std::endl;
+        dropReplica(fd);
+        return;
+    }
+
+    conn->outBuf.erase(0, sent);
+    if (conn->outBuf.empty()) {
+        event_free(conn->writeEvent);
+        conn->writeEvent = nullptr;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Replica link constructor                                                   |
+//+----------------------------------------------------------------------------+
+
+ReplicaLink::ReplicaLink(const Config &config)
+    : port(0), staging(nullptr), shmFilename(config.shmFilename),
+      segment(nullptr), hTable(nullptr), semFile(config.semFile),
+      semaphore(nullptr) {
+
+    /* Address is "host:port" */
+    size_t colon = config.replicaOf.rfind(':');
+    if (colon != std::string::npos) {
+        host = config.replicaOf.substr(0, colon);
+        port = atoi(config.replicaOf.c_str() + colon + 1);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Replica link destructor                                                    |
+//+----------------------------------------------------------------------------+
+
+ReplicaLink::~ReplicaLink() {
+
+    if (semaphore && sem_close(semaphore) == -1)
+        std::cout << "[sem_close]:\t" << strerror(errno) << std::endl;
+
+    delete staging;
+    delete hTable;
+    delete segment;
+}
+
+//+----------------------------------------------------------------------------+
+//| Connect to primary                                                         |
+//+----------------------------------------------------------------------------+
+
+int ReplicaLink::connectPrimary() {
+
+    struct addrinfo hints, *res;
+    bzero(&hints, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    std::string service = std::to_string(port);
+    int result = getaddrinfo(host.c_str(), service.c_str(), &hints, &res);
+    if (result != 0) {
+        printf("[getaddrinfo]:\t%s\n", gai_strerror(result));
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        freeaddrinfo(res);
+        return -1;
+    }
+    if (connect(fd, res->ai_addr, res->ai_addrlen) == -1) {
+        std::cout << "[connect]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+//+----------------------------------------------------------------------------+
+//| Drop unfinished full sync                                                  |
+//+----------------------------------------------------------------------------+
+
+void ReplicaLink::discardStaging() {
+
+    delete staging;
+    staging = nullptr;
+    std::vector<char>().swap(stagingImage);
+}
+
+//+----------------------------------------------------------------------------+
+//| Apply complete lines from primary in one critical section                  |
+//+----------------------------------------------------------------------------+
+
+int ReplicaLink::apply() {
+
+    size_t end = inBuf.rfind('\n');
+    if (end == std::string::npos)
+        return 0;
+
+    /* Lock is taken only once a line touches the live table */
+    bool locked = false;
+
+    size_t pos = 0;
+    while (pos <= end) {
+        size_t nl = inBuf.find('\n', pos);
+        std::string line = inBuf.substr(pos, nl - pos);
+        pos = nl + 1;
+
+        std::string key, value;
+        int ttl;
+        bool isSet = !line.empty() && CParser::parseLine(line, &key, &value, &ttl) == 0 &&
+                     !value.empty();
+
+        /* Primary state is built aside: readers see the old table until it is complete */
+        if (line == "fullsync") {
+            discardStaging();
+            staging = new CHashTable();
+            stagingImage.assign(staging->imageSize(), 0);
+            staging->allocate(stagingImage.data());
+            staging->setPartitions(hTable->getPartitions());
+            continue;
+        }
+        if (staging && line != "endsync") {
+            if (isSet)
+                staging->put(ttl, key, value);
+            continue;
+        }
+
+        if (!locked) {
+            if (sem_wait(semaphore) == -1) {
+                std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+                return -1;
+            }
+            lockPartitions(segment->header());
+            locked = true;
+        }
+
+        if (line == "endsync") {
+            if (staging) {
+                hTable->loadImage(stagingImage.data(), stagingImage.size());
+                discardStaging();
+            }
+            printf("[replica]:\tfull sync done\n");
+        } else if (isSet) {
+            hTable->put(ttl, key, value);
+        }
+    }
+
+    if (locked) {
+        unlockPartitions(segment->header());
+
+        if (sem_post(semaphore) == -1) {
+            std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+
+    inBuf.erase(0, end + 1);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Start replica link process                                                 |
+//+----------------------------------------------------------------------------+
+
+void ReplicaLink::start() {
+
+    if (host.empty() || port == 0) {
+        printf("[replica]:\tprimary address must be host:port\n");
+        return;
+    }
+
+    /* Open hash table */
+    segment = new Segment(shmFilename);
+    if (segment->attach() == -1)
+        return;
+    hTable = new CHashTable();
+    if (segment->attachTable(hTable) == -1)
+        return;
+    hTable->setStats(segment->stats(segment->header()->generation, STATS_REPLICATION));
+
+    /* Open semaphore */
+    semaphore = sem_open(semFile.c_str(), 0);
+    if (semaphore == SEM_FAILED) {
+        std::cout << "[sem_open]:\t" << strerror(errno) << std::endl;
+        return;
+    }
+
+    /* Follow primary, reconnecting when link breaks */
+    while (true) {
+
+        int fd = connectPrimary();
+        if (fd == -1) {
+            sleep(REPL_RETRY_SEC);
+            continue;
+        }
+        printf("[replica]:\tconnected to %s:%d\n", host.c_str(), port);
+
+        char buf[64 * 1024];
+        ssize_t len;
+        inBuf.clear();
+
+        while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            inBuf.append(buf, len);
+            if (apply() == -1)
+                break;
+        }
+        if (len == -1)
+            std::cout << "[recv]:\t" << strerror(errno) << std::endl;
+
+        close(fd);
+        discardStaging();
+        printf("[replica]:\tlost primary\n");
+        sleep(REPL_RETRY_SEC);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Accept replica callback                                                    |
+//+----------------------------------------------------------------------------+
+
+void repl_accept_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a replicator object */
+    Replicator *repl = (Replicator *)ptr;
+
+    int fd = accept(evs, 0, 0);
+    if (fd == -1)
+        return;
+    evutil_make_socket_nonblocking(fd);
+
+    repl->addReplica(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Replica read callback                                                      |
+//+----------------------------------------------------------------------------+
+
+void repl_read_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a replicator object */
+    Replicator *repl = (Replicator *)ptr;
+
+    char buf[BUFSIZ];
+    ssize_t len = recv(evs, buf, sizeof(buf), 0);
+
+    if (len == 0 || (len == -1 && errno != EAGAIN && errno != EINTR))
+        repl->dropReplica(evs);
+}
+
+//+----------------------------------------------------------------------------+
+//| Replica write callback                                                     |
+//+----------------------------------------------------------------------------+
+
+void repl_write_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a replicator object */
+    Replicator *repl = (Replicator *)ptr;
+
+    repl->flush(evs);
+}
+
+//+----------------------------------------------------------------------------+
+//| Feed timer callback                                                        |
+//+----------------------------------------------------------------------------+
+
+void repl_feed_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a replicator object */
+    Replicator *repl = (Replicator *)ptr;
+
+    repl->feed();
+}
@@ -0,0 +1,138 @@
+#ifndef __REPLICATION_H__
+#define __REPLICATION_H__
+
+#include "config.h"
+#include "htable.h"
+#include "parser.h"
+#include "segment.h"
+#include <event.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const size_t REPL_MAX_PENDING = 64 * 1024 * 1024;
+static const int    REPL_RETRY_SEC   = 1;
+
+//+----------------------------------------------------------------------------+
+//| Replication backlog (ring buffer in shared memory)                         |
+//+----------------------------------------------------------------------------+
+
+class Backlog {
+    SegmentHeader *hdr;
+    char          *ring;
+
+public:
+    Backlog(Segment *segment)
+        : hdr(segment->header()), ring(segment->backlog()) {}
+
+    /* Caller holds the table lock (or the partition lock of the key) */
+    bool     active() const { return ring && hdr->replicas > 0; }
+    void     append(const std::string &record);
+
+    /* Readers take the backlog lock: partition owners append concurrently */
+    void     lock()   { shmLock(&hdr->backlogLock); }
+    void     unlock() { shmUnlock(&hdr->backlogLock); }
+    uint64_t offset() const { return hdr->replOffset; }
+    bool     holds(uint64_t from) const;
+    int      read(uint64_t from, std::string *out);
+};
+
+//+----------------------------------------------------------------------------+
+//| Replica connected to primary                                               |
+//+----------------------------------------------------------------------------+
+
+class ReplicaConn {
+public:
+    struct event *readEvent;
+    struct event *writeEvent;
+    uint64_t     offset;
+    std::string  outBuf;
+
+    ReplicaConn() : readEvent(nullptr), writeEvent(nullptr), offset(0) {}
+    ~ReplicaConn();
+};
+
+//+----------------------------------------------------------------------------+
+//| Replicator class (primary side process)                                    |
+//+----------------------------------------------------------------------------+
+
+class Replicator {
+    struct event_base *base;
+    struct event  *listenEvent;
+    struct event  *feedTimer;
+    int           listener;
+    std::string   ip;
+    uint16_t      port;
+    int           interval;
+    std::unordered_map<int, ReplicaConn *> replicas;
+
+    /* Shared memory */
+    std::string   shmFilename;
+    Segment       *segment;
+    CHashTable    *hTable;
+    Backlog       *backlog;
+    std::string   semFile;
+    sem_t         *semaphore;
+
+    int  configListener();
+    void enableWriting(int fd);
+
+public:
+    Replicator(const Config &config)
+        : base(nullptr), listenEvent(nullptr), feedTimer(nullptr),
+          listener(-1), ip(config.ip), port(config.replPort),
+          interval(config.replIntervalMs), shmFilename(config.shmFilename),
+          segment(nullptr), hTable(nullptr), backlog(nullptr),
+          semFile(config.semFile), semaphore(nullptr) {}
+    ~Replicator();
+
+    void start();
+    void addReplica(int fd);
+    void dropReplica(int fd);
+    void feed();
+    void flush(int fd);
+};
+
+//+----------------------------------------------------------------------------+
+//| Replica link class (replica side process)                                  |
+//+----------------------------------------------------------------------------+
+
+class ReplicaLink {
+    std::string   host;
+    uint16_t      port;
+    std::string   inBuf;
+
+    /* Full sync is loaded here and swapped in at its end (null otherwise) */
+    CHashTable    *staging;
+    std::vector<char> stagingImage;
+
+    /* Shared memory */
+    std::string   shmFilename;
+    Segment       *segment;
+    CHashTable    *hTable;
+    std::string   semFile;
+    sem_t         *semaphore;
+
+    int  connectPrimary();
+    int  apply();
+    void discardStaging();
+
+public:
+    ReplicaLink(const Config &config);
+    ~ReplicaLink();
+
+    void start();
+};
+
+//+----------------------------------------------------------------------------+
+//| Callbacks                                                                  |
+//+----------------------------------------------------------------------------+
+
+void repl_accept_cb(evutil_socket_t evs, short events, void *ptr);
+void repl_read_cb  (evutil_socket_t evs, short events, void *ptr);
+void repl_write_cb (evutil_socket_t evs, short events, void *ptr);
+void repl_feed_cb  (evutil_socket_t evs, short events, void *ptr);
+
+#endif /* __REPLICATION_H__ */
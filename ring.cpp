@@ -0,0 +1,97 @@
+#include "ring.h"
+#include <string.h>
+
+//+----------------------------------------------------------------------------+
+//| Message header (payload follows, padded to 8 bytes)                        |
+//+----------------------------------------------------------------------------+
+
+struct RingMessage {
+    uint32_t length;
+    uint32_t type;
+    uint64_t token;
+};
+
+/* Length of a marker telling consumer to continue from the start */
+static const uint32_t RING_WRAP = 0xffffffff;
+
+static size_t padded(size_t size) {
+
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+//+----------------------------------------------------------------------------+
+//| Check that payload is small enough for the ring                            |
+//+----------------------------------------------------------------------------+
+
+bool Ring::fits(size_t length) const {
+
+    return sizeof(RingMessage) + padded(length) <= capacity / 2;
+}
+
+//+----------------------------------------------------------------------------+
+//| Push message                                                               |
+//+----------------------------------------------------------------------------+
+
+bool Ring::push(uint32_t type, uint64_t token, const std::string &payload) {
+
+    if (!fits(payload.size()))
+        return false;
+
+    size_t need = sizeof(RingMessage) + padded(payload.size());
+
+    uint64_t tail = hdr->tail;
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    size_t   pos  = tail % capacity;
+    size_t   skip = (capacity - pos < need) ? capacity - pos : 0;
+
+    if (capacity - (tail - head) < skip + need)
+        return false;
+
+    if (skip) {
+        /* Not enough room before the end: wrap */
+        uint32_t wrap = RING_WRAP;
+        memcpy(data + pos, &wrap, sizeof(wrap));
+        tail += skip;
+        pos = 0;
+    }
+
+    RingMessage msg = { static_cast<uint32_t>(payload.size()), type, token };
+    memcpy(data + pos, &msg, sizeof(msg));
+    memcpy(data + pos + sizeof(msg), payload.data(), payload.size());
+
+    /* Publish after the message is complete */
+    __atomic_store_n(&hdr->tail, tail + need, __ATOMIC_RELEASE);
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Pop message                                                                |
+//+----------------------------------------------------------------------------+
+
+bool Ring::pop(uint32_t *type, uint64_t *token, std::string *payload) {
+
+    uint64_t head = hdr->head;
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+        return false;
+
+    size_t   pos = head % capacity;
+    uint32_t length;
+    memcpy(&length, data + pos, sizeof(length));
+
+    if (length == RING_WRAP) {
+        head += capacity - pos;
+        pos = 0;
+    }
+
+    RingMessage msg;
+    memcpy(&msg, data + pos, sizeof(msg));
+    *type  = msg.type;
+    *token = msg.token;
+    payload->assign(data + pos + sizeof(msg), msg.length);
+
+    /* Release space to producer */
+    __atomic_store_n(&hdr->head, head + sizeof(msg) + padded(msg.length), __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include "segment.h"
+#include <stdint.h>
+#include <string>
+
+/* Message types */
+static const uint32_t RING_REQUEST = 1;
+static const uint32_t RING_REPLY   = 2;
+
+//+----------------------------------------------------------------------------+
+//| Ring control block (head and tail on separate cache lines)                 |
+//+----------------------------------------------------------------------------+
+
+struct RingHeader {
+    uint64_t head;
+    char     pad1[CACHE_LINE - sizeof(uint64_t)];
+    uint64_t tail;
+    char     pad2[CACHE_LINE - sizeof(uint64_t)];
+};
+
+//+----------------------------------------------------------------------------+
+//| Single producer single consumer ring in shared memory                      |
+//+----------------------------------------------------------------------------+
+
+class Ring {
+    RingHeader *hdr;
+    char       *data;
+    size_t     capacity;
+
+public:
+    Ring(void *memory, size_t size)
+        : hdr(static_cast<RingHeader *>(memory)),
+          data(static_cast<char *>(memory) + sizeof(RingHeader)),
+          capacity(size - sizeof(RingHeader)) {}
+
+    /* Payload of this length can ever be pushed (at most half the ring) */
+    bool fits(size_t length) const;
+
+    /* Producer side: false if there is no room */
+    bool push(uint32_t type, uint64_t token, const std::string &payload);
+
+    /* Consumer side: false if ring is empty */
+    bool pop(uint32_t *type, uint64_t *token, std::string *payload);
+};
+
+#endif /* __RING_H__ */
@@ -0,0 +1,468 @@
+#include "segment.h"
+#include <sched.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static_assert(sizeof(SegmentHeader) <= SEGMENT_HEADER_SIZE, "segment header too big");
+
+/* Region size rounded up so the next region starts on its own cache line */
+static size_t lineAligned(size_t size) {
+
+    return (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+//+----------------------------------------------------------------------------+
+//| Acquire spin lock                                                          |
+//+----------------------------------------------------------------------------+
+
+void shmLock(ShmLock *lock) {
+
+    for (int spins = 0; __atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE); ++spins) {
+        /* Holder may be descheduled: give it the core */
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+            if (++spins > 100)
+                sched_yield();
+        }
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Release spin lock                                                          |
+//+----------------------------------------------------------------------------+
+
+void shmUnlock(ShmLock *lock) {
+
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Segment destructor                                                         |
+//+----------------------------------------------------------------------------+
+
+Segment::~Segment() {
+
+    if (base && munmap(base, size) == -1)
+        std::cout << "[munmap]:\t" << strerror(errno) << std::endl;
+
+    if (shmFile != -1)
+        close(shmFile);
+}
+
+//+----------------------------------------------------------------------------+
+//| Map whole segment                                                          |
+//+----------------------------------------------------------------------------+
+
+int Segment::map() {
+
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmFile, 0);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        std::cout << "[mmap]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Check that segment was created by a compatible server                      |
+//+----------------------------------------------------------------------------+
+
+int Segment::validate(const CHashTable &geometry) {
+
+    SegmentHeader *hdr = header();
+
+    if (hdr->magic != SEGMENT_MAGIC) {
+        printf("[segment]:\t%s is not a cache segment\n", name.c_str());
+        return -1;
+    }
+    if (hdr->version != SEGMENT_VERSION || hdr->headerSize != SEGMENT_HEADER_SIZE) {
+        printf("[segment]:\t%s has layout version %u, expected %u\n",
+               name.c_str(), hdr->version, SEGMENT_VERSION);
+        return -1;
+    }
+    if (hdr->segmentSize != size ||
+        hdr->keySize     != geometry.getKeySize()   ||
+        hdr->valueSize   != geometry.getValueSize() ||
+        hdr->entrySize   != geometry.getEntrySize() ||
+        hdr->tableSize   != geometry.getTableSize()) {
+        printf("[segment]:\t%s has different table geometry\n", name.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Create and initialize new segment                                          |
+//+----------------------------------------------------------------------------+
+
+int Segment::create(size_t partitions, const std::vector<NamespaceConfig> &spaces) {
+
+    CHashTable geometry;
+    size_t rings = partitions > 1 ? RING_SETS * partitions * partitions * RING_SIZE : 0;
+
+    /* Named tables follow their headers, each on its own cache line */
+    std::vector<size_t> spaceOffsets;
+    size_t named = spaces.size() * sizeof(NamespaceHeader);
+    for (size_t i = 0; i < spaces.size(); ++i) {
+        CHashTable table(spaces[i].memory, spaces[i].keySize + 1, spaces[i].valueSize + 1);
+        spaceOffsets.push_back(named);
+        named += lineAligned(table.imageSize());
+    }
+
+    /* Regions at the end are placed back from the size: each keeps its alignment */
+    size_t stats = lineAligned(STATS_SETS * STATS_SLOTS * sizeof(Stats));
+    size_t limits = lineAligned(geometry.probeLimitsSize());
+    size_t versions = lineAligned(CHashTable::versionsSize());
+    size_t hot = lineAligned(STATS_SETS * MAX_WORKERS * sizeof(HotKeySummary));
+    size_t tracking = lineAligned(VERSION_STRIPES * sizeof(uint64_t)) +
+                      STATS_SETS * MAX_WORKERS * sizeof(TrackingQueue);
+    size = SEGMENT_HEADER_SIZE + MAX_CACHE_SIZE + REPL_BACKLOG_SIZE + rings + named + tracking +
+           limits + versions + hot + stats;
+
+    if (partitions > MAX_PARTITIONS) {
+        printf("[segment]:\tat most %lu partitions are supported\n", MAX_PARTITIONS);
+        return -1;
+    }
+
+    if (shm_unlink(name.c_str()) == -1 && errno != ENOENT)
+        std::cout << "[shm_unlink]:\t" << strerror(errno) << std::endl;
+    shmFile = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (shmFile == -1) {
+        std::cout << "[shm_open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (ftruncate(shmFile, size) == -1) {
+        std::cout << "[ftruncate]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (map() == -1)
+        return -1;
+
+    /* Fresh shm is zero-filled, so only the header needs to be written */
+    SegmentHeader *hdr = header();
+    hdr->magic       = SEGMENT_MAGIC;
+    hdr->version     = SEGMENT_VERSION;
+    hdr->headerSize  = SEGMENT_HEADER_SIZE;
+    hdr->segmentSize = size;
+    hdr->keySize     = geometry.getKeySize();
+    hdr->valueSize   = geometry.getValueSize();
+    hdr->entrySize   = geometry.getEntrySize();
+    hdr->tableSize   = geometry.getTableSize();
+    hdr->tableOffset = SEGMENT_HEADER_SIZE;
+    hdr->generation  = 1;
+    hdr->ownerPid    = getpid();
+
+    hdr->replBacklogOffset = SEGMENT_HEADER_SIZE + MAX_CACHE_SIZE;
+    hdr->replBacklogSize   = REPL_BACKLOG_SIZE;
+
+    if (partitions > 1) {
+        hdr->partitions = partitions;
+        hdr->ringOffset = hdr->replBacklogOffset + REPL_BACKLOG_SIZE;
+        hdr->ringSets   = RING_SETS;
+    }
+
+    if (!spaces.empty()) {
+        hdr->namespaceOffset = hdr->replBacklogOffset + REPL_BACKLOG_SIZE + rings;
+        hdr->namespaces      = spaces.size();
+    }
+    hdr->trackingOffset = hdr->replBacklogOffset + REPL_BACKLOG_SIZE + rings + named;
+    for (size_t i = 0; i < spaces.size(); ++i) {
+        NamespaceHeader *ns = space(i);
+        strncpy(ns->name, spaces[i].name.c_str(), NAMESPACE_NAME_SIZE - 1);
+        ns->cacheSize   = spaces[i].memory;
+        ns->keySize     = spaces[i].keySize + 1;
+        ns->valueSize   = spaces[i].valueSize + 1;
+        ns->tableOffset = hdr->namespaceOffset + spaceOffsets[i];
+        ns->stripes     = spaces[i].stripes;
+        ns->maxTTL      = spaces[i].maxTTL;
+        ns->evict       = spaces[i].evict;
+    }
+
+    hdr->probeOffset   = size - stats - hot - versions - limits;
+    hdr->versionOffset = size - stats - hot - versions;
+    hdr->hotKeysOffset = size - stats - hot;
+    hdr->statsOffset   = size - stats;
+    hdr->statsSlotSize = sizeof(Stats);
+    hdr->createdAt     = time(nullptr);
+    hdr->tscPerSec     = tscFrequency();
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Attach to existing segment                                                 |
+//+----------------------------------------------------------------------------+
+
+int Segment::attach() {
+
+    CHashTable geometry;
+
+    shmFile = shm_open(name.c_str(), O_RDWR, 0);
+    if (shmFile == -1) {
+        std::cout << "[shm_open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(shmFile, &st) == -1) {
+        std::cout << "[fstat]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    size = st.st_size;
+    if (size < SEGMENT_HEADER_SIZE) {
+        printf("[segment]:\t%s is too small\n", name.c_str());
+        return -1;
+    }
+
+    if (map() == -1)
+        return -1;
+
+    return validate(geometry);
+}
+
+//+----------------------------------------------------------------------------+
+//| Replication backlog (null if segment was created without one)              |
+//+----------------------------------------------------------------------------+
+
+char *Segment::backlog() {
+
+    if (!header()->replBacklogSize)
+        return nullptr;
+    return static_cast<char *>(base) + header()->replBacklogOffset;
+}
+
+//+----------------------------------------------------------------------------+
+//| Table change callback                                                      |
+//+----------------------------------------------------------------------------+
+
+static void change_cb(void *arg, size_t stripe, const char *key) {
+
+    /* First parameter is a segment object */
+    Segment *segment = static_cast<Segment *>(arg);
+
+    segment->keyChanged(stripe, key);
+}
+
+//+----------------------------------------------------------------------------+
+//| Attach table to segment memory                                             |
+//+----------------------------------------------------------------------------+
+
+int Segment::attachTable(CHashTable *hTable) {
+
+    if (hTable->allocate(table()) == -1)
+        return -1;
+    if (header()->partitions > 1)
+        hTable->setPartitions(header()->partitions);
+    if (header()->probeOffset)
+        hTable->setProbeLimits(static_cast<char *>(base) + header()->probeOffset);
+    if (header()->versionOffset)
+        hTable->setVersions(static_cast<char *>(base) + header()->versionOffset);
+    if (hasTracking())
+        hTable->setChangeHook(change_cb, this);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Forwarding ring from one partition owner to another                        |
+//+----------------------------------------------------------------------------+
+
+void *Segment::ring(int set, size_t from, size_t to) {
+
+    SegmentHeader *hdr = header();
+    size_t n     = hdr->partitions;
+    size_t index = (set % hdr->ringSets) * n * n + from * n + to;
+
+    return static_cast<char *>(base) + hdr->ringOffset + index * RING_SIZE;
+}
+
+//+----------------------------------------------------------------------------+
+//| Empty ring set before new workers use it (its previous users are gone)     |
+//+----------------------------------------------------------------------------+
+
+void Segment::resetRings(int set) {
+
+    size_t n = header()->partitions;
+    if (n > 1)
+        memset(ring(set, 0, 0), 0, n * n * RING_SIZE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Counter slot of process                                                    |
+//+----------------------------------------------------------------------------+
+
+Stats *Segment::stats(int set, size_t slot) {
+
+    /* Counting into a private slot keeps callers free of checks */
+    static Stats unused;
+
+    SegmentHeader *hdr = header();
+    if (!hasStats() || slot >= STATS_SLOTS)
+        return &unused;
+
+    Stats *first = reinterpret_cast<Stats *>(static_cast<char *>(base) + hdr->statsOffset);
+    return first + (set % STATS_SETS) * STATS_SLOTS + slot;
+}
+
+//+----------------------------------------------------------------------------+
+//| Heavy hitter summary of worker (null if segment has none)                  |
+//+----------------------------------------------------------------------------+
+
+HotKeySummary *Segment::hotKeys(int set, size_t worker) {
+
+    SegmentHeader *hdr = header();
+    if (!hdr->hotKeysOffset || worker >= MAX_WORKERS)
+        return nullptr;
+
+    HotKeySummary *first = reinterpret_cast<HotKeySummary *>(static_cast<char *>(base) +
+                                                             hdr->hotKeysOffset);
+    return first + (set % STATS_SETS) * MAX_WORKERS + worker;
+}
+
+//+----------------------------------------------------------------------------+
+//| Workers tracking a key of each stripe, one bit per (set, worker) queue     |
+//+----------------------------------------------------------------------------+
+
+uint64_t *Segment::trackingInterest() {
+
+    return reinterpret_cast<uint64_t *>(static_cast<char *>(base) + header()->trackingOffset);
+}
+
+//+----------------------------------------------------------------------------+
+//| Changed keys for worker                                                    |
+//+----------------------------------------------------------------------------+
+
+TrackingQueue *Segment::trackingQueue(int set, size_t worker) {
+
+    TrackingQueue *first = reinterpret_cast<TrackingQueue *>(trackingInterest() + VERSION_STRIPES);
+    return first + (set % STATS_SETS) * MAX_WORKERS + worker;
+}
+
+//+----------------------------------------------------------------------------+
+//| Tell workers tracking the stripe that key changed (caller holds its lock)  |
+//+----------------------------------------------------------------------------+
+
+void Segment::keyChanged(size_t stripe, const char *key) {
+
+    /* Whole table changed: every worker flushes */
+    uint64_t mask = key ? __atomic_load_n(&trackingInterest()[stripe], __ATOMIC_ACQUIRE) : ~0ULL;
+
+    while (mask) {
+        int q = __builtin_ctzll(mask);
+        mask &= mask - 1;
+
+        TrackingQueue *queue = trackingQueue(q / MAX_WORKERS, q % MAX_WORKERS);
+        shmLock(&queue->lock);
+        uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if (!key || queue->head - tail >= TRACKING_SLOTS) {
+            __atomic_store_n(&queue->overflow, 1, __ATOMIC_RELEASE);
+        } else {
+            strncpy(queue->keys[queue->head % TRACKING_SLOTS], key, MAX_KEY_SIZE - 1);
+            __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+        }
+        shmUnlock(&queue->lock);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Sum counters of every slot (no lock: each slot has a single writer)        |
+//+----------------------------------------------------------------------------+
+
+void Segment::collectStats(Stats *total) {
+
+    memset(total, 0, sizeof(*total));
+
+    for (int set = 0; set < STATS_SETS; ++set) {
+        for (size_t slot = 0; slot < STATS_SLOTS && hasStats(); ++slot)
+            addStats(total, stats(set, slot));
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Header of named table                                                      |
+//+----------------------------------------------------------------------------+
+
+NamespaceHeader *Segment::space(size_t i) {
+
+    NamespaceHeader *first = reinterpret_cast<NamespaceHeader *>(static_cast<char *>(base) +
+                                                                 header()->namespaceOffset);
+    return first + i;
+}
+
+//+----------------------------------------------------------------------------+
+//| Index of named table (-1 if there is none)                                 |
+//+----------------------------------------------------------------------------+
+
+int Segment::findNamespace(const std::string &name) {
+
+    for (size_t i = 0; i < namespaces(); ++i) {
+        if (name == space(i)->name)
+            return i;
+    }
+    return -1;
+}
+
+//+----------------------------------------------------------------------------+
+//| Check that named tables are the configured ones                            |
+//+----------------------------------------------------------------------------+
+
+bool Segment::sameNamespaces(const std::vector<NamespaceConfig> &spaces) {
+
+    if (spaces.size() != namespaces())
+        return false;
+
+    for (size_t i = 0; i < spaces.size(); ++i) {
+        NamespaceHeader *ns = space(i);
+        if (spaces[i].name != ns->name || spaces[i].memory != ns->cacheSize ||
+            spaces[i].keySize + 1 != ns->keySize || spaces[i].valueSize + 1 != ns->valueSize ||
+            spaces[i].stripes != ns->stripes || spaces[i].maxTTL != ns->maxTTL ||
+            spaces[i].evict != static_cast<bool>(ns->evict))
+            return false;
+    }
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Table over segment memory of named table                                   |
+//+----------------------------------------------------------------------------+
+
+CHashTable *Segment::namespaceTable(size_t i) {
+
+    NamespaceHeader *ns = space(i);
+
+    CHashTable *table = new CHashTable(ns->cacheSize, ns->keySize, ns->valueSize);
+    table->allocate(static_cast<char *>(base) + ns->tableOffset);
+    if (ns->stripes > 1)
+        table->setPartitions(ns->stripes);
+    return table;
+}
+
+//+----------------------------------------------------------------------------+
+//| Lock all partitions (caller holds the semaphore)                           |
+//+----------------------------------------------------------------------------+
+
+void lockPartitions(SegmentHeader *hdr) {
+
+    for (size_t p = 0; p < hdr->partitions; ++p)
+        shmLock(&hdr->partitionLocks[p]);
+}
+
+//+----------------------------------------------------------------------------+
+//| Unlock all partitions                                                      |
+//+----------------------------------------------------------------------------+
+
+void unlockPartitions(SegmentHeader *hdr) {
+
+    for (size_t p = 0; p < hdr->partitions; ++p)
+        shmUnlock(&hdr->partitionLocks[p]);
+}
+
+//+----------------------------------------------------------------------------+
+//| Remove segment name                                                        |
+//+----------------------------------------------------------------------------+
+
+void Segment::unlink() {
+
+    if (shm_unlink(name.c_str()) == -1)
+        std::cout << "[shm_unlink]:\t" << strerror(errno) << std::endl;
+}
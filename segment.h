@@ -0,0 +1,215 @@
+#ifndef __SEGMENT_H__
+#define __SEGMENT_H__
+
+#include "config.h"
+#include "hotkeys.h"
+#include "htable.h"
+#include "stats.h"
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+static const uint64_t SEGMENT_MAGIC       = 0x3147455348434d59ULL; /* "YMCHSEG1" */
+/* Bumped whenever header fields move: servers refuse to adopt other layouts */
+static const uint32_t SEGMENT_VERSION     = 2;
+static const size_t   SEGMENT_HEADER_SIZE = 4096;
+static const size_t   REPL_BACKLOG_SIZE   = 1024 * 1024;
+static const size_t   MAX_PARTITIONS      = MAX_WORKERS;
+static const size_t   RING_SIZE           = 64 * 1024;
+static const int      RING_SETS           = 2;
+static const size_t   MAX_NAMESPACES      = 16;
+static const size_t   MAX_STRIPES         = 64;
+static const size_t   NAMESPACE_NAME_SIZE = 32;
+static const size_t   TRACKING_SLOTS      = 512;
+
+//+----------------------------------------------------------------------------+
+//| Spin lock living in shared memory                                          |
+//+----------------------------------------------------------------------------+
+
+struct ShmLock {
+    uint32_t locked;
+    char     pad[CACHE_LINE - sizeof(uint32_t)];
+};
+
+void shmLock(ShmLock *lock);
+void shmUnlock(ShmLock *lock);
+
+//+----------------------------------------------------------------------------+
+//| Keys changed under the eyes of one worker's tracking clients               |
+//|                                                                            |
+//| Whoever changes a key pushes it under the queue lock; the worker pops      |
+//| without it. A full queue only raises overflow: the worker then takes       |
+//| every key it tracks for changed.                                           |
+//+----------------------------------------------------------------------------+
+
+struct TrackingQueue {
+    ShmLock  lock;
+    uint64_t head     __attribute__((aligned(CACHE_LINE)));
+    uint64_t overflow;
+    uint64_t tail     __attribute__((aligned(CACHE_LINE)));
+    char     keys[TRACKING_SLOTS][MAX_KEY_SIZE] __attribute__((aligned(CACHE_LINE)));
+};
+
+/* Interest bit of every (set, worker) queue fits one word */
+static_assert(STATS_SETS * MAX_WORKERS <= 64, "too many tracking queues");
+
+//+----------------------------------------------------------------------------+
+//| Named table in shared memory                                               |
+//|                                                                            |
+//| Only workers and the cleaner use named tables: snapshots, the append-only  |
+//| log and replication cover the default table.                               |
+//+----------------------------------------------------------------------------+
+
+struct NamespaceHeader {
+    char     name[NAMESPACE_NAME_SIZE];
+
+    /* Table geometry, as passed to CHashTable */
+    uint64_t cacheSize;
+    uint64_t keySize;
+    uint64_t valueSize;
+    uint64_t tableOffset;
+
+    /* Policies */
+    uint64_t stripes;
+    int64_t  maxTTL;
+    uint64_t evict;
+
+    /* One lock per stripe: probing never leaves a stripe */
+    ShmLock  stripeLocks[MAX_STRIPES] __attribute__((aligned(CACHE_LINE)));
+};
+
+//+----------------------------------------------------------------------------+
+//| Shared memory segment header                                               |
+//+----------------------------------------------------------------------------+
+
+struct SegmentHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t segmentSize;
+
+    /* Table geometry */
+    uint64_t keySize;
+    uint64_t valueSize;
+    uint64_t entrySize;
+    uint64_t tableSize;
+    uint64_t tableOffset;
+
+    /* Bumped each time a new server adopts the segment */
+    uint64_t generation;
+    pid_t    ownerPid;
+
+    /* Fields below start zeroed in a fresh segment; new ones go before the
+       locks, which moves them (bump SEGMENT_VERSION) */
+
+    /* Append-only log: sequence of last mutation and file generation */
+    uint64_t aofSequence;
+    uint64_t aofGeneration;
+
+    /* Replication backlog: ring of mutations, written under the table lock */
+    uint64_t replBacklogOffset;
+    uint64_t replBacklogSize;
+    uint64_t replOffset;
+    uint64_t replicas;
+
+    /* Shared-nothing mode: partition count and forwarding rings */
+    uint64_t partitions;
+    uint64_t ringOffset;
+    uint64_t ringSets;
+
+    /* Counters: STATS_SETS sets of STATS_SLOTS slots (set chosen by generation) */
+    uint64_t statsOffset;
+    int64_t  createdAt;
+    uint64_t statsSlotSize;
+    uint64_t tscPerSec;
+
+    /* Probe limit of every home slot (bounds misses) */
+    uint64_t probeOffset;
+
+    /* Key stripe versions checked by worker near-caches */
+    uint64_t versionOffset;
+
+    /* Heavy hitters: STATS_SETS sets of MAX_WORKERS summaries */
+    uint64_t hotKeysOffset;
+
+    /* Named tables: headers, then their tables */
+    uint64_t namespaceOffset;
+    uint64_t namespaces;
+
+    /* Invalidation tracking: interest mask of every key stripe, then queues */
+    uint64_t trackingOffset;
+
+    /* Owner logs mutations (sequence stays 0 until the first one is logged) */
+    uint64_t aofEnabled;
+
+    /* Locks: backlog writers, and owner of each partition */
+    ShmLock  backlogLock __attribute__((aligned(CACHE_LINE)));
+    ShmLock  partitionLocks[MAX_PARTITIONS];
+};
+
+//+----------------------------------------------------------------------------+
+//| Shared memory segment class                                                |
+//+----------------------------------------------------------------------------+
+
+class Segment {
+    std::string name;
+    int         shmFile;
+    void        *base;
+    size_t      size;
+
+    int  map();
+    int  validate(const CHashTable &geometry);
+
+public:
+    Segment(std::string name)
+        : name(name), shmFile(-1), base(nullptr), size(0) {}
+    ~Segment();
+
+    /* Create new segment (owner) or attach to existing one */
+    int  create(size_t partitions = 0,
+                const std::vector<NamespaceConfig> &spaces = std::vector<NamespaceConfig>());
+    int  attach();
+    void unlink();
+
+    SegmentHeader *header() { return static_cast<SegmentHeader *>(base); }
+    void          *table()  { return static_cast<char *>(base) + header()->tableOffset; }
+    char          *backlog();
+
+    /* Point table at segment memory with segment's partitioning */
+    int            attachTable(CHashTable *hTable);
+
+    /* Shared-nothing mode */
+    size_t partitions() { return header()->partitions; }
+    void  *ring(int set, size_t from, size_t to);
+    void   resetRings(int set);
+
+    /* Counters (segments created without them count into a dummy) */
+    bool   hasStats() { return header()->statsSlotSize == sizeof(Stats); }
+    Stats *stats(int set, size_t slot);
+    void   collectStats(Stats *total);
+    HotKeySummary *hotKeys(int set, size_t worker);
+    void   lockPartition(size_t p)   { shmLock(&header()->partitionLocks[p]); }
+    void   unlockPartition(size_t p) { shmUnlock(&header()->partitionLocks[p]); }
+
+    /* Named tables (table is the caller's to delete) */
+    size_t           namespaces() { return header()->namespaces; }
+    NamespaceHeader *space(size_t i);
+    int              findNamespace(const std::string &name);
+    bool             sameNamespaces(const std::vector<NamespaceConfig> &spaces);
+    CHashTable      *namespaceTable(size_t i);
+    void lockStripe(size_t i, size_t s)   { shmLock(&space(i)->stripeLocks[s]); }
+    void unlockStripe(size_t i, size_t s) { shmUnlock(&space(i)->stripeLocks[s]); }
+
+    /* Invalidation tracking (segments created without it have none) */
+    bool           hasTracking() { return header()->trackingOffset != 0; }
+    uint64_t      *trackingInterest();
+    TrackingQueue *trackingQueue(int set, size_t worker);
+    void           keyChanged(size_t stripe, const char *key);
+};
+
+/* Whole-table access: holders of the semaphore also take every partition */
+void lockPartitions(SegmentHeader *hdr);
+void unlockPartitions(SegmentHeader *hdr);
+
+#endif /* __SEGMENT_H__ */
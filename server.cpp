@@ -4,9 +4,13 @@
 //| Server class constructor                                                   |
 //+----------------------------------------------------------------------------+
 
-Server::Server(std::string ip, uint16_t port, std::string shm, std::string sem)
-: ip(ip), port(port), shmFilename(shm), base(nullptr), mainEvent(nullptr),
-semaphore(nullptr), semFile(sem), ttl_cleaner(-1) {}
+Server::Server(const Config &config)
+: config(config), base(nullptr), mainEvent(nullptr), master(-1),
+unixListener(-1), unixEvent(nullptr),
+segment(nullptr), hTable(nullptr), semaphore(nullptr), ttl_cleaner(-1),
+replicator(-1), replicaLink(-1), slotSet(0),
+control(-1), controlEvent(nullptr), handedOff(false), dumpEvent(nullptr), metrics(nullptr),
+metricsListener(-1), owner(false) {}
 
 //+----------------------------------------------------------------------------+
 //| Server class destructor                                                    |
@@ -16,33 +20,75 @@ Server::~Server() {
 
     /* Free memory and close sockets */
     for (size_t i = 0; i < workers.size(); ++i) {
-        if (workers[i].first != -1)
+        if (handedOff) {
+            /* Let workers finish serving their clients */
+            if (workers[i].first > 0)
+                waitpid(workers[i].first, nullptr, 0);
+        } else if (workers[i].first != -1) {
             kill(workers[i].first, SIGINT);
+        }
         close(workers[i].second);
     }
 
-    if (ttl_cleaner != -1)
-        kill(ttl_cleaner, SIGINT);
+    stopHelpers();
+
+    for (size_t i = 0; i < notifyPipes.size(); ++i) {
+        close(notifyPipes[i].first);
+        close(notifyPipes[i].second);
+    }
 
     if (mainEvent) {
         event_free(mainEvent);
         mainEvent = nullptr;
     }
+    if (unixEvent) {
+        event_free(unixEvent);
+        unixEvent = nullptr;
+    }
+    if (controlEvent) {
+        event_free(controlEvent);
+        controlEvent = nullptr;
+    }
+    if (dumpEvent) {
+        event_free(dumpEvent);
+        dumpEvent = nullptr;
+    }
+    if (metrics) {
+        int sock = metrics->release();
+        if (sock != -1)
+            close(sock);
+        delete metrics;
+        metrics = nullptr;
+    }
     if (base) {
         event_base_free(base);
         base = nullptr;
     }
-    close(master);
-    close(shmFile);
-
-    if (shm_unlink(shmFilename.c_str()) == -1)
-        std::cout << "[shm_unlink]:\t" << strerror(errno) << std::endl;
+    if (master != -1)
+        close(master);
+    if (unixListener != -1) {
+        close(unixListener);
+        if (owner && !handedOff)
+            unlink(config.unixPath.c_str());
+    }
+    if (control != -1) {
+        close(control);
+        unlink(config.controlPath.c_str());
+    }
+    delete hTable;
 
     if (sem_close(semaphore) == -1)
         std::cout << "[sem_close]:\t" << strerror(errno) << std::endl;
 
-    if (sem_unlink(semFile.c_str()) == -1)
-        std::cout << "[sem_unlink]:\t" << strerror(errno) << std::endl;
+    /* Table and semaphore now belong to the new server */
+    if (owner && !handedOff) {
+        if (segment)
+            segment->unlink();
+
+        if (sem_unlink(config.semFile.c_str()) == -1)
+            std::cout << "[sem_unlink]:\t" << strerror(errno) << std::endl;
+    }
+    delete segment;
 }
 
 //+----------------------------------------------------------------------------+
@@ -62,8 +108,8 @@ int Server::configMaster() {
     struct sockaddr_in sAddr;
     bzero(&sAddr, sizeof(sAddr));
     sAddr.sin_family = AF_INET;
-    sAddr.sin_port   = htons(port);
-    int result = inet_pton(AF_INET, ip.c_str(), &(sAddr.sin_addr));
+    sAddr.sin_port   = htons(config.port);
+    int result = inet_pton(AF_INET, config.ip.c_str(), &(sAddr.sin_addr));
 
     /* Check result of parsing IP */
     if (result == 0) {
@@ -98,46 +144,53 @@ int Server::configMaster() {
 }
 
 //+----------------------------------------------------------------------------+
-//| Send descriptor to selected worker                                         |
+//| Configure unix socket for local clients                                    |
 //+----------------------------------------------------------------------------+
 
-void Server::sendDescriptor(int worker, int fd) {
+int Server::configUnix() {
 
-    int  BUF_LEN = 1;
-    char buf[BUF_LEN];
+    struct sockaddr_un sAddr;
+    if (config.unixPath.size() >= sizeof(sAddr.sun_path)) {
+        printf("[configUnix]:\tunix socket path is too long\n");
+        return -1;
+    }
 
-    /* Send fd in message */
-    ssize_t       size;
-    struct msghdr msg;
-    struct iovec  iov;
-    union {
-        struct cmsghdr cmsghdr;
-        char control[CMSG_SPACE(sizeof(int))];
-    } cmsgu;
-    struct cmsghdr *cmsg;
+    int unixSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (unixSocket == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
 
-    iov.iov_base = buf;
-    iov.iov_len  = BUF_LEN;
+    /* Fill parameters */
+    bzero(&sAddr, sizeof(sAddr));
+    sAddr.sun_family = AF_UNIX;
+    strncpy(sAddr.sun_path, config.unixPath.c_str(), sizeof(sAddr.sun_path) - 1);
 
-    msg.msg_name    = nullptr;
-    msg.msg_namelen = 0;
-    msg.msg_iov     = &iov;
-    msg.msg_iovlen  = 1;
+    /* Socket file left by a crashed server */
+    unlink(config.unixPath.c_str());
+    evutil_make_socket_nonblocking(unixSocket);
 
-    msg.msg_control = cmsgu.control;
-    msg.msg_controllen = sizeof(cmsgu.control);
+    if (bind(unixSocket, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[bind]:\t" << strerror(errno) << std::endl;
+        close(unixSocket);
+        return -1;
+    }
+    if (listen(unixSocket, SOMAXCONN) == -1) {
+        std::cout << "[listen]:\t" << strerror(errno) << std::endl;
+        close(unixSocket);
+        return -1;
+    }
 
-    cmsg = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
-    cmsg->cmsg_level = SOL_SOCKET;
-    cmsg->cmsg_type = SCM_RIGHTS;
+    return unixSocket;
+}
 
-    *((int *)CMSG_DATA(cmsg)) = fd;
-    size = sendmsg(worker, &msg, 0);
+//+----------------------------------------------------------------------------+
+//| Send descriptor to selected worker                                         |
+//+----------------------------------------------------------------------------+
 
-    if (size == -1)
-        std::cout << "[sendmsg]:\t" << strerror(errno) << std::endl;
+void Server::sendDescriptor(int worker, int fd) {
 
+    ::sendDescriptor(worker, fd);
     close(fd);
 }
 
@@ -170,8 +223,18 @@ int Server::createWorker(size_t i) {
         /* Child process */
         close(pair_fd[PARENT]);
 
+        /* Own CPU: first touch keeps private memory on its node */
+        if (!config.workerCpus.empty())
+            pinProcess(std::vector<int>(1, config.workerCpus[i % config.workerCpus.size()]));
+        else if (!startCpus.empty())
+            pinProcess(startCpus);
+        if (config.numaPolicy == NUMA_INTERLEAVE)
+            interleaveProcessMemory();
+
         /* Create worker */
-        Worker w(i + 1, pair_fd[CHILD], shmFilename, semFile);
+        Worker w(i + 1, pair_fd[CHILD], config);
+        w.useSlots(slotSet);
+        w.forwardVia(notifyPipes);
         w.start();
         exit(1);
 
@@ -184,6 +247,54 @@ int Server::createWorker(size_t i) {
     return 0;
 }
 
+//+----------------------------------------------------------------------------+
+//| Place pages of new segment on NUMA nodes, before anything touches them     |
+//+----------------------------------------------------------------------------+
+
+void Server::placeSegment() {
+
+    SegmentHeader *hdr = segment->header();
+
+    if (config.numaPolicy == NUMA_INTERLEAVE) {
+        if (interleaveMemory(hdr, hdr->segmentSize) == 0)
+            printf("[server]:\tsegment interleaved over %d nodes\n", numaNodes());
+
+    } else if (config.numaPolicy == NUMA_PARTITION && segment->partitions() > 1) {
+        /* Slots of a partition go to the node of its owner (pages at the edges to either) */
+        uintptr_t page  = sysconf(_SC_PAGESIZE);
+        size_t    n     = segment->partitions();
+        size_t    bytes = hTable->getTableSize() / n * hTable->getEntrySize();
+        char      *table = static_cast<char *>(segment->table());
+
+        for (size_t p = 0; p < n; ++p) {
+            uintptr_t begin = reinterpret_cast<uintptr_t>(table + p * bytes) / page * page;
+            uintptr_t end   = reinterpret_cast<uintptr_t>(table + (p + 1) * bytes);
+            int node = cpuNode(config.workerCpus[p % config.workerCpus.size()]);
+            placeMemory(reinterpret_cast<void *>(begin), end - begin, node);
+        }
+
+        /* Named tables are served by every worker */
+        if (segment->namespaces() > 0) {
+            char *spaces = reinterpret_cast<char *>(hdr) + hdr->namespaceOffset;
+            interleaveMemory(spaces, hdr->trackingOffset - hdr->namespaceOffset);
+        }
+
+        /* Tracking queue is drained by its worker only (pages at the edges to either) */
+        if (segment->hasTracking()) {
+            for (int set = 0; set < STATS_SETS; ++set) {
+                for (int w = 0; w < config.numWorkers; ++w) {
+                    char *queue = reinterpret_cast<char *>(segment->trackingQueue(set, w));
+                    uintptr_t begin = reinterpret_cast<uintptr_t>(queue) / page * page;
+                    uintptr_t end   = reinterpret_cast<uintptr_t>(queue + sizeof(TrackingQueue));
+                    int node = cpuNode(config.workerCpus[w % config.workerCpus.size()]);
+                    placeMemory(reinterpret_cast<void *>(begin), end - begin, node);
+                }
+            }
+        }
+        printf("[server]:\tpartitions placed on nodes of their workers\n");
+    }
+}
+
 //+----------------------------------------------------------------------------+
 //| Create cleaner process                                                     |
 //+----------------------------------------------------------------------------+
@@ -200,7 +311,7 @@ int Server::createCleaner() {
 
     } else if (pid == 0) {
         /* Create cleaner */
-        Cleaner cl(shmFilename, semFile);
+        Cleaner cl(config);
         cl.start();
         exit(1);
 
@@ -213,48 +324,216 @@ int Server::createCleaner() {
 }
 
 //+----------------------------------------------------------------------------+
-//| Configure server                                                           |
+//| Create replicator process (primary side)                                   |
 //+----------------------------------------------------------------------------+
 
-int Server::configure(int numWorkers) {
+int Server::createReplicator() {
+
+    /* Fork process */
+    pid_t pid = fork();
 
-    /* Create hash table in shared memory */
-    if (shm_unlink(shmFilename.c_str()) == -1)
-        std::cout << "[shm_unlink]:\t" << strerror(errno) << std::endl;
-    shmFile = shm_open(shmFilename.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
-    if (shmFile == -1) {
-        std::cout << "[shm_open]:\t" << strerror(errno) << std::endl;
+    if (pid == -1) {
+        /* Error */
+        std::cout << "[fork]:\t" << strerror(errno) << std::endl;
         return -1;
+
+    } else if (pid == 0) {
+        /* Create replicator */
+        Replicator repl(config);
+        repl.start();
+        exit(1);
+
+    } else {
+        /* Server process */
+        replicator = pid;
     }
-    if (ftruncate(shmFile, MAX_CACHE_SIZE) == -1) {
-        std::cout << "[ftruncate]:\t" << strerror(errno) << std::endl;
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Create replica link process (replica side)                                 |
+//+----------------------------------------------------------------------------+
+
+int Server::createReplicaLink() {
+
+    /* Fork process */
+    pid_t pid = fork();
+
+    if (pid == -1) {
+        /* Error */
+        std::cout << "[fork]:\t" << strerror(errno) << std::endl;
         return -1;
+
+    } else if (pid == 0) {
+        /* Create replica link */
+        ReplicaLink link(config);
+        link.start();
+        exit(1);
+
+    } else {
+        /* Server process */
+        replicaLink = pid;
+    }
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Stop cleaner and replication processes                                     |
+//+----------------------------------------------------------------------------+
+
+void Server::stopHelpers() {
+
+    pid_t *helpers[] = { &ttl_cleaner, &replicator, &replicaLink };
+
+    for (size_t i = 0; i < sizeof(helpers) / sizeof(helpers[0]); ++i) {
+        if (*helpers[i] == -1)
+            continue;
+        kill(*helpers[i], SIGTERM);
+        waitpid(*helpers[i], nullptr, 0);
+        *helpers[i] = -1;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Configure server                                                           |
+//+----------------------------------------------------------------------------+
+
+int Server::configure() {
+
+    /* Children inherit this: only the server dumps latency */
+    signal(SIGUSR1, SIG_IGN);
+
+    /* Cleaner and replication inherit this too; workers move to their own
+       CPU, or back to where the server started */
+    if (!config.serviceCpus.empty()) {
+        processCpus(&startCpus);
+        pinProcess(config.serviceCpus);
     }
 
-    /* Create semaphore */
-    if (sem_unlink(semFile.c_str()) == -1)
-        std::cout << "[sem_unlink]:\t" << strerror(errno) << std::endl;
-    semaphore = sem_open(semFile.c_str(), O_CREAT, S_IRUSR | S_IWUSR, 1);
-    if (semaphore == SEM_FAILED) {
-        std::cout << "[sem_open]:\t" << strerror(errno) << std::endl;
+    segment = new Segment(config.shmFilename);
+
+    if (config.upgrade) {
+        /* Adopt table and semaphore of running server */
+        if (segment->attach() == -1)
+            return -1;
+        semaphore = sem_open(config.semFile.c_str(), 0);
+        if (semaphore == SEM_FAILED) {
+            std::cout << "[sem_open]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        /* Partition owners can't change while old workers still drain */
+        size_t partitions = (config.partitioned && config.numWorkers > 1) ? config.numWorkers : 0;
+        if (segment->partitions() != partitions) {
+            printf("[server]:\trunning server uses %lu partitions, not %lu\n",
+                   segment->partitions(), partitions);
+            return -1;
+        }
+
+        /* Old workers keep using the named tables they have */
+        if (!segment->sameNamespaces(config.namespaces)) {
+            printf("[server]:\trunning server has other namespaces\n");
+            return -1;
+        }
+
+    } else {
+        /* Create hash table in shared memory */
+        if (segment->create(config.partitioned ? config.numWorkers : 0, config.namespaces) == -1)
+            return -1;
+        owner = true;
+
+        /* Create semaphore */
+        if (sem_unlink(config.semFile.c_str()) == -1)
+            std::cout << "[sem_unlink]:\t" << strerror(errno) << std::endl;
+        semaphore = sem_open(config.semFile.c_str(), O_CREAT, S_IRUSR | S_IWUSR, 1);
+        if (semaphore == SEM_FAILED) {
+            std::cout << "[sem_open]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+
+    hTable = new CHashTable();
+    if (segment->attachTable(hTable) == -1)
         return -1;
+    if (owner)
+        placeSegment();
+
+    /* Old workers keep the other rings and counters while they drain */
+    slotSet = (segment->header()->generation + (config.upgrade ? 1 : 0)) % STATS_SETS;
+    hTable->setStats(segment->stats(slotSet, STATS_SERVER));
+
+    /* Warm restart: fill table from snapshot before anyone can use it */
+    if (!config.upgrade && (!config.snapshotPath.empty() || !config.imagePath.empty())) {
+        bool loaded = !config.snapshotPath.empty() &&
+                      Snapshot(config.snapshotPath).load(hTable) == 0;
+
+        /* Bulk-loaded image seeds a node until it has snapshots of its own */
+        if (!loaded && !config.imagePath.empty())
+            loaded = Snapshot(config.imagePath).load(hTable) == 0;
+
+        if (!loaded)
+            printf("[server]:\tstarting with empty table\n");
     }
-    
+
+    /* Mutations logged after the snapshot */
+    if (!config.upgrade && !config.aofPath.empty() && config.replicaOf.empty())
+        AppendLog::replay(config.aofPath, hTable, segment->header());
+
+    /* Direct writers of shared-memory clients check it before every set */
+    segment->header()->aofEnabled = !config.aofPath.empty();
+
+    if (segment->partitions() > 1 && configForwarding() == -1)
+        return -1;
+
     /* Create workers */
-    for (size_t i = 0; i < numWorkers; ++i) {
+    for (size_t i = 0; i < config.numWorkers; ++i) {
         if (createWorker(i) == -1)
             return -1;  
     }
 
-    /* Create cleaner */
+    if (config.upgrade) {
+        /* Take listening socket over from running server */
+        master = takeOver();
+        if (master == -1)
+            return -1;
+
+        owner = true;
+        SegmentHeader *hdr = segment->header();
+        hdr->generation++;
+        hdr->ownerPid = getpid();
+        printf("[server]:\tadopted segment, generation %llu\n",
+               (unsigned long long)hdr->generation);
+
+    } else {
+        /* Create TCP socket for handling incoming connections */
+        master = configMaster();
+        if (master == -1)
+            return -1;
+    }
+
+    /* Running server may not have had one */
+    if (!config.unixPath.empty() && unixListener == -1) {
+        unixListener = configUnix();
+        if (unixListener == -1)
+            return -1;
+    }
+
+    /* Create cleaner (old server stops its cleaner on hand-off) */
     if (createCleaner() == -1)
         return -1; 
-    
-    /* Create TCP socket for handling incoming connections */
-    master = configMaster();
-    if (master == -1) {
+
+    /* Replication */
+    if (config.replPort && createReplicator() == -1)
+        return -1;
+    if (!config.replicaOf.empty() && createReplicaLink() == -1)
+        return -1;
+
+    /* Listen for next upgrade */
+    control = configControl();
+    if (control == -1)
         return -1;
-    }
 
     /* Create event base */
     base = event_base_new();
@@ -263,9 +542,216 @@ int Server::configure(int numWorkers) {
     mainEvent = event_new(base, master, EV_READ | EV_PERSIST, accept_cb, (void *)this);
     event_add(mainEvent, nullptr);
 
+    /* Local clients go through the same dispatch */
+    if (unixListener != -1) {
+        unixEvent = event_new(base, unixListener, EV_READ | EV_PERSIST, accept_cb, (void *)this);
+        event_add(unixEvent, nullptr);
+        printf("[server]:\tlocal clients at %s\n", config.unixPath.c_str());
+    }
+
+    /* Create event for upgrade requests */
+    controlEvent = event_new(base, control, EV_READ | EV_PERSIST, control_cb, (void *)this);
+    event_add(controlEvent, nullptr);
+
+    if (configMetrics() == -1)
+        return -1;
+
+    /* Dump latency histograms on request */
+    dumpEvent = evsignal_new(base, SIGUSR1, dump_cb, (void *)this);
+    event_add(dumpEvent, nullptr);
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Prepare rings and wake-up pipes of partition owners                        |
+//+----------------------------------------------------------------------------+
+
+int Server::configForwarding() {
+
+    segment->resetRings(slotSet);
+
+    for (size_t i = 0; i < segment->partitions(); ++i) {
+        int pipe_fd[2];
+        if (pipe(pipe_fd) == -1) {
+            std::cout << "[pipe]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+        evutil_make_socket_nonblocking(pipe_fd[0]);
+        evutil_make_socket_nonblocking(pipe_fd[1]);
+        notifyPipes.push_back(std::make_pair(pipe_fd[0], pipe_fd[1]));
+    }
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Serve metrics on listener of previous server or on own one                 |
+//+----------------------------------------------------------------------------+
+
+int Server::configMetrics() {
+
+    if (!config.metricsPort) {
+        if (metricsListener != -1)
+            close(metricsListener);
+        metricsListener = -1;
+        return 0;
+    }
+
+    if (metricsListener == -1) {
+        metricsListener = Metrics::configListener(config.ip, config.metricsPort);
+        if (metricsListener == -1)
+            return -1;
+    }
+
+    metrics = new Metrics(base, segment, config.numWorkers);
+    metrics->start(metricsListener);
+    metricsListener = -1;
+
+    printf("[server]:\tmetrics at http://%s:%d/metrics\n", config.ip.c_str(), config.metricsPort);
     return 0;
 }
 
+//+----------------------------------------------------------------------------+
+//| Configure control socket                                                   |
+//+----------------------------------------------------------------------------+
+
+int Server::configControl() {
+
+    struct sockaddr_un sAddr;
+    if (config.controlPath.size() >= sizeof(sAddr.sun_path)) {
+        printf("[configControl]:\tcontrol path is too long\n");
+        return -1;
+    }
+
+    int controlSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (controlSocket == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Fill parameters */
+    bzero(&sAddr, sizeof(sAddr));
+    sAddr.sun_family = AF_UNIX;
+    strncpy(sAddr.sun_path, config.controlPath.c_str(), sizeof(sAddr.sun_path) - 1);
+
+    /* Previous owner (if any) keeps its own descriptor */
+    unlink(config.controlPath.c_str());
+    evutil_make_socket_nonblocking(controlSocket);
+
+    if (bind(controlSocket, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[bind]:\t" << strerror(errno) << std::endl;
+        close(controlSocket);
+        return -1;
+    }
+    if (listen(controlSocket, 1) == -1) {
+        std::cout << "[listen]:\t" << strerror(errno) << std::endl;
+        close(controlSocket);
+        return -1;
+    }
+
+    return controlSocket;
+}
+
+//+----------------------------------------------------------------------------+
+//| Receive listening socket from running server                               |
+//+----------------------------------------------------------------------------+
+
+int Server::takeOver() {
+
+    struct sockaddr_un sAddr;
+    bzero(&sAddr, sizeof(sAddr));
+    sAddr.sun_family = AF_UNIX;
+    strncpy(sAddr.sun_path, config.controlPath.c_str(), sizeof(sAddr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        std::cout << "[socket]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&sAddr, sizeof(sAddr)) == -1) {
+        std::cout << "[connect]:\t" << strerror(errno) << std::endl;
+        close(sock);
+        return -1;
+    }
+
+    /* Client listener first, then optional ones until end of hand-off */
+    char tag = 0;
+    int fd = receiveDescriptor(sock, &tag);
+
+    if (fd < 0 || tag != LISTENER_TCP) {
+        printf("[server]:\tno listener received from running server\n");
+        if (fd >= 0)
+            close(fd);
+        close(sock);
+        return -1;
+    }
+
+    int other;
+    while ((other = receiveDescriptor(sock, &tag)) >= 0 && tag != HANDOFF_END) {
+        if (tag == LISTENER_METRICS && metricsListener == -1)
+            metricsListener = other;
+        else if (tag == LISTENER_UNIX && unixListener == -1 && !config.unixPath.empty())
+            unixListener = other;
+        else
+            close(other);
+    }
+    close(sock);
+
+    printf("[server]:\ttook over listener from running server\n");
+    return fd;
+}
+
+//+----------------------------------------------------------------------------+
+//| Give listening socket to new server and drain                              |
+//+----------------------------------------------------------------------------+
+
+void Server::handOff(int fd) {
+
+    if (::sendDescriptor(fd, master, LISTENER_TCP) == -1)
+        return;
+
+    /* New server keeps serving scrapes on the same port */
+    if (metrics) {
+        int sock = metrics->release();
+        ::sendDescriptor(fd, sock, LISTENER_METRICS);
+        close(sock);
+    }
+
+    /* Socket file stays, so local clients never see it missing */
+    if (unixListener != -1) {
+        ::sendDescriptor(fd, unixListener, LISTENER_UNIX);
+        event_del(unixEvent);
+        close(unixListener);
+        unixListener = -1;
+    }
+
+    /* New server starts now, not once helpers below are gone */
+    if (send(fd, &HANDOFF_END, 1, 0) == -1)
+        std::cout << "[send]:\t" << strerror(errno) << std::endl;
+
+    /* Pending connections stay in the shared backlog for the new server */
+    event_del(mainEvent);
+    event_del(controlEvent);
+    close(master);
+    master = -1;
+    close(control);
+    control = -1;
+
+    /* New server runs its own cleaner and replication */
+    stopHelpers();
+
+    /* Workers keep serving connected clients */
+    for (size_t i = 0; i < workers.size(); ++i) {
+        if (workers[i].first > 0)
+            kill(workers[i].first, SIGTERM);
+    }
+
+    handedOff = true;
+    printf("[server]:\thanded off to new server, draining\n");
+    event_base_loopexit(base, nullptr);
+}
+
 //+----------------------------------------------------------------------------+
 //| Main server event loop                                                     |
 //+----------------------------------------------------------------------------+
@@ -273,7 +759,7 @@ int Server::configure(int numWorkers) {
 void Server::start() {
 
     /* Start event loop */
-    printf("[server]:\tstarted at %s:%d\n", ip.c_str(), port);
+    printf("[server]:\tstarted at %s:%d\n", config.ip.c_str(), config.port);
     event_base_dispatch(base);
 }
 
@@ -289,6 +775,59 @@ void Server::acceptClient(int fd) {
     sendDescriptor(workers[id].second, fd);
 }
 
+//+----------------------------------------------------------------------------+
+//| Print latency histograms of every worker and their sum                     |
+//+----------------------------------------------------------------------------+
+
+void Server::dumpLatency() {
+
+    uint64_t tscPerSec = segment->header()->tscPerSec;
+    Stats    total;
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+        Stats worker;
+        memset(&worker, 0, sizeof(worker));
+        for (int set = 0; set < STATS_SETS; ++set)
+            addStats(&worker, segment->stats(set, STATS_WORKERS + i));
+
+        printf("[server]:\tworker #%lu\n%s", i + 1, latencyReport(worker, tscPerSec).c_str());
+    }
+
+    segment->collectStats(&total);
+    printf("[server]:\tall processes\n%s", latencyReport(total, tscPerSec).c_str());
+    fflush(stdout);
+}
+
+//+----------------------------------------------------------------------------+
+//| Latency dump signal callback                                               |
+//+----------------------------------------------------------------------------+
+
+void dump_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a server object */
+    Server *srv = (Server *)ptr;
+
+    srv->dumpLatency();
+}
+
+//+----------------------------------------------------------------------------+
+//| Control socket callback                                                    |
+//+----------------------------------------------------------------------------+
+
+void control_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a server object */
+    Server *srv = (Server *)ptr;
+
+    /* New server connected */
+    int fd = accept(evs, 0, 0);
+    if (fd == -1)
+        return;
+
+    srv->handOff(fd);
+    close(fd);
+}
+
 //+----------------------------------------------------------------------------+
 //| Accept callback                                                            |
 //+----------------------------------------------------------------------------+
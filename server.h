@@ -1,25 +1,38 @@
 #ifndef __SERVER_H__
 #define __SERVER_H__
 
+#include "affinity.h"
+#include "aof.h"
+#include "config.h"
 #include "worker.h"
 #include "cleaner.h"
+#include "descriptor.h"
+#include "metrics.h"
+#include "replication.h"
+#include "segment.h"
+#include "snapshot.h"
 #include <assert.h>
 #include <arpa/inet.h> /* inet_pton */
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <iostream>
 #include <vector>
 
-static const std::string SHM_FILE     = "shared_ht";
-static const std::string SEM_FILE     = "mycache_sem";
-static const std::string DEFAULT_IP   = "127.0.0.1";
-static const uint16_t    DEFAULT_PORT = 8080;
-static const int         NUM_WORKERS  = 4;
 static const int         PARENT       = 0;
 static const int         CHILD        = 1;
 
+/* Tags of descriptors passed over control socket */
+static const char        LISTENER_TCP     = 'T';
+static const char        LISTENER_METRICS = 'M';
+static const char        LISTENER_UNIX    = 'U';
+
+/* Sent without descriptor once every listener is passed */
+static const char        HANDOFF_END      = 'E';
+
 //+----------------------------------------------------------------------------+
 //| Server class                                                               |
 //+----------------------------------------------------------------------------+
@@ -28,41 +41,79 @@ class Server {
     struct event_base *base;
     struct event  *mainEvent;
     int           master;
-    std::string   ip;
-    uint16_t      port;
+
+    /* Unix socket listener of local clients */
+    int           unixListener;
+    struct event  *unixEvent;
+    Config        config;
     ServWorkers   workers;
 
     /* Shared memory */
-    std::string   shmFilename;
-    int           shmFile;
+    Segment       *segment;
+    CHashTable    *hTable;
     sem_t         *semaphore;
-    std::string   semFile;
 
     /* Cleaner process ID */
     pid_t         ttl_cleaner;
 
+    /* Replication process IDs */
+    pid_t         replicator;
+    pid_t         replicaLink;
+
+    /* CPUs before pinning to service CPUs: unpinned workers get them back */
+    std::vector<int> startCpus;
+
+    /* Rings and counters of this generation, wake-up pipes of workers */
+    int           slotSet;
+    std::vector<std::pair<int, int>> notifyPipes;
+
+    /* Control socket for hot upgrades */
+    int           control;
+    struct event  *controlEvent;
+    bool          handedOff;
+
+    /* SIGUSR1 prints latency histograms */
+    struct event  *dumpEvent;
+
+    /* Prometheus endpoint */
+    Metrics       *metrics;
+    int           metricsListener;
+
+    /* Segment and semaphore are ours to remove (failed upgrade leaves them) */
+    bool          owner;
+
     int  configMaster();
+    int  configUnix();
+    int  configControl();
+    int  configForwarding();
+    void placeSegment();
+    int  takeOver();
+    int  configMetrics();
     void sendDescriptor(int worker, int fd);
     int  createWorker(size_t i);
     int  createCleaner();
+    int  createReplicator();
+    int  createReplicaLink();
+    void stopHelpers();
 
 public:
-    Server(std::string ip         = DEFAULT_IP,
-           uint16_t    port       = DEFAULT_PORT,
-           std::string shm        = SHM_FILE,
-           std::string sem        = SEM_FILE);
+    Server(const Config &config = Config());
     ~Server();
 
     /* Server methods */
-    int  configure(int numWorkers = NUM_WORKERS);
+    int  configure();
     void start();
     void acceptClient(int fd);
+    void handOff(int fd);
+    void dumpLatency();
 };
 
 //+----------------------------------------------------------------------------+
 //| Callbacks                                                                  |
 //+----------------------------------------------------------------------------+
 
-void accept_cb(evutil_socket_t evs, short events, void *ptr);
+void accept_cb (evutil_socket_t evs, short events, void *ptr);
+void control_cb(evutil_socket_t evs, short events, void *ptr);
+void dump_cb   (evutil_socket_t evs, short events, void *ptr);
 
 #endif /* __SERVER_H__ */
\ No newline at end of file
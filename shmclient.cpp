@@ -0,0 +1,185 @@
+#include "shmclient.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+//+----------------------------------------------------------------------------+
+//| Unmap segment, close semaphore                                             |
+//+----------------------------------------------------------------------------+
+
+ShmClient::~ShmClient() {
+
+    if (semaphore && sem_close(semaphore) == -1)
+        std::cout << "[sem_close]:\t" << strerror(errno) << std::endl;
+
+    /* Segment belongs to the server: only unmap it */
+    delete nearCache;
+    delete hTable;
+    delete segment;
+}
+
+//+----------------------------------------------------------------------------+
+//| Attach to segment and semaphore of running server                          |
+//+----------------------------------------------------------------------------+
+
+int ShmClient::open(bool allowWrites) {
+
+    segment = new Segment(shmName);
+    if (segment->attach() == -1)
+        return -1;
+
+    hTable = new CHashTable();
+    if (segment->attachTable(hTable) == -1)
+        return -1;
+
+    semaphore = sem_open(semName.c_str(), 0);
+    if (semaphore == SEM_FAILED) {
+        std::cout << "[sem_open]:\t" << strerror(errno) << std::endl;
+        semaphore = nullptr;
+        return -1;
+    }
+
+    /* Inserts and removals keep the gauges of the stats command right */
+    writes = allowWrites;
+    if (writes && segment->partitions() <= 1) {
+        stats = segment->stats(segment->header()->generation % STATS_SETS, STATS_SERVER);
+        hTable->setStats(stats);
+    }
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Serve hot values from process memory                                       |
+//+----------------------------------------------------------------------------+
+
+void ShmClient::useNearCache(size_t entries) {
+
+    delete nearCache;
+    nearCache = entries ? new NearCache(entries) : nullptr;
+}
+
+//+----------------------------------------------------------------------------+
+//| Lock table for key, as worker does                                         |
+//+----------------------------------------------------------------------------+
+
+int ShmClient::lock(const std::string &key) {
+
+    if (segment->partitions() > 1) {
+        segment->lockPartition(hTable->partitionOf(key));
+        return 0;
+    }
+
+    while (sem_wait(semaphore) == -1) {
+        if (errno != EINTR) {
+            std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Unlock table for key                                                       |
+//+----------------------------------------------------------------------------+
+
+void ShmClient::unlock(const std::string &key) {
+
+    if (segment->partitions() > 1)
+        segment->unlockPartition(hTable->partitionOf(key));
+    else if (sem_post(semaphore) == -1)
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+}
+
+//+----------------------------------------------------------------------------+
+//| Direct write would not be lost on restart or replicas (caller holds lock)  |
+//+----------------------------------------------------------------------------+
+
+bool ShmClient::canWrite() {
+
+    SegmentHeader *hdr = segment->header();
+    return writes && hdr->partitions <= 1 && hdr->replicas == 0 && !hdr->aofEnabled;
+}
+
+//+----------------------------------------------------------------------------+
+//| Get value of key                                                           |
+//+----------------------------------------------------------------------------+
+
+int ShmClient::get(const std::string &key, std::string *value) {
+
+    if (!hTable)
+        return -1;
+
+    /* Hot key still at cached version: no lock, no probe */
+    bool near = nearCache && hTable->hasVersions();
+    if (near && nearCache->lookup(key, hTable->version(key), value))
+        return HT_OK;
+
+    if (lock(key) == -1)
+        return -1;
+
+    uint64_t version = near ? hTable->version(key) : 0;
+    std::string stored;
+    int status = hTable->lookup(key, &stored);
+
+    unlock(key);
+
+    if (status != HT_OK)
+        return status;
+    if (!expandValue(stored, value))
+        return -1;
+
+    if (near && nearCache->admit(key))
+        nearCache->store(key, version, *value);
+
+    return HT_OK;
+}
+
+//+----------------------------------------------------------------------------+
+//| Set value of key                                                           |
+//+----------------------------------------------------------------------------+
+
+int ShmClient::set(int ttl, const std::string &key, const std::string &value) {
+
+    if (!hTable || !writes)
+        return -1;
+
+    /* Same codec rules as worker: stored form passes through if it decodes */
+    std::string stored = value;
+    if (isCompressed(value)) {
+        std::string raw;
+        if (!expandValue(value, &raw))
+            return -1;
+    } else if (compressThreshold && value.size() >= compressThreshold &&
+               value.size() <= MAX_RAW_VALUE) {
+        stored = compressValue(value);
+    }
+
+    if (lock(key) == -1)
+        return -1;
+
+    int status = canWrite() ? hTable->put(ttl, key, stored) : -1;
+
+    unlock(key);
+    return status;
+}
+
+//+----------------------------------------------------------------------------+
+//| Remove key                                                                 |
+//+----------------------------------------------------------------------------+
+
+int ShmClient::remove(const std::string &key) {
+
+    if (!hTable || !writes)
+        return -1;
+
+    if (lock(key) == -1)
+        return -1;
+
+    int status = canWrite() ? hTable->remove(key) : -1;
+
+    unlock(key);
+    return status;
+}
@@ -0,0 +1,68 @@
+#ifndef __SHMCLIENT_H__
+#define __SHMCLIENT_H__
+
+#include "compress.h"
+#include "config.h"
+#include "htable.h"
+#include "nearcache.h"
+#include "segment.h"
+#include <semaphore.h>
+#include <string>
+
+//+----------------------------------------------------------------------------+
+//| In-process client of a running server on the same host                     |
+//|                                                                            |
+//| Maps the server's segment and semaphore and works on the table directly,   |
+//| under the same lock a worker takes for the key: the semaphore, or the      |
+//| partition lock in shared-nothing mode. An optional near-cache serves hot   |
+//| keys without the lock while their stripe version holds.                    |
+//|                                                                            |
+//| Direct writes are off by default. They skip the append-only log and the    |
+//| replication feed, so they are refused once either is in use, and in        |
+//| shared-nothing mode, where only the owner worker writes a partition.       |
+//|                                                                            |
+//| Only the default table is reachable: named tables ("use <name>") are       |
+//| served over the protocol only.                                             |
+//+----------------------------------------------------------------------------+
+
+class ShmClient {
+    std::string shmName;
+    std::string semName;
+    Segment     *segment;
+    CHashTable  *hTable;
+    sem_t       *semaphore;
+
+    /* Table gauges of direct writes (server slot, guarded by the semaphore) */
+    Stats       *stats;
+    bool        writes;
+    size_t      compressThreshold;
+
+    NearCache   *nearCache;
+
+    int  lock(const std::string &key);
+    void unlock(const std::string &key);
+    bool canWrite();
+
+public:
+    ShmClient(std::string shmName = SHM_FILE, std::string semName = SEM_FILE)
+        : shmName(shmName), semName(semName), segment(nullptr), hTable(nullptr),
+          semaphore(nullptr), stats(nullptr), writes(false), compressThreshold(0),
+          nearCache(nullptr) {}
+    ~ShmClient();
+
+    /* Attach to segment and semaphore of running server */
+    int  open(bool allowWrites = false);
+
+    /* Keep up to entries hot values in process (before first get) */
+    void useNearCache(size_t entries);
+
+    /* Store values of at least threshold bytes compressed, like the server */
+    void compressFrom(size_t threshold) { compressThreshold = threshold; }
+
+    /* HT_* result of table operation, -1 if client cannot do it */
+    int  get(const std::string &key, std::string *value);
+    int  set(int ttl, const std::string &key, const std::string &value);
+    int  remove(const std::string &key);
+};
+
+#endif /* __SHMCLIENT_H__ */
@@ -0,0 +1,209 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+//+----------------------------------------------------------------------------+
+//| FNV-1a checksum of table image                                             |
+//+----------------------------------------------------------------------------+
+
+uint64_t Snapshot::checksum(const void *data, size_t size) {
+
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//+----------------------------------------------------------------------------+
+//| Save snapshot                                                              |
+//+----------------------------------------------------------------------------+
+
+pid_t Snapshot::save(CHashTable *hTable, SegmentHeader *hdr, sem_t *semaphore) {
+
+    std::vector<char> image(hTable->imageSize());
+
+    /* Point-in-time copy: workers are blocked only for one memcpy */
+    if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    lockPartitions(hdr);
+    hTable->saveImage(image.data());
+    time_t savedAt = time(nullptr);
+    unlockPartitions(hdr);
+    if (sem_post(semaphore) == -1) {
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    /* Write the private copy from a child so the caller keeps ticking */
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cout << "[fork]:\t" << strerror(errno) << std::endl;
+        return -1;
+
+    } else if (pid > 0) {
+        return pid;
+    }
+
+    _exit(write(hTable, image.data(), savedAt) == 0 ? 0 : 1);
+}
+
+//+----------------------------------------------------------------------------+
+//| Write snapshot file                                                        |
+//+----------------------------------------------------------------------------+
+
+int Snapshot::write(CHashTable *hTable, const void *image, time_t savedAt) {
+
+    const char *data = static_cast<const char *>(image);
+    size_t      size = hTable->imageSize();
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version    = SNAPSHOT_VERSION;
+    header.partitions = hTable->getPartitions();
+    header.keySize    = hTable->getKeySize();
+    header.valueSize  = hTable->getValueSize();
+    header.entrySize  = hTable->getEntrySize();
+    header.tableSize  = hTable->getTableSize();
+    header.savedAt    = savedAt;
+    header.checksum   = checksum(data, size);
+
+    /* Write temporary file and atomically replace the old snapshot */
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    const char *chunks[] = { reinterpret_cast<const char *>(&header), data };
+    size_t      sizes[]  = { sizeof(header), size };
+
+    for (int i = 0; i < 2; ++i) {
+        size_t done = 0;
+        while (done < sizes[i]) {
+            ssize_t len = ::write(fd, chunks[i] + done, sizes[i] - done);
+            if (len == -1) {
+                std::cout << "[write]:\t" << strerror(errno) << std::endl;
+                close(fd);
+                unlink(tmpPath.c_str());
+                return -1;
+            }
+            done += len;
+        }
+    }
+
+    if (fsync(fd) == -1) {
+        std::cout << "[fsync]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+    close(fd);
+
+    if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+        std::cout << "[rename]:\t" << strerror(errno) << std::endl;
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Load snapshot                                                              |
+//+----------------------------------------------------------------------------+
+
+int Snapshot::load(CHashTable *hTable) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        if (errno != ENOENT)
+            std::cout << "[open]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        std::cout << "[fstat]:\t" << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    if (size < sizeof(SnapshotHeader)) {
+        printf("[snapshot]:\t%s is truncated\n", path.c_str());
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "[mmap]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    const SnapshotHeader *header = static_cast<const SnapshotHeader *>(data);
+    const char           *image  = static_cast<const char *>(data) + sizeof(SnapshotHeader);
+    size_t                imageSize = size - sizeof(SnapshotHeader);
+    int                   result = -1;
+
+    /* Validate header and geometry */
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION) {
+        printf("[snapshot]:\t%s has unknown format\n", path.c_str());
+
+    } else if (header->keySize   != hTable->getKeySize()   ||
+               header->valueSize != hTable->getValueSize() ||
+               header->entrySize != hTable->getEntrySize() ||
+               header->tableSize != hTable->getTableSize() ||
+               imageSize != hTable->imageSize()) {
+        printf("[snapshot]:\t%s has different table geometry\n", path.c_str());
+
+    } else if (header->checksum != checksum(image, imageSize)) {
+        printf("[snapshot]:\t%s is corrupted\n", path.c_str());
+
+    } else if (std::max<uint32_t>(header->partitions, 1) != hTable->getPartitions()) {
+        /* Slots depend on partitioning: insert entries one by one */
+        CHashTable saved;
+        saved.allocate(const_cast<char *>(image));
+        saved.setPartitions(std::max<uint32_t>(header->partitions, 1));
+
+        std::string key, value;
+        int ttl;
+        for (size_t i = 0; i < saved.getTableSize(); ++i) {
+            if (saved.readEntry(i, &key, &value, &ttl))
+                hTable->put(ttl, key, value);
+        }
+
+        time_t now = time(nullptr);
+        int elapsed = (now > header->savedAt) ? static_cast<int>(now - header->savedAt) : 0;
+        hTable->ageTTL(elapsed);
+
+        printf("[snapshot]:\tloaded %s into new partitioning (%d s old)\n", path.c_str(), elapsed);
+        result = 0;
+
+    } else if (hTable->loadImage(image, imageSize) == 0) {
+        /* TTLs were frozen while the server was down */
+        time_t now = time(nullptr);
+        int elapsed = (now > header->savedAt) ? static_cast<int>(now - header->savedAt) : 0;
+        hTable->ageTTL(elapsed);
+
+        printf("[snapshot]:\tloaded %s (%d s old)\n", path.c_str(), elapsed);
+        result = 0;
+    }
+
+    munmap(data, size);
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "htable.h"
+#include "segment.h"
+#include <semaphore.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include <string>
+
+static const char     SNAPSHOT_MAGIC[8] = { 'M', 'Y', 'C', 'S', 'N', 'A', 'P', '\0' };
+static const uint32_t SNAPSHOT_VERSION  = 1;
+
+//+----------------------------------------------------------------------------+
+//| Snapshot file header (followed by raw table image)                         |
+//+----------------------------------------------------------------------------+
+
+struct SnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t partitions;  /* 0 in files written before partitioning */
+    uint64_t keySize;
+    uint64_t valueSize;
+    uint64_t entrySize;
+    uint64_t tableSize;
+    int64_t  savedAt;
+    uint64_t checksum;
+};
+
+//+----------------------------------------------------------------------------+
+//| Snapshot class                                                             |
+//+----------------------------------------------------------------------------+
+
+class Snapshot {
+    std::string path;
+
+    static uint64_t checksum(const void *data, size_t size);
+
+public:
+    Snapshot(std::string path) : path(path) {}
+
+    /* Copy table under lock and write it from a forked child */
+    pid_t save(CHashTable *hTable, SegmentHeader *hdr, sem_t *semaphore);
+
+    /* Atomically replace file with image of table of hTable's geometry */
+    int   write(CHashTable *hTable, const void *image, time_t savedAt);
+
+    /* Map snapshot file and load it into empty table */
+    int   load(CHashTable *hTable);
+};
+
+#endif /* __SNAPSHOT_H__ */
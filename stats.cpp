@@ -0,0 +1,96 @@
+#include "stats.h"
+#include <stdio.h>
+
+/* Slots are plain arrays of counters (padding stays zero) */
+static const size_t STATS_FIELDS = sizeof(Stats) / sizeof(uint64_t);
+
+static const char *STAGE_NAMES[LAT_STAGES] = {
+    "parse", "lock_wait", "lock_hold", "probe", "send", "sweep_hold"
+};
+
+//+----------------------------------------------------------------------------+
+//| Add slot to total                                                          |
+//+----------------------------------------------------------------------------+
+
+void addStats(Stats *total, const Stats *slot) {
+
+    uint64_t       *dst = reinterpret_cast<uint64_t *>(total);
+    const uint64_t *src = reinterpret_cast<const uint64_t *>(slot);
+
+    for (size_t i = 0; i < STATS_FIELDS; ++i)
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+//+----------------------------------------------------------------------------+
+//| Name of stage                                                              |
+//+----------------------------------------------------------------------------+
+
+const char *stageName(int stage) {
+
+    return (stage >= 0 && stage < LAT_STAGES) ? STAGE_NAMES[stage] : "unknown";
+}
+
+//+----------------------------------------------------------------------------+
+//| Measure TSC frequency against monotonic clock                              |
+//+----------------------------------------------------------------------------+
+
+uint64_t tscFrequency() {
+
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec start, end;
+    struct timespec pause = { 0, 20 * 1000 * 1000 };
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t ticks = readTSC();
+    nanosleep(&pause, nullptr);
+    ticks = readTSC() - ticks;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint64_t ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+    return ns ? ticks * 1000000000ULL / ns : 1000000000ULL;
+#else
+    return 1000000000ULL;
+#endif
+}
+
+//+----------------------------------------------------------------------------+
+//| Upper bound of bucket where cumulative count reaches quantile              |
+//+----------------------------------------------------------------------------+
+
+static uint64_t quantile(const Histogram &h, double q) {
+
+    uint64_t rank = static_cast<uint64_t>(q * h.count);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < LAT_BUCKETS; ++i) {
+        seen += h.buckets[i];
+        if (seen > rank)
+            return 1ULL << i;
+    }
+    return 1ULL << (LAT_BUCKETS - 1);
+}
+
+//+----------------------------------------------------------------------------+
+//| Summarize histograms in nanoseconds                                        |
+//+----------------------------------------------------------------------------+
+
+std::string latencyReport(const Stats &stats, uint64_t tscPerSec) {
+
+    std::string out;
+    double nsPerTick = tscPerSec ? 1e9 / tscPerSec : 1.0;
+    char line[256];
+
+    for (int stage = 0; stage < LAT_STAGES; ++stage) {
+        const Histogram &h = stats.latency[stage];
+        double avg = h.count ? static_cast<double>(h.sum) / h.count : 0;
+
+        snprintf(line, sizeof(line),
+                 "latency %s count %llu avg_ns %.0f p50_ns %.0f p99_ns %.0f p999_ns %.0f\n",
+                 STAGE_NAMES[stage], (unsigned long long)h.count, avg * nsPerTick,
+                 h.count ? quantile(h, 0.5)   * nsPerTick : 0.0,
+                 h.count ? quantile(h, 0.99)  * nsPerTick : 0.0,
+                 h.count ? quantile(h, 0.999) * nsPerTick : 0.0);
+        out.append(line);
+    }
+    return out;
+}
\ No newline at end of file
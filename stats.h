@@ -0,0 +1,148 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static const size_t CACHE_LINE  = 64;
+static const size_t MAX_WORKERS = 32;
+
+/* Counter slots: one per process that touches the table */
+enum {
+    STATS_SERVER = 0,
+    STATS_CLEANER,
+    STATS_REPLICATION,
+    STATS_WORKERS
+};
+
+static const size_t STATS_SLOTS = STATS_WORKERS + MAX_WORKERS;
+static const int    STATS_SETS  = 2;
+
+/* Timed stages of request handling (sweep hold is the cleaner's) */
+enum {
+    LAT_PARSE = 0,
+    LAT_LOCK_WAIT,
+    LAT_LOCK_HOLD,
+    LAT_PROBE,
+    LAT_SEND,
+    LAT_SWEEP_HOLD,
+    LAT_STAGES
+};
+
+/* Bucket i counts durations in [2^(i-1), 2^i) ticks */
+static const int    LAT_BUCKETS = 48;
+
+//+----------------------------------------------------------------------------+
+//| Log-bucketed histogram of durations in TSC ticks                           |
+//+----------------------------------------------------------------------------+
+
+struct Histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t buckets[LAT_BUCKETS];
+};
+
+//+----------------------------------------------------------------------------+
+//| Counters of one process (single writer, own cache lines)                   |
+//|                                                                            |
+//| Table gauges are kept as deltas: a process adds what it inserted and       |
+//| subtracts what it removed, so only the sum over all slots is meaningful.   |
+//| Every field is uint64_t so slots can be summed field by field.             |
+//+----------------------------------------------------------------------------+
+
+struct Stats {
+    /* Requests */
+    uint64_t gets;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t sets;
+    uint64_t keyTooBig;
+    uint64_t valueTooBig;
+    uint64_t badTTL;
+    uint64_t noSpace;
+    uint64_t badQueries;
+
+    /* Table (deltas) */
+    uint64_t expirations;
+    uint64_t live;
+    uint64_t tombstones;
+    uint64_t bytes;
+
+    /* Connections (current is a delta) */
+    uint64_t connections;
+    uint64_t totalConnections;
+
+    /* Gets answered from worker near-cache (also counted as hits) */
+    uint64_t nearHits;
+
+    /* Entries dropped to make room in named tables that evict */
+    uint64_t evictions;
+
+    /* Clients paused over soft output limit, dropped over hard one */
+    uint64_t outputPauses;
+    uint64_t outputDrops;
+
+    /* Key-change notifications sent to tracking clients */
+    uint64_t invalidations;
+
+    /* Latency of request stages */
+    Histogram latency[LAT_STAGES];
+} __attribute__((aligned(CACHE_LINE)));
+
+/* Only the owner of a slot writes it: no read-modify-write needed */
+inline void statAdd(uint64_t *counter, uint64_t delta) {
+
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + delta,
+                     __ATOMIC_RELAXED);
+}
+
+inline void statSub(uint64_t *counter, uint64_t delta) {
+
+    statAdd(counter, -delta);
+}
+
+void addStats(Stats *total, const Stats *slot);
+
+//+----------------------------------------------------------------------------+
+//| Cheap timestamps: TSC where available, monotonic clock otherwise           |
+//+----------------------------------------------------------------------------+
+
+inline uint64_t readTSC() {
+
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+inline void recordLatency(Stats *stats, int stage, uint64_t start) {
+
+    uint64_t ticks = readTSC() - start;
+    int bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    if (bucket >= LAT_BUCKETS)
+        bucket = LAT_BUCKETS - 1;
+
+    Histogram *h = &stats->latency[stage];
+    statAdd(&h->count, 1);
+    statAdd(&h->sum, ticks);
+    statAdd(&h->buckets[bucket], 1);
+}
+
+/* Name of stage for reports */
+const char *stageName(int stage);
+
+/* Ticks per second of readTSC() (measured, takes a few milliseconds) */
+uint64_t tscFrequency();
+
+/* Human readable histogram summary, one line per stage */
+std::string latencyReport(const Stats &stats, uint64_t tscPerSec);
+
+#endif /* __STATS_H__ */
@@ -0,0 +1,384 @@
+#include "htable.h"
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const size_t MAX_PROBES = 64;      /* longer probes share the last bucket */
+static const int    TTL        = 1 << 30; /* never expires during a run */
+
+//+----------------------------------------------------------------------------+
+//| Benchmark parameters                                                       |
+//+----------------------------------------------------------------------------+
+
+struct TableBenchConfig {
+    size_t              cacheSize;
+    size_t              ops;
+    std::vector<double> loads;
+    std::vector<double> tombstones;
+    std::vector<double> hitRatios;
+    std::vector<double> keyLengths;
+
+    TableBenchConfig()
+        : cacheSize(16 * MAX_CACHE_SIZE), ops(1000000),
+          loads({ 0.25, 0.5, 0.75, 0.9 }), tombstones({ 0, 0.1, 0.3 }),
+          hitRatios({ 1, 0.5, 0 }), keyLengths({ 8, 31 }) {}
+};
+
+//+----------------------------------------------------------------------------+
+//| Hardware cache miss counter (Linux only)                                   |
+//+----------------------------------------------------------------------------+
+
+class MissCounter {
+    int fd;
+
+public:
+    MissCounter() : fd(-1) {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd == -1)
+            printf("[perf_event_open]:\t%s (cache misses not reported)\n", strerror(errno));
+#endif
+    }
+
+    ~MissCounter() {
+        if (fd != -1)
+            close(fd);
+    }
+
+    bool available() const { return fd != -1; }
+
+    void start() {
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+};
+
+//+----------------------------------------------------------------------------+
+//| Result of one measured operation                                           |
+//+----------------------------------------------------------------------------+
+
+struct OpResult {
+    double              nsPerOp;
+    double              missesPerOp;
+    std::vector<size_t> probes;
+
+    OpResult() : nsPerOp(0), missesPerOp(0), probes(MAX_PROBES + 1, 0) {}
+
+    size_t probeQuantile(double q) const {
+        size_t total = 0, seen = 0;
+        for (size_t i = 0; i < probes.size(); ++i)
+            total += probes[i];
+        for (size_t i = 0; i < probes.size(); ++i) {
+            seen += probes[i];
+            if (total && seen >= q * total)
+                return i;
+        }
+        return MAX_PROBES;
+    }
+
+    double probeMean() const {
+        size_t total = 0, sum = 0;
+        for (size_t i = 0; i < probes.size(); ++i) {
+            total += probes[i];
+            sum   += i * probes[i];
+        }
+        return total ? static_cast<double>(sum) / total : 0;
+    }
+};
+
+//+----------------------------------------------------------------------------+
+//| Monotonic time in nanoseconds                                              |
+//+----------------------------------------------------------------------------+
+
+static uint64_t nowNs() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+//+----------------------------------------------------------------------------+
+//| Key number n padded to exact length                                        |
+//+----------------------------------------------------------------------------+
+
+static std::string makeKey(char prefix, size_t n, size_t length) {
+
+    std::string key(1, prefix);
+    key += std::to_string(n);
+    if (key.size() < length)
+        key.insert(1, length - key.size(), '0');
+    return key;
+}
+
+//+----------------------------------------------------------------------------+
+//| Time one kind of operation over a prepared key sequence                    |
+//+----------------------------------------------------------------------------+
+
+enum { OP_GET, OP_SET };
+
+static OpResult measure(CHashTable *ht, MissCounter *misses, int op,
+                        const std::vector<std::string> &keys, const std::string &value) {
+
+    OpResult result;
+
+    /* Probe lengths are gathered on a separate pass to keep the timed loop bare */
+    misses->start();
+    uint64_t start = nowNs();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (op == OP_GET)
+            ht->get(keys[i]);
+        else
+            ht->put(TTL, keys[i], value);
+    }
+    uint64_t elapsed = nowNs() - start;
+    uint64_t count   = misses->stop();
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (op == OP_GET)
+            ht->get(keys[i]);
+        else
+            ht->put(TTL, keys[i], value);
+        result.probes[std::min(ht->lastProbes(), MAX_PROBES)]++;
+    }
+
+    result.nsPerOp     = static_cast<double>(elapsed) / keys.size();
+    result.missesPerOp = static_cast<double>(count) / keys.size();
+    return result;
+}
+
+//+----------------------------------------------------------------------------+
+//| Print one result row                                                       |
+//+----------------------------------------------------------------------------+
+
+static void report(double load, double tomb, size_t keyLength, const std::string &op,
+                   const OpResult &r, bool probes, bool misses) {
+
+    printf("%5.2f %5.2f %4lu  %-12s %9.1f", load, tomb, keyLength, op.c_str(), r.nsPerOp);
+
+    if (probes)
+        printf(" %7.2f %5lu %5lu %5lu", r.probeMean(), r.probeQuantile(0.5),
+               r.probeQuantile(0.99), r.probeQuantile(1.0));
+    else
+        printf(" %7s %5s %5s %5s", "-", "-", "-", "-");
+
+    if (misses)
+        printf(" %10.2f\n", r.missesPerOp);
+    else
+        printf(" %10s\n", "-");
+}
+
+//+----------------------------------------------------------------------------+
+//| Fill table and run every operation for one configuration                   |
+//+----------------------------------------------------------------------------+
+
+static void runCase(const TableBenchConfig &config, CHashTable *ht, MissCounter *misses,
+                    double load, double tomb, size_t keyLength) {
+
+    size_t slots = ht->getTableSize();
+    size_t live  = static_cast<size_t>(load * slots);
+    size_t dead  = static_cast<size_t>(tomb * slots);
+    std::string value(16, 'v');
+
+    /* Tombstones first so live keys probe past them */
+    ht->clear();
+    for (size_t i = 0; i < dead; ++i)
+        ht->put(TTL, makeKey('t', i, keyLength), value);
+    for (size_t i = 0; i < live; ++i)
+        ht->put(TTL, makeKey('k', i, keyLength), value);
+    for (size_t i = 0; i < dead; ++i)
+        ht->remove(makeKey('t', i, keyLength));
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> liveKey(0, live ? live - 1 : 0);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    for (size_t h = 0; h < config.hitRatios.size(); ++h) {
+        double ratio = config.hitRatios[h];
+        if (!live && ratio > 0)
+            continue;
+
+        std::vector<std::string> keys(config.ops);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (coin(rng) < ratio)
+                keys[i] = makeKey('k', liveKey(rng), keyLength);
+            else
+                keys[i] = makeKey('m', i, keyLength);
+        }
+
+        std::ostringstream name;
+        name << "get hit=" << ratio;
+        report(load, tomb, keyLength, name.str(), measure(ht, misses, OP_GET, keys, value),
+               true, misses->available());
+    }
+
+    /* Overwrites keep load factor constant */
+    if (live) {
+        std::vector<std::string> keys(config.ops);
+        for (size_t i = 0; i < keys.size(); ++i)
+            keys[i] = makeKey('k', liveKey(rng), keyLength);
+        report(load, tomb, keyLength, "set", measure(ht, misses, OP_SET, keys, value),
+               true, misses->available());
+    }
+
+    /* TTL sweep: cost per slot of a full pass */
+    OpResult sweep;
+    int passes = 10;
+    misses->start();
+    uint64_t start = nowNs();
+    for (int i = 0; i < passes; ++i)
+        ht->checkTTL();
+    sweep.nsPerOp     = static_cast<double>(nowNs() - start) / (passes * slots);
+    sweep.missesPerOp = static_cast<double>(misses->stop()) / (passes * slots);
+    report(load, tomb, keyLength, "sweep/slot", sweep, false, misses->available());
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse comma separated list                                                 |
+//+----------------------------------------------------------------------------+
+
+static std::vector<double> parseList(const char *arg) {
+
+    std::vector<double> list;
+    std::stringstream stream(arg);
+    std::string item;
+
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            list.push_back(atof(item.c_str()));
+
+    return list;
+}
+
+//+----------------------------------------------------------------------------+
+//| Print usage                                                                |
+//+----------------------------------------------------------------------------+
+
+static void usage(const char *name) {
+
+    printf("usage: %s [options]\n", name);
+    printf("  --cache-size <bytes>   table memory (default %lu)\n", 16 * MAX_CACHE_SIZE);
+    printf("  --ops <n>              operations per measurement (default 1000000)\n");
+    printf("  --load <list>          load factors (default 0.25,0.5,0.75,0.9)\n");
+    printf("  --tombstones <list>    tombstone ratios (default 0,0.1,0.3)\n");
+    printf("  --hit-ratio <list>     share of gets that hit (default 1,0.5,0)\n");
+    printf("  --key-length <list>    key lengths, below %lu (default 8,31)\n", MAX_KEY_SIZE);
+}
+
+//+----------------------------------------------------------------------------+
+//| Main microbenchmark function                                               |
+//+----------------------------------------------------------------------------+
+
+int main(int argc, char *argv[]) {
+
+    enum { OPT_CACHE_SIZE = 1, OPT_OPS, OPT_LOAD, OPT_TOMBSTONES, OPT_HIT_RATIO, OPT_KEY_LENGTH };
+
+    static struct option options[] = {
+        { "cache-size", required_argument, nullptr, OPT_CACHE_SIZE },
+        { "ops",        required_argument, nullptr, OPT_OPS        },
+        { "load",       required_argument, nullptr, OPT_LOAD       },
+        { "tombstones", required_argument, nullptr, OPT_TOMBSTONES },
+        { "hit-ratio",  required_argument, nullptr, OPT_HIT_RATIO  },
+        { "key-length", required_argument, nullptr, OPT_KEY_LENGTH },
+        { nullptr,      0,                 nullptr, 0              }
+    };
+
+    TableBenchConfig config;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_CACHE_SIZE: config.cacheSize  = strtoul(optarg, nullptr, 10); break;
+        case OPT_OPS:        config.ops        = strtoul(optarg, nullptr, 10); break;
+        case OPT_LOAD:       config.loads      = parseList(optarg);            break;
+        case OPT_TOMBSTONES: config.tombstones = parseList(optarg);            break;
+        case OPT_HIT_RATIO:  config.hitRatios  = parseList(optarg);            break;
+        case OPT_KEY_LENGTH: config.keyLengths = parseList(optarg);            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!config.ops || config.loads.empty() || config.keyLengths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Table lives on an anonymous mapping, like the shm segment minus sharing */
+    CHashTable ht(config.cacheSize);
+    size_t mapped = ht.imageSize() + ht.probeLimitsSize();
+    void *memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (memory == MAP_FAILED) {
+        printf("[mmap]:\t%s\n", strerror(errno));
+        return 1;
+    }
+    ht.allocate(memory);
+    ht.setProbeLimits(static_cast<char *>(memory) + ht.imageSize());
+
+    MissCounter misses;
+
+    printf("table: %lu slots of %lu bytes, %lu ops per measurement\n",
+           ht.getTableSize(), ht.getEntrySize(), config.ops);
+    printf("%5s %5s %4s  %-12s %9s %7s %5s %5s %5s %10s\n", "load", "tomb", "klen", "op",
+           "ns/op", "probes", "p50", "p99", "max", "miss/op");
+
+    for (size_t l = 0; l < config.loads.size(); ++l)
+        for (size_t t = 0; t < config.tombstones.size(); ++t)
+            for (size_t k = 0; k < config.keyLengths.size(); ++k) {
+                double load = config.loads[l], tomb = config.tombstones[t];
+                size_t keyLength = static_cast<size_t>(config.keyLengths[k]);
+
+                /* Leave free cells: probing a full table never terminates early */
+                if (load < 0 || tomb < 0 || load + tomb > 0.98 ||
+                    !keyLength || keyLength >= ht.getKeySize()) {
+                    printf("%5.2f %5.2f %4lu  skipped\n", load, tomb, keyLength);
+                    continue;
+                }
+                runCase(config, &ht, &misses, load, tomb, keyLength);
+            }
+
+    munmap(memory, mapped);
+    return 0;
+}
@@ -28,26 +28,103 @@ Worker::~Worker() {
         delete it->second;
     }
 
+    if (drainEvent)
+        event_free(drainEvent);
+    if (drainTimer)
+        event_free(drainTimer);
+    if (commitTimer)
+        event_free(commitTimer);
+    if (ringEvent)
+        event_free(ringEvent);
+    if (retryTimer)
+        event_free(retryTimer);
+    if (captureTimer)
+        event_free(captureTimer);
+    if (hotKeysTimer)
+        event_free(hotKeysTimer);
+    if (trackingTimer)
+        event_free(trackingTimer);
+    for (size_t i = 0; i < spaces.size(); ++i)
+        delete spaces[i];
+    delete hotKeys;
+    delete capture;
+    delete nearCache;
+    delete forwarder;
+    delete aof;
+    delete backlog;
     event_free(mainEvent);
     event_base_free(base);
 
     close(serverFd);
-    close(shmFile);
-
-    if (shm_unlink(shmFilename.c_str()) == -1)
-        std::cout << "[shm_unlink]:\t" << strerror(errno) << std::endl;
 
+    /* Segment belongs to the server: only unmap it */
     if (sem_close(semaphore) == -1)
         std::cout << "[sem_close]:\t" << strerror(errno) << std::endl;
 
     delete hTable;
+    delete segment;
+}
+
+//+----------------------------------------------------------------------------+
+//| Lock table for key                                                         |
+//+----------------------------------------------------------------------------+
+
+int Worker::lock(const std::string &key) {
+
+    uint64_t start = readTSC();
+
+    if (forwarder) {
+        /* Shared-nothing mode: partition lock, uncontended for the owner */
+        segment->lockPartition(hTable->partitionOf(key));
+
+    } else if (sem_wait(semaphore) == -1) {
+        std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    recordLatency(stats, LAT_LOCK_WAIT, start);
+    lockedAt = readTSC();
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Unlock table for key                                                       |
+//+----------------------------------------------------------------------------+
+
+int Worker::unlock(const std::string &key) {
+
+    recordLatency(stats, LAT_LOCK_HOLD, lockedAt);
+
+    if (forwarder) {
+        segment->unlockPartition(hTable->partitionOf(key));
+        return 0;
+    }
+
+    if (sem_post(semaphore) == -1) {
+        std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Parse query (timed)                                                        |
+//+----------------------------------------------------------------------------+
+
+int Worker::parse(const std::string &query, std::string *key, std::string *value, int *ttl) {
+
+    uint64_t start = readTSC();
+    int result = CParser::parseLine(query, key, value, ttl);
+    recordLatency(stats, LAT_PARSE, start);
+
+    return result;
 }
 
 //+----------------------------------------------------------------------------+
 //| Compose response to query                                                  |
 //+----------------------------------------------------------------------------+
 
-std::string Worker::composeResponse(std::string query) {
+std::string Worker::composeResponse(std::string query, bool *logged) {
 
     std::string key;
     std::string value;
@@ -55,41 +132,630 @@ std::string Worker::composeResponse(std::string query) {
 
     /* Answer to compose */
     std::string answer;
+    *logged = false;
 
     if (query.empty()) {
         answer = "error (empty query)\n";
 
-    } else if (!CParser::parseLine(query, &key, &value, &ttl)) {
+    } else if (!parse(query, &key, &value, &ttl)) {
+
+        /* Hot key still at cached version: no lock, no probe */
+        bool isGet = (value == "" && ttl <= 0);
+        bool raw   = (ttl < 0);
+        bool near  = isGet && !raw && nearCache && hTable->hasVersions();
+        if (near && nearCache->lookup(key, hTable->version(key), &answer)) {
+            statAdd(&stats->gets, 1);
+            statAdd(&stats->hits, 1);
+            statAdd(&stats->nearHits, 1);
+            if (hotKeys)
+                hotKeys->add(key, query.size() + answer.size());
+            return answer;
+        }
 
-        /* Lock semaphore */
-        if (sem_wait(semaphore) == -1) {
-            std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+        /* Codec work stays outside the lock: large values are kept compressed */
+        std::string original = value;
+        if (!isGet && !readOnly && encode(&value, &original) == -1)
+            return "error (bad compressed value)\n";
+
+        if (lock(key) == -1)
             return "";
-        }
 
-        if (value == "" && ttl == 0) {
+        int status = HT_OK;
+        uint64_t version = 0;
+
+        if (isGet) {
             /* Get key from hash table */
-            answer = hTable->get(key);
+            version = near ? hTable->version(key) : 0;
+            uint64_t start = readTSC();
+            answer = hTable->get(key, &status);
+            recordLatency(stats, LAT_PROBE, start);
+
+            statAdd(&stats->gets, 1);
+            statAdd(status == HT_OK ? &stats->hits : &stats->misses, 1);
+
+        } else if (readOnly) {
+            /* Replica only takes writes from its primary */
+            answer = "error (read-only replica)\n";
 
         } else {
             /* Set in hash table */
-            answer = hTable->set(ttl, key, value);
+            uint64_t start = readTSC();
+            answer = hTable->set(ttl, key, value, &status);
+            recordLatency(stats, LAT_PROBE, start);
+            countSet(status);
+
+            /* Log while still holding the lock to keep table order */
+            if (aof && status == HT_OK) {
+                aof->logSet(segment->header(), ttl, key, value);
+                *logged = true;
+            }
+
+            /* Feed replicas in table order */
+            if (status == HT_OK && backlog->active()) {
+                backlog->append(std::string("set ") + std::to_string(ttl) + " " +
+                                key + " " + value + "\n");
+            }
         }
 
-        /* Unlock semaphore */
-        if (sem_post(semaphore) == -1) {
-            std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+        if (unlock(key) == -1)
             return "";
+
+        if (isGet && status == HT_OK) {
+            /* Decompress unless client takes stored bytes */
+            if (!raw)
+                answer = expand(key, answer);
+
+            /* Version read under the lock matches the answer */
+            if (near && nearCache->admit(key))
+                nearCache->store(key, version, answer);
+
+        } else if (!isGet && !readOnly && status == HT_OK && value != original) {
+            /* Client sees the value it sent */
+            answer = "ok " + key + " " + original + "\n";
         }
 
+        /* Sketch is worker-local: counted outside the lock */
+        if (hotKeys)
+            hotKeys->add(key, query.size() + answer.size());
+
+    } else {
+        /* Not a table operation */
+        answer = command(query);
+    }
+
+    return answer;
+}
+
+//+----------------------------------------------------------------------------+
+//| Compose response to query on named table                                   |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::spaceResponse(size_t space, const std::string &query) {
+
+    std::string key;
+    std::string value;
+    int         ttl;
+
+    if (query.empty())
+        return "error (empty query)\n";
+
+    /* Service commands are about the server */
+    if (parse(query, &key, &value, &ttl))
+        return command(query);
+
+    NamespaceHeader *ns    = segment->space(space);
+    CHashTable      *table = spaces[space];
+    bool isGet = (value == "" && ttl <= 0);
+    bool raw   = (ttl < 0);
+
+    if (!isGet && readOnly)
+        return "error (read-only replica)\n";
+
+    std::string original = value;
+    if (!isGet && encode(&value, &original) == -1)
+        return "error (bad compressed value)\n";
+
+    /* TTL policy of the table */
+    if (!isGet && ns->maxTTL && ttl > ns->maxTTL)
+        ttl = ns->maxTTL;
+
+    size_t stripe = table->partitionOf(key);
+    uint64_t start = readTSC();
+    segment->lockStripe(space, stripe);
+    recordLatency(stats, LAT_LOCK_WAIT, start);
+    lockedAt = readTSC();
+
+    std::string answer;
+    int status;
+
+    start = readTSC();
+    if (isGet) {
+        answer = table->get(key, &status);
+        statAdd(&stats->gets, 1);
+        statAdd(status == HT_OK ? &stats->hits : &stats->misses, 1);
+
     } else {
-        /* Bad query */
-        answer = "error (bad query)\n";
+        answer = table->set(ttl, key, value, &status);
+
+        /* Eviction policy: entry nearest to expiry makes room */
+        if (status == HT_NO_SPACE && ns->evict && table->evict(key) == HT_OK) {
+            statAdd(&stats->evictions, 1);
+            answer = table->set(ttl, key, value, &status);
+        }
+        countSet(status);
     }
+    recordLatency(stats, LAT_PROBE, start);
+
+    recordLatency(stats, LAT_LOCK_HOLD, lockedAt);
+    segment->unlockStripe(space, stripe);
+
+    if (isGet && status == HT_OK && !raw)
+        answer = expand(key, answer);
+    else if (!isGet && status == HT_OK && value != original)
+        answer = "ok " + key + " " + original + "\n";
 
     return answer;
 }
 
+//+----------------------------------------------------------------------------+
+//| Turn value into stored form (large values compressed)                      |
+//+----------------------------------------------------------------------------+
+
+int Worker::encode(std::string *value, std::string *original) {
+
+    *original = *value;
+
+    /* Passthrough clients send stored form: it must decode */
+    if (isCompressed(*value))
+        return expandValue(*value, original) ? 0 : -1;
+
+    if (compressThreshold && value->size() >= compressThreshold && value->size() <= MAX_RAW_VALUE)
+        *value = compressValue(*value);
+    return 0;
+}
+
+//+----------------------------------------------------------------------------+
+//| Turn get answer with stored value into one with raw value                  |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::expand(const std::string &key, const std::string &answer) {
+
+    /* Answer is "ok <key> <value>\n" */
+    size_t start = 3 + key.size() + 1;
+    if (answer.size() <= start || answer[start] != COMPRESSED_MARKER)
+        return answer;
+
+    std::string value;
+    if (!expandValue(answer.substr(start, answer.size() - start - 1), &value))
+        return "error (corrupt value)\n";
+
+    return answer.substr(0, start) + value + "\n";
+}
+
+//+----------------------------------------------------------------------------+
+//| Count set by result                                                        |
+//+----------------------------------------------------------------------------+
+
+void Worker::countSet(int status) {
+
+    statAdd(&stats->sets, 1);
+
+    switch (status) {
+    case HT_OK:
+        break;
+    case HT_KEY_TOO_BIG:
+        statAdd(&stats->keyTooBig, 1);
+        break;
+    case HT_VALUE_TOO_BIG:
+        statAdd(&stats->valueTooBig, 1);
+        break;
+    case HT_BAD_TTL:
+        statAdd(&stats->badTTL, 1);
+        break;
+    default:
+        statAdd(&stats->noSpace, 1);
+        break;
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Execute service command                                                    |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::command(const std::string &query) {
+
+    std::vector<std::string> args = CParser::split(query);
+
+    if (args.size() == 1 && args[0] == "stats")
+        return statsReport();
+
+    if (!args.empty() && args[0] == "latency" && args.size() <= 2)
+        return latencyReport(args.size() == 2 ? atoi(args[1].c_str()) : 0);
+
+    if (!args.empty() && args[0] == "hotkeys" && args.size() <= 2) {
+        int n = args.size() == 2 ? atoi(args[1].c_str()) : 10;
+        return n > 0 ? hotKeysReport(n) : "error (bad count)\n";
+    }
+
+    if (!args.empty() && args[0] == "scan" && (args.size() == 2 || args.size() == 3)) {
+        char *end;
+        size_t cursor = strtoull(args[1].c_str(), &end, 10);
+        if (*end || args[1][0] == '-')
+            return "error (bad cursor)\n";
+        int count = args.size() == 3 ? atoi(args[2].c_str()) : SCAN_COUNT;
+        if (count <= 0)
+            return "error (bad count)\n";
+        return scanReport(cursor, std::min<size_t>(count, SCAN_MAX_COUNT));
+    }
+
+    /* Bad query */
+    statAdd(&stats->badQueries, 1);
+    return "error (bad query)\n";
+}
+
+//+----------------------------------------------------------------------------+
+//| Latency histograms of one worker (1..n) or of all processes (0)            |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::latencyReport(int worker) {
+
+    Stats total;
+
+    if (worker == 0) {
+        segment->collectStats(&total);
+
+    } else if (worker > 0 && static_cast<size_t>(worker) <= MAX_WORKERS) {
+        memset(&total, 0, sizeof(total));
+        for (int set = 0; set < STATS_SETS; ++set)
+            addStats(&total, segment->stats(set, STATS_WORKERS + worker - 1));
+
+    } else {
+        return "error (bad worker)\n";
+    }
+
+    return ::latencyReport(total, segment->header()->tscPerSec) + "end\n";
+}
+
+//+----------------------------------------------------------------------------+
+//| Heaviest keys over all live workers                                        |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::hotKeysReport(size_t n) {
+
+    if (!segment->hotKeys(0, 0))
+        return "error (hot keys not tracked)\n";
+
+    /* Own summary first, so the answer includes the latest requests */
+    if (hotKeys)
+        publishHotKeys();
+
+    std::vector<HotKeySummary> summaries;
+    HotKeySummary copy;
+    for (int set = 0; set < STATS_SETS; ++set) {
+        for (size_t i = 0; i < MAX_WORKERS; ++i) {
+            if (HotKeys::read(segment->hotKeys(set, i), &copy))
+                summaries.push_back(copy);
+        }
+    }
+
+    return HotKeys::report(summaries, n);
+}
+
+//+----------------------------------------------------------------------------+
+//| Keys of next slots and cursor to continue from (0 once table is done)      |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::scanReport(size_t cursor, size_t count) {
+
+    std::vector<std::string> keys;
+    size_t next;
+
+    /* Short critical section per call: workers serve requests in between */
+    if (forwarder) {
+        size_t p = hTable->slotPartition(cursor);
+        segment->lockPartition(p);
+        next = hTable->scan(cursor, count, &keys);
+        segment->unlockPartition(p);
+
+    } else {
+        if (sem_wait(semaphore) == -1) {
+            std::cout << "[sem_wait]:\t" << strerror(errno) << std::endl;
+            return "";
+        }
+        next = hTable->scan(cursor, count, &keys);
+        if (sem_post(semaphore) == -1)
+            std::cout << "[sem_post]:\t" << strerror(errno) << std::endl;
+    }
+
+    std::string out;
+    for (size_t i = 0; i < keys.size(); ++i)
+        out.append("key " + keys[i] + "\n");
+    out.append("cursor " + std::to_string(next) + "\n");
+
+    return out;
+}
+
+//+----------------------------------------------------------------------------+
+//| Append stat line                                                           |
+//+----------------------------------------------------------------------------+
+
+static void addStat(std::string *out, const char *name, uint64_t value) {
+
+    out->append("stat ");
+    out->append(name);
+    out->append(" ");
+    out->append(std::to_string(value));
+    out->append("\n");
+}
+
+//+----------------------------------------------------------------------------+
+//| Report counters summed over all processes                                  |
+//+----------------------------------------------------------------------------+
+
+std::string Worker::statsReport() {
+
+    Stats total;
+    segment->collectStats(&total);
+
+    SegmentHeader *hdr = segment->header();
+    time_t now = time(nullptr);
+
+    std::string out;
+    addStat(&out, "uptime",                 hdr->createdAt ? now - hdr->createdAt : 0);
+    addStat(&out, "generation",             hdr->generation);
+    addStat(&out, "partitions",             hTable->getPartitions());
+    addStat(&out, "gets",                   total.gets);
+    addStat(&out, "get_hits",               total.hits);
+    addStat(&out, "get_misses",             total.misses);
+    addStat(&out, "near_cache_hits",        total.nearHits);
+    addStat(&out, "sets",                   total.sets);
+    addStat(&out, "set_fail_key_too_big",   total.keyTooBig);
+    addStat(&out, "set_fail_value_too_big", total.valueTooBig);
+    addStat(&out, "set_fail_bad_ttl",       total.badTTL);
+    addStat(&out, "set_fail_no_space",      total.noSpace);
+    addStat(&out, "bad_queries",            total.badQueries);
+    addStat(&out, "expirations",            total.expirations);
+    addStat(&out, "evictions",              total.evictions);
+    addStat(&out, "live_entries",           total.live);
+    addStat(&out, "tombstones",             total.tombstones);
+    addStat(&out, "bytes_used",             total.bytes);
+    addStat(&out, "table_slots",            hTable->getTableSize());
+    addStat(&out, "table_bytes",            hTable->imageSize());
+    addStat(&out, "namespaces",             segment->namespaces());
+    addStat(&out, "curr_connections",       total.connections);
+    addStat(&out, "total_connections",      total.totalConnections);
+    addStat(&out, "output_pauses",          total.outputPauses);
+    addStat(&out, "output_limit_drops",     total.outputDrops);
+    addStat(&out, "invalidations",          total.invalidations);
+    out.append("end\n");
+
+    return out;
+}
+
+//+----------------------------------------------------------------------------+
+//| Execute query locally or forward it to owner of the key                    |
+//+----------------------------------------------------------------------------+
+
+void Worker::route(int fd, const std::string &query) {
+
+    Client *client = clients[fd];
+    if (client->captured)
+        capture->record(client->id, query);
+
+    /* Client-side caching: connection is told when keys it read change */
+    if (query == "tracking on" || query == "tracking off") {
+        if (!trackingQueue) {
+            queueResponse(fd, "error (tracking not supported)\n");
+            return;
+        }
+        setTracking(fd, query == "tracking on");
+        queueResponse(fd, "ok " + query + "\n");
+        return;
+    }
+
+    /* Named table: per connection ("use <name>") or per command ("in <name> <query>") */
+    int space = client->space;
+    std::string named;
+    const std::string *q = &query;
+    if (query.compare(0, 4, "use ") == 0 || query.compare(0, 3, "in ") == 0) {
+        std::vector<std::string> args = CParser::split(query);
+        bool use = (args[0] == "use");
+        if (args.size() < 2 || (use && args.size() != 2)) {
+            statAdd(&stats->badQueries, 1);
+            queueResponse(fd, "error (bad query)\n");
+            return;
+        }
+
+        space = segment->findNamespace(args[1]);
+        if (space == -1 && args[1] != "default") {
+            queueResponse(fd, "error (no such namespace)\n");
+            return;
+        }
+        if (use) {
+            client->space = space;
+            queueResponse(fd, "ok use " + args[1] + "\n");
+            return;
+        }
+
+        for (size_t i = 2; i < args.size(); ++i)
+            named += (i > 2 ? " " : "") + args[i];
+        q = &named;
+    }
+
+    /* Stripe locks are shared by all workers: nothing to forward */
+    if (space != -1) {
+        queueResponse(fd, spaceResponse(space, *q));
+        return;
+    }
+
+    std::string key, value;
+    int ttl;
+    bool parsed = (forwarder || client->tracking) && !CParser::parseLine(*q, &key, &value, &ttl);
+
+    /* Interest is announced before the read: no change can slip in between */
+    if (parsed && client->tracking && value.empty())
+        track(fd, key);
+
+    /* Draining workers touch other partitions themselves: owners may be gone */
+    if (parsed && forwarder && !draining) {
+        size_t owner = hTable->partitionOf(key);
+        if (owner != myPartition) {
+            uint32_t seq = client->pendingBase + client->pending.size();
+            client->pending.push_back(std::make_pair(false, std::string()));
+            if (!forwarder->send(owner, RING_REQUEST,
+                                 (static_cast<uint64_t>(client->id) << 32) | seq, *q)) {
+                client->pending.pop_back();
+                queueResponse(fd, "error (query too long)\n");
+                return;
+            }
+
+            /* Owners fall behind: stop reading until their rings drain */
+            if (forwarder->backlog() > FORWARD_MAX_PENDING && !client->throttled &&
+                client->readEvent) {
+                event_del(client->readEvent);
+                client->throttled = true;
+                throttledIds.push_back(client->id);
+            }
+            return;
+        }
+    }
+
+    bool logged;
+    std::string answer = composeResponse(*q, &logged);
+    if (logged)
+        holdForCommit(fd);
+    queueResponse(fd, answer);
+}
+
+//+----------------------------------------------------------------------------+
+//| Hold client replies until next commit                                      |
+//+----------------------------------------------------------------------------+
+
+void Worker::holdForCommit(int fd) {
+
+    if (!clients[fd]->awaitingCommit) {
+        clients[fd]->awaitingCommit = true;
+        waitingCommit.push_back(fd);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Add response behind replies still expected from other partitions           |
+//+----------------------------------------------------------------------------+
+
+void Worker::queueResponse(int fd, const std::string &resp) {
+
+    Client *client = clients[fd];
+
+    if (client->pending.empty())
+        addResponse(fd, resp);
+    else
+        client->pending.push_back(std::make_pair(true, resp));
+}
+
+//+----------------------------------------------------------------------------+
+//| Reply from partition owner arrived                                         |
+//+----------------------------------------------------------------------------+
+
+void Worker::deliver(uint64_t token, const std::string &resp) {
+
+    /* Client may have gone away meanwhile */
+    auto id = clientIds.find(static_cast<uint32_t>(token >> 32));
+    if (id == clientIds.end())
+        return;
+
+    int fd = id->second;
+    Client *client = clients[fd];
+
+    uint32_t index = static_cast<uint32_t>(token) - client->pendingBase;
+    if (index >= client->pending.size())
+        return;
+    client->pending[index] = std::make_pair(true, resp);
+
+    /* Release everything that is now in order */
+    while (!client->pending.empty() && client->pending.front().first) {
+        addResponse(fd, client->pending.front().second);
+        client->pending.pop_front();
+        client->pendingBase++;
+    }
+
+    limitOutput(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Handle requests and replies from other partition owners                    |
+//+----------------------------------------------------------------------------+
+
+void Worker::processForwarded() {
+
+    forwarder->drainNotify();
+
+    ForwardMsg msg;
+    int handled = 0;
+    while (forwarder->receive(&msg)) {
+
+        if (msg.type == RING_REQUEST) {
+            bool logged;
+            msg.type    = RING_REPLY;
+            msg.payload = composeResponse(msg.payload, &logged);
+            if (!forwarder->fits(msg.payload))
+                msg.payload = "error (reply too long)\n";
+
+            /* Same durability as for own clients */
+            if (logged)
+                heldReplies.push_back(msg);
+            else
+                forwarder->send(msg.peer, msg.type, msg.token, msg.payload);
+
+        } else {
+            deliver(msg.token, msg.payload);
+        }
+
+        /* Busy peers must not starve own clients: continue next loop pass */
+        if (++handled == RING_BATCH) {
+            event_active(ringEvent, EV_READ, 0);
+            break;
+        }
+    }
+
+    flushForwarded();
+}
+
+//+----------------------------------------------------------------------------+
+//| Wake peers, retry later if their rings are full                            |
+//+----------------------------------------------------------------------------+
+
+void Worker::flushForwarded() {
+
+    forwarder->flush();
+
+    if (!throttledIds.empty() && forwarder->backlog() * 2 <= FORWARD_MAX_PENDING) {
+        std::vector<uint32_t> ids;
+        ids.swap(throttledIds);
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto id = clientIds.find(ids[i]);
+            if (id == clientIds.end())
+                continue;
+            clients[id->second]->throttled = false;
+            resume(id->second);
+        }
+    }
+
+    if (forwarder->pending() && !evtimer_pending(retryTimer, nullptr)) {
+        struct timeval tv = { 0, 1000 };
+        evtimer_add(retryTimer, &tv);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Set up forwarding between partition owners                                 |
+//+----------------------------------------------------------------------------+
+
+void Worker::forwardVia(const std::vector<std::pair<int, int>> &pipes) {
+
+    notifyPipes = pipes;
+}
+
 //+----------------------------------------------------------------------------+
 //| Start worker process                                                       |
 //+----------------------------------------------------------------------------+
@@ -97,14 +763,19 @@ std::string Worker::composeResponse(std::string query) {
 void Worker::start() {
 
     /* Open hash table */
-    shmFile = shm_open(shmFilename.c_str(), O_RDWR);
-    if (shmFile == -1) {
-        std::cout << "[shm_open]:\t" << strerror(errno) << std::endl;
+    segment = new Segment(shmFilename);
+    if (segment->attach() == -1)
         return;
-    }
     hTable = new CHashTable();
-    if (hTable->allocate(shmFile) == -1)
+    if (segment->attachTable(hTable) == -1)
         return;
+    backlog = new Backlog(segment);
+    stats = segment->stats(slotSet, STATS_WORKERS + myID - 1);
+    hTable->setStats(stats);
+    if (segment->partitions() > 1)
+        forwarder = new Forwarder(segment, slotSet, myPartition, notifyPipes);
+    for (size_t i = 0; i < segment->namespaces(); ++i)
+        spaces.push_back(segment->namespaceTable(i));
 
     /* Open semaphore */
     semaphore = sem_open(semFile.c_str(), 0);
@@ -120,11 +791,331 @@ void Worker::start() {
     mainEvent = event_new(base, serverFd, EV_READ | EV_PERSIST, worker_cb, (void *)this);
     event_add(mainEvent, nullptr);
 
+    /* Server asks to drain with SIGTERM when it hands off to a new binary */
+    drainEvent = evsignal_new(base, SIGTERM, drain_cb, (void *)this);
+    event_add(drainEvent, nullptr);
+
+    /* Group commit timer */
+    if (aof) {
+        struct timeval tv = { commitInterval / 1000, (commitInterval % 1000) * 1000 };
+        commitTimer = event_new(base, -1, EV_PERSIST, commit_cb, (void *)this);
+        event_add(commitTimer, &tv);
+    }
+
+    /* Wake-ups from other partition owners */
+    if (forwarder) {
+        ringEvent = event_new(base, forwarder->fd(), EV_READ | EV_PERSIST, ring_cb, (void *)this);
+        event_add(ringEvent, nullptr);
+        retryTimer = evtimer_new(base, retry_cb, (void *)this);
+    }
+
+    /* Heavy hitters of this worker, refreshed for readers in other workers */
+    hotSummary = segment->hotKeys(slotSet, myID - 1);
+    if (hotKeys && hotSummary) {
+        HotKeys::reset(hotSummary);
+        struct timeval tv = { HOT_KEYS_PUBLISH_MS / 1000, (HOT_KEYS_PUBLISH_MS % 1000) * 1000 };
+        hotKeysTimer = event_new(base, -1, EV_PERSIST, hotkeys_cb, (void *)this);
+        event_add(hotKeysTimer, &tv);
+    }
+
+    /* Own changed-key queue; interest left by a previous worker in the slot is stale */
+    if (segment->hasTracking()) {
+        trackingQueue = segment->trackingQueue(slotSet, myID - 1);
+        trackingBit   = 1ULL << ((slotSet % STATS_SETS) * MAX_WORKERS + myID - 1);
+        uint64_t *interest = segment->trackingInterest();
+        for (size_t i = 0; i < VERSION_STRIPES; ++i)
+            __atomic_fetch_and(&interest[i], ~trackingBit, __ATOMIC_RELAXED);
+        shmLock(&trackingQueue->lock);
+        trackingQueue->tail     = trackingQueue->head;
+        trackingQueue->overflow = 0;
+        shmUnlock(&trackingQueue->lock);
+        trackedStripes.assign(VERSION_STRIPES, 0);
+    }
+
+    /* Trace is written in the background of the loop */
+    if (capture && capture->open() == 0) {
+        struct timeval tv = { 0, CAPTURE_FLUSH_MS * 1000 };
+        captureTimer = event_new(base, -1, EV_PERSIST, capture_cb, (void *)this);
+        event_add(captureTimer, &tv);
+    }
+
     /* Start event loop */
     printf("[worker #%d]:\tstarted\n", myID);
     event_base_dispatch(base);
 }
 
+//+----------------------------------------------------------------------------+
+//| Stop taking new clients and exit once existing ones are gone               |
+//+----------------------------------------------------------------------------+
+
+void Worker::drain() {
+
+    if (draining)
+        return;
+    draining = true;
+    printf("[worker #%d]:\tdraining %lu clients\n", myID, clients.size());
+
+    event_del(mainEvent);
+
+    if (clients.empty()) {
+        stop();
+        return;
+    }
+
+    /* Idle clients must not keep the old binary alive forever */
+    struct timeval tv = { drainTimeout, 0 };
+    drainTimer = evtimer_new(base, drained_cb, (void *)this);
+    event_add(drainTimer, &tv);
+}
+
+//+----------------------------------------------------------------------------+
+//| Leave event loop                                                           |
+//+----------------------------------------------------------------------------+
+
+void Worker::stop() {
+
+    /* Answer what peers forwarded before they started draining too */
+    if (forwarder)
+        processForwarded();
+    commit();
+    printf("[worker #%d]:\tstopped\n", myID);
+    event_base_loopexit(base, nullptr);
+}
+
+//+----------------------------------------------------------------------------+
+//| Write buffered trace records                                               |
+//+----------------------------------------------------------------------------+
+
+void Worker::flushCapture() {
+
+    capture->flush();
+}
+
+//+----------------------------------------------------------------------------+
+//| Publish heavy hitters to shared memory                                     |
+//+----------------------------------------------------------------------------+
+
+void Worker::publishHotKeys() {
+
+    if (hotSummary)
+        hotKeys->publish(hotSummary);
+}
+
+//+----------------------------------------------------------------------------+
+//| Tell tracking clients about keys other processes changed                   |
+//+----------------------------------------------------------------------------+
+
+void Worker::processInvalidations() {
+
+    /* Changes were lost (or the whole table changed): every tracked key is stale */
+    if (__atomic_exchange_n(&trackingQueue->overflow, 0, __ATOMIC_ACQ_REL)) {
+        uint64_t head = __atomic_load_n(&trackingQueue->head, __ATOMIC_ACQUIRE);
+
+        std::vector<int> notified;
+        for (auto it = clients.begin(); it != clients.end(); ++it) {
+            if (it->second->trackedKeys.empty())
+                continue;
+            it->second->trackedKeys.clear();
+            queueResponse(it->first, "invalidate *\n");
+            statAdd(&stats->invalidations, 1);
+            notified.push_back(it->first);
+        }
+
+        uint64_t *interest = segment->trackingInterest();
+        for (size_t i = 0; i < VERSION_STRIPES; ++i) {
+            if (trackedStripes[i])
+                __atomic_fetch_and(&interest[i], ~trackingBit, __ATOMIC_RELAXED);
+        }
+        trackedStripes.assign(VERSION_STRIPES, 0);
+        tracked.clear();
+
+        __atomic_store_n(&trackingQueue->tail, head, __ATOMIC_RELEASE);
+        limitNotified(notified);
+        return;
+    }
+
+    uint64_t head = __atomic_load_n(&trackingQueue->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = trackingQueue->tail;
+    std::vector<int> notified;
+    while (tail != head) {
+        const char *slot = trackingQueue->keys[tail % TRACKING_SLOTS];
+        std::string key(slot, strnlen(slot, MAX_KEY_SIZE));
+
+        /* Slot may be reused as soon as tail moves */
+        __atomic_store_n(&trackingQueue->tail, ++tail, __ATOMIC_RELEASE);
+        invalidate(key, &notified);
+    }
+
+    limitNotified(notified);
+}
+
+//+----------------------------------------------------------------------------+
+//| Turn tracking of client on or off                                          |
+//+----------------------------------------------------------------------------+
+
+void Worker::setTracking(int fd, bool on) {
+
+    Client *client = clients[fd];
+
+    if (!on) {
+        untrack(fd);
+        client->tracking = false;
+        return;
+    }
+
+    client->tracking = true;
+    if (!trackingTimer) {
+        struct timeval tv = { TRACKING_POLL_MS / 1000, (TRACKING_POLL_MS % 1000) * 1000 };
+        trackingTimer = event_new(base, -1, EV_PERSIST, tracking_cb, (void *)this);
+        event_add(trackingTimer, &tv);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Remember that client read key                                              |
+//+----------------------------------------------------------------------------+
+
+void Worker::track(int fd, const std::string &key) {
+
+    if (!clients[fd]->trackedKeys.insert(key).second)
+        return;
+
+    std::vector<int> &readers = tracked[key];
+    readers.push_back(fd);
+    if (readers.size() > 1)
+        return;
+
+    /* First reader of key in this worker: producers now push its changes */
+    size_t stripe = hTable->versionStripe(key);
+    if (trackedStripes[stripe]++ == 0)
+        __atomic_fetch_or(&segment->trackingInterest()[stripe], trackingBit, __ATOMIC_SEQ_CST);
+
+    /* Bounded memory: some other key is given up early */
+    if (tracked.size() > TRACKING_MAX_KEYS) {
+        auto victim = tracked.begin();
+        if (victim->first == key)
+            ++victim;
+
+        /* Reader of this query is limited by processQueries itself */
+        std::vector<int> notified;
+        invalidate(std::string(victim->first), &notified);
+        limitNotified(notified, fd);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Drop keys tracked for client                                               |
+//+----------------------------------------------------------------------------+
+
+void Worker::untrack(int fd) {
+
+    Client *client = clients[fd];
+
+    for (auto it = client->trackedKeys.begin(); it != client->trackedKeys.end(); ++it) {
+        auto readers = tracked.find(*it);
+        if (readers == tracked.end())
+            continue;
+
+        std::vector<int> &fds = readers->second;
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i] == fd) {
+                fds[i] = fds.back();
+                fds.pop_back();
+                break;
+            }
+        }
+        if (fds.empty())
+            forget(*it);
+    }
+    client->trackedKeys.clear();
+}
+
+//+----------------------------------------------------------------------------+
+//| Send invalidation of key to its readers (tracking is one-shot)             |
+//+----------------------------------------------------------------------------+
+
+void Worker::invalidate(const std::string &key, std::vector<int> *notified) {
+
+    auto readers = tracked.find(key);
+    if (readers == tracked.end())
+        return;
+
+    const std::vector<int> &fds = readers->second;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        clients[fds[i]]->trackedKeys.erase(key);
+        queueResponse(fds[i], "invalidate " + key + "\n");
+        statAdd(&stats->invalidations, 1);
+        notified->push_back(fds[i]);
+    }
+
+    forget(key);
+}
+
+//+----------------------------------------------------------------------------+
+//| Apply output limits to clients sent invalidations (may close some)         |
+//+----------------------------------------------------------------------------+
+
+void Worker::limitNotified(const std::vector<int> &notified, int except) {
+
+    for (size_t i = 0; i < notified.size(); ++i) {
+        /* Client may be listed twice and dropped the first time */
+        if (notified[i] != except && clients.find(notified[i]) != clients.end())
+            limitOutput(notified[i]);
+    }
+}
+
+//+----------------------------------------------------------------------------+
+//| Stop tracking key nobody here reads any more                               |
+//+----------------------------------------------------------------------------+
+
+void Worker::forget(const std::string &key) {
+
+    size_t stripe = hTable->versionStripe(key);
+    if (--trackedStripes[stripe] == 0)
+        __atomic_fetch_and(&segment->trackingInterest()[stripe], ~trackingBit, __ATOMIC_RELAXED);
+
+    tracked.erase(key);
+}
+
+//+----------------------------------------------------------------------------+
+//| Commit logged sets and release replies waiting for them                    |
+//+----------------------------------------------------------------------------+
+
+void Worker::commit() {
+
+    if (!aof || aof->empty())
+        return;
+
+    /* Sets that are not on disk must not be acknowledged: retry next tick */
+    int partition = forwarder ? static_cast<int>(myPartition) : -1;
+    if (aof->commit(segment->header(), semaphore, partition) == -1) {
+        printf("[worker #%d]:\tappend-only log commit failed, holding replies\n", myID);
+        return;
+    }
+
+    /* Replies to other partition owners */
+    if (!heldReplies.empty()) {
+        for (size_t i = 0; i < heldReplies.size(); ++i) {
+            const ForwardMsg &msg = heldReplies[i];
+            forwarder->send(msg.peer, msg.type, msg.token, msg.payload);
+        }
+        heldReplies.clear();
+        flushForwarded();
+    }
+
+    for (size_t i = 0; i < waitingCommit.size(); ++i) {
+        int fd = waitingCommit[i];
+        auto it = clients.find(fd);
+        if (it == clients.end() || !it->second->awaitingCommit)
+            continue;
+
+        it->second->awaitingCommit = false;
+        if (!it->second->outBuf.empty())
+            enableWriting(fd);
+    }
+    waitingCommit.clear();
+}
+
 //+----------------------------------------------------------------------------+
 //| Add client to worker                                                       |
 //+----------------------------------------------------------------------------+
@@ -138,7 +1129,12 @@ void Worker::addClient(int fd) {
     ev = event_new(base, fd, EV_READ | EV_PERSIST, read_cb, (void *)this);
     event_add(ev, nullptr);
 
-    clients[fd] = new Client(ev, nullptr);
+    uint32_t id = nextClientId++;
+    clients[fd] = new Client(ev, nullptr, id);
+    clients[fd]->captured = capture && capture->sample();
+    clientIds[id] = fd;
+    statAdd(&stats->connections, 1);
+    statAdd(&stats->totalConnections, 1);
     printf("[worker #%d]:\tnew client (%d)\n", myID, fd);
 }
 
@@ -150,10 +1146,16 @@ void Worker::closeClient(int fd) {
 
     assert(clients.find(fd) != clients.end());
 
+    untrack(fd);
+    clientIds.erase(clients[fd]->id);
+    statSub(&stats->connections, 1);
     delete clients[fd];
     clients.erase(fd);
     close(fd);
     printf("[worker #%d]:\tclient (%d) closed\n", myID, fd);
+
+    if (draining && clients.empty())
+        stop();
 }
 
 //+----------------------------------------------------------------------------+
@@ -162,51 +1164,11 @@ void Worker::closeClient(int fd) {
 
 int Worker::receiveDescriptor(int parent) {
 
-    int client_fd;
-    ssize_t size;
-
-    int  BUF_LEN = 1;
-    char buf[BUF_LEN];
-
-    struct msghdr msg;
-    struct iovec  iov;
-    union {
-        struct cmsghdr cmsghdr;
-        char control[CMSG_SPACE(sizeof(int))];
-    } cmsgu;
-    struct cmsghdr *cmsg;
-
-    iov.iov_base = (void *)buf;
-    iov.iov_len  = BUF_LEN;
-
-    msg.msg_name    = nullptr;
-    msg.msg_namelen = 0;
-    msg.msg_iov     = &iov;
-    msg.msg_iovlen  = 1;
-    msg.msg_control = cmsgu.control;
-    msg.msg_controllen = sizeof(cmsgu.control);
-
-    size = recvmsg(parent, &msg, 0);
-    if (size < 0) {
-        std::cout << "[recvmsg]:\t" << strerror(errno) << std::endl;
+    int client_fd = ::receiveDescriptor(parent);
+    if (client_fd == -2) {
+        printf("[worker #%d]:\tlost connection to server\n", myID);
         exit(1);
     }
-    cmsg = CMSG_FIRSTHDR(&msg);
-    if (cmsg && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
-        if (cmsg->cmsg_level != SOL_SOCKET) {
-            printf("[worker #%d]:\tinvalid cmsg_level %d\n", myID, cmsg->cmsg_level);
-            exit(1);
-        }
-        if (cmsg->cmsg_type != SCM_RIGHTS) {
-            printf("[worker #%d]:\tinvalid cmsg_type %d\n", myID, cmsg->cmsg_type);
-            exit(1);
-        }
-
-        client_fd = *((int *)CMSG_DATA(cmsg));
-
-    } else {
-        client_fd = -1;
-    }
 
     return client_fd;
 }
@@ -222,6 +1184,16 @@ void Worker::addResponse(int fd, std::string resp) {
 
     clients[fd]->outBuf.append(resp);
 
+    if (!clients[fd]->awaitingCommit)
+        enableWriting(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Start watching client socket for writing                                   |
+//+----------------------------------------------------------------------------+
+
+void Worker::enableWriting(int fd) {
+
     if (!clients[fd]->writeEvent) {
         /* Add write event */
         struct event *ev;
@@ -232,6 +1204,19 @@ void Worker::addResponse(int fd, std::string resp) {
     }
 }
 
+//+----------------------------------------------------------------------------+
+//| Stop watching client socket for writing                                    |
+//+----------------------------------------------------------------------------+
+
+void Worker::disableWriting(int fd) {
+
+    if (clients[fd]->writeEvent) {
+        event_del(clients[fd]->writeEvent);
+        event_free(clients[fd]->writeEvent);
+        clients[fd]->writeEvent = nullptr;
+    }
+}
+
 //+----------------------------------------------------------------------------+
 //| Get response to the client                                                 |
 //+----------------------------------------------------------------------------+
@@ -240,8 +1225,13 @@ std::string Worker::getResponse(int fd) {
 
     assert(clients.find(fd) != clients.end());
 
-    std::string outBuf = clients[fd]->outBuf;
-    clients[fd]->outBuf.clear();
+    Client *client = clients[fd];
+
+    /* Take buffer over instead of copying it */
+    std::string outBuf;
+    outBuf.swap(client->outBuf);
+    outBuf.erase(0, client->outPos);
+    client->outPos = 0;
 
     return outBuf;
 }
@@ -256,17 +1246,82 @@ void Worker::pushToInBuf(int fd, std::string str) {
     assert(clients.find(fd) != clients.end());
 
     clients[fd]->inBuf.append(str);
-    int pos = clients[fd]->inBuf.find('\n');
+    processQueries(fd);
+}
+
+//+----------------------------------------------------------------------------+
+//| Answer complete queries of in buffer until output is over the soft limit   |
+//+----------------------------------------------------------------------------+
+
+void Worker::processQueries(int fd) {
+
+    Client *client = clients[fd];
+    size_t start = 0;
+    size_t pos = client->inBuf.find('\n');
 
     /* Compose response */
-    while (pos != std::string::npos) {
+    while (pos != std::string::npos && !client->paused && !client->throttled) {
 
-        std::string query = clients[fd]->inBuf.substr(0, pos);
-        clients[fd]->inBuf = clients[fd]->inBuf.substr(pos + 1);
-        addResponse(fd, composeResponse(query));
+        std::string query = client->inBuf.substr(start, pos - start);
+        start = pos + 1;
+        route(fd, query);
 
-        pos = clients[fd]->inBuf.find('\n');
+        /* Client may be dropped for unsent replies */
+        if (!limitOutput(fd))
+            break;
+
+        pos = client->inBuf.find('\n', start);
+    }
+
+    if (clients.find(fd) != clients.end())
+        client->inBuf.erase(0, start);
+
+    /* One wake-up per owner for the whole batch */
+    if (forwarder)
+        flushForwarded();
+}
+
+//+----------------------------------------------------------------------------+
+//| Pause reading over soft output limit, drop client over hard limit          |
+//+----------------------------------------------------------------------------+
+
+bool Worker::limitOutput(int fd) {
+
+    Client *client = clients[fd];
+    size_t unsent = client->outBuf.size() - client->outPos;
+
+    if (outputHardLimit && unsent > outputHardLimit) {
+        statAdd(&stats->outputDrops, 1);
+        printf("[worker #%d]:\tclient (%d) has %lu unsent bytes, dropping it\n",
+               myID, fd, unsent);
+        closeClient(fd);
+        return false;
     }
+
+    /* Socket buffer keeps the rest: no need to read until the client catches up */
+    if (outputSoftLimit && unsent > outputSoftLimit && !client->paused && client->readEvent) {
+        event_del(client->readEvent);
+        client->paused = true;
+        statAdd(&stats->outputPauses, 1);
+    }
+
+    return true;
+}
+
+//+----------------------------------------------------------------------------+
+//| Read again from client once nothing holds it back                          |
+//+----------------------------------------------------------------------------+
+
+void Worker::resume(int fd) {
+
+    Client *client = clients[fd];
+    if (client->paused || client->throttled)
+        return;
+
+    event_add(client->readEvent, nullptr);
+
+    /* Queries read before the pause */
+    processQueries(fd);
 }
 
 //+----------------------------------------------------------------------------+
@@ -278,23 +1333,58 @@ void Worker::answer(int fd) {
     assert(clients.find(fd) != clients.end());
     assert(!clients[fd]->outBuf.empty());
 
-    std::string resp = clients[fd]->outBuf;
-    printf("[worker #%d]:\t%s", myID, resp.c_str());
-    ssize_t sent = send(fd, resp.c_str(), resp.size() + 1, 0);
+    /* Write event was already on when a logged set got queued */
+    if (clients[fd]->awaitingCommit) {
+        disableWriting(fd);
+        return;
+    }
 
-    if (sent > 0) {
+    /* Batch ends with the terminator kept after the buffer */
+    Client *client = clients[fd];
+    const char *resp = client->outBuf.c_str() + client->outPos;
+    size_t size = client->outBuf.size() - client->outPos + 1;
 
-        if (sent == resp.size() + 1) {
-            /* Clear outBuf */
-            clients[fd]->outBuf.clear();
-            /* Remove write event for client */
-            finishWriting(fd);
+    #ifdef _DEBUG_MODE_
+    printf("[worker #%d]:\t%s", myID, resp);
+    #endif /* _DEBUG_MODE_ */
 
-        } else {
-            /* Decrease string size */
-            clients[fd]->outBuf = clients[fd]->outBuf.substr(sent);
+    uint64_t start = readTSC();
+    ssize_t sent = send(fd, resp, size, 0);
+    recordLatency(stats, LAT_SEND, start);
+
+    if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        /* Paused client is only watched for writing: this is where it goes away */
+        std::cout << "[send]:\t" << strerror(errno) << std::endl;
+        closeClient(fd);
+        return;
+    }
+    if (sent <= 0)
+        return;
+
+    if (static_cast<size_t>(sent) == size) {
+        /* Clear outBuf */
+        client->outBuf.clear();
+        client->outPos = 0;
+        /* Remove write event for client */
+        finishWriting(fd);
+        if (clients.find(fd) == clients.end())
+            return;
+
+    } else {
+        /* Sent head is dropped once it is most of the buffer: no copy per send
+           (kept while only the terminator is left, so it still goes out) */
+        client->outPos += sent;
+        if (client->outPos > client->outBuf.size() / 2 && client->outPos < client->outBuf.size()) {
+            client->outBuf.erase(0, client->outPos);
+            client->outPos = 0;
         }
     }
+
+    /* Resume below half the soft limit, so pauses don't flap */
+    if (client->paused && (client->outBuf.size() - client->outPos) * 2 <= outputSoftLimit) {
+        client->paused = false;
+        resume(fd);
+    }
 }
 
 //+----------------------------------------------------------------------------+
@@ -309,7 +1399,8 @@ void Worker::finishReading(int fd) {
     event_free(clients[fd]->readEvent);
     clients[fd]->readEvent = nullptr;
 
-    if (!clients[fd]->writeEvent) {
+    if (!clients[fd]->writeEvent && !clients[fd]->awaitingCommit &&
+        clients[fd]->pending.empty()) {
         /* Close client */
         closeClient(fd);
     }
@@ -322,12 +1413,9 @@ void Worker::finishReading(int fd) {
 void Worker::finishWriting(int fd) {
 
     assert(clients.find(fd) != clients.end());
-    event_del(clients[fd]->writeEvent);
+    disableWriting(fd);
 
-    event_free(clients[fd]->writeEvent);
-    clients[fd]->writeEvent = nullptr;
-
-    if (!clients[fd]->readEvent) {
+    if (!clients[fd]->readEvent && clients[fd]->pending.empty()) {
         /* Close client */
         closeClient(fd);
     }
@@ -351,6 +1439,42 @@ void worker_cb(evutil_socket_t evs, short events, void *ptr) {
     }
 }
 
+//+----------------------------------------------------------------------------+
+//| Drain signal callback                                                      |
+//+----------------------------------------------------------------------------+
+
+void drain_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->drain();
+}
+
+//+----------------------------------------------------------------------------+
+//| Drain timeout callback                                                     |
+//+----------------------------------------------------------------------------+
+
+void drained_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->stop();
+}
+
+//+----------------------------------------------------------------------------+
+//| Group commit timer callback                                                |
+//+----------------------------------------------------------------------------+
+
+void commit_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->commit();
+}
+
 //+----------------------------------------------------------------------------+
 //| Read callback                                                              |
 //+----------------------------------------------------------------------------+
@@ -390,4 +1514,64 @@ void write_cb(evutil_socket_t evs, short events, void *ptr) {
 
     /* Answer with a string from outBuf */
     wrk->answer(evs);
+}
+
+//+----------------------------------------------------------------------------+
+//| Partition owner wake-up callback                                           |
+//+----------------------------------------------------------------------------+
+
+void ring_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->processForwarded();
+}
+
+//+----------------------------------------------------------------------------+
+//| Full ring retry callback                                                   |
+//+----------------------------------------------------------------------------+
+
+void retry_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->processForwarded();
+}
+
+//+----------------------------------------------------------------------------+
+//| Trace flush timer callback                                                 |
+//+----------------------------------------------------------------------------+
+
+void capture_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->flushCapture();
+}
+
+//+----------------------------------------------------------------------------+
+//| Heavy hitter publish timer callback                                        |
+//+----------------------------------------------------------------------------+
+
+void hotkeys_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->publishHotKeys();
+}
+
+//+----------------------------------------------------------------------------+
+//| Changed-key poll timer callback                                            |
+//+----------------------------------------------------------------------------+
+
+void tracking_cb(evutil_socket_t evs, short events, void *ptr) {
+
+    /* Last parameter is a worker object */
+    Worker *wrk = (Worker *)ptr;
+
+    wrk->processInvalidations();
 }
\ No newline at end of file
@@ -1,18 +1,44 @@
 #ifndef __WORKER_H__
 #define __WORKER_H__
 
+#include "aof.h"
+#include "capture.h"
+#include "compress.h"
+#include "config.h"
+#include "descriptor.h"
+#include "forwarder.h"
 #include "parser.h"
+#include "hotkeys.h"
 #include "htable.h"
+#include "nearcache.h"
+#include "replication.h"
+#include "segment.h"
 #include <assert.h>
 #include <event.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h> /* close */
 #include <semaphore.h>
+#include <deque>
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <utility>
 
-static const int BUF_SIZE = 1024;
+static const int BUF_SIZE   = 1024;
+
+/* Forwarded messages handled per wake-up before yielding to clients */
+static const int RING_BATCH = 256;
+
+/* Slots a scan visits per call by default and at most (bounds lock hold) */
+static const size_t SCAN_COUNT     = 64;
+static const size_t SCAN_MAX_COUNT = 1024;
+
+/* Changed keys are picked up this often; more tracked keys evict one */
+static const int    TRACKING_POLL_MS  = 10;
+static const size_t TRACKING_MAX_KEYS = 65536;
 
 //+----------------------------------------------------------------------------+
 //| Client class                                                               |
@@ -24,14 +50,47 @@ public:
     struct event *readEvent;
     struct event *writeEvent;
 
-    /* In/out buffers */
+    /* In/out buffers: unsent replies start at outPos */
     std::string inBuf;
     std::string outBuf;
+    size_t      outPos;
+
+    /* Reading stops while unsent replies are over the soft limit, and
+       while messages to partition owners back up */
+    bool paused;
+    bool throttled;
+
+    /* Replies are held until logged sets are on disk */
+    bool awaitingCommit;
+
+    /* Replies in query order; forwarded ones fill in when owner answers */
+    uint32_t id;
+    std::deque<std::pair<bool, std::string>> pending;
+    uint32_t pendingBase;
+
+    /* Requests go to trace */
+    bool captured;
+
+    /* Named table of "use" (-1 = default table) */
+    int space;
+
+    /* "tracking on": keys read since their last invalidation */
+    bool tracking;
+    std::unordered_set<std::string> trackedKeys;
 
     Client();
-    Client(struct event *readEv, struct event *writeEv) :
+    Client(struct event *readEv, struct event *writeEv, uint32_t id) :
         readEvent(readEv),
-        writeEvent(writeEv) {}
+        writeEvent(writeEv),
+        outPos(0),
+        paused(false),
+        throttled(false),
+        awaitingCommit(false),
+        id(id),
+        pendingBase(0),
+        captured(false),
+        space(-1),
+        tracking(false) {}
     ~Client();
 };
 
@@ -50,23 +109,141 @@ class Worker {
 
     /* Shared memory */
     std::string   shmFilename;
-    int           shmFile;
+    Segment       *segment;
     CHashTable    *hTable;
     std::string   semFile;
     sem_t         *semaphore;
 
-    std::string composeResponse(std::string query);
+    /* Draining after hand-off to a new server */
+    struct event  *drainEvent;
+    struct event  *drainTimer;
+    int           drainTimeout;
+    bool          draining;
+
+    /* Append-only log with group commit */
+    AppendLog     *aof;
+    struct event  *commitTimer;
+    int           commitInterval;
+    std::vector<int> waitingCommit;
+
+    /* Replication */
+    Backlog       *backlog;
+    bool          readOnly;
+
+    /* Counters in shared memory */
+    Stats         *stats;
+    uint64_t      lockedAt;
+
+    /* Shared-nothing mode: own partition, forward other keys to owners */
+    size_t        myPartition;
+    int           slotSet;
+    std::vector<std::pair<int, int>> notifyPipes;
+    Forwarder     *forwarder;
+    struct event  *ringEvent;
+    struct event  *retryTimer;
+    std::vector<ForwardMsg> heldReplies;
+    std::vector<uint32_t> throttledIds;
+    uint32_t      nextClientId;
+    std::unordered_map<uint32_t, int> clientIds;
+
+    /* Answers to hot gets, valid while their key stripe version holds */
+    NearCache     *nearCache;
+
+    /* Heavy hitters, published to shared memory for the hotkeys command */
+    HotKeys       *hotKeys;
+    HotKeySummary *hotSummary;
+    struct event  *hotKeysTimer;
+
+    /* Values at least this long are stored compressed (0 = off) */
+    size_t        compressThreshold;
+
+    /* Named tables by segment index, locked by stripe */
+    std::vector<CHashTable *> spaces;
+
+    /* Unsent reply bytes that pause reading and drop client (0 = no limit) */
+    size_t        outputSoftLimit;
+    size_t        outputHardLimit;
+
+    /* Sampled request trace */
+    Capture       *capture;
+    struct event  *captureTimer;
+
+    /* Invalidation tracking: tracking clients by key, tracked keys per
+       stripe (own interest bit is set while non-zero), changed keys queue */
+    std::unordered_map<std::string, std::vector<int>> tracked;
+    std::vector<uint32_t> trackedStripes;
+    TrackingQueue *trackingQueue;
+    uint64_t      trackingBit;
+    struct event  *trackingTimer;
+
+    int         lock(const std::string &key);
+    int         unlock(const std::string &key);
+    std::string composeResponse(std::string query, bool *logged);
+    std::string spaceResponse(size_t space, const std::string &query);
+    int         encode(std::string *value, std::string *original);
+    void        countSet(int status);
+    std::string expand(const std::string &key, const std::string &answer);
+    std::string command(const std::string &query);
+    std::string statsReport();
+    std::string latencyReport(int worker);
+    std::string hotKeysReport(size_t n);
+    std::string scanReport(size_t cursor, size_t count);
+    int         parse(const std::string &query, std::string *key, std::string *value, int *ttl);
+    void        route(int fd, const std::string &query);
+    void        holdForCommit(int fd);
+    void        queueResponse(int fd, const std::string &resp);
+    void        deliver(uint64_t token, const std::string &resp);
+    void        flushForwarded();
+    void        enableWriting(int fd);
+    void        disableWriting(int fd);
+    void        processQueries(int fd);
+    bool        limitOutput(int fd);
+    void        resume(int fd);
+    void        setTracking(int fd, bool on);
+    void        track(int fd, const std::string &key);
+    void        untrack(int fd);
+    void        invalidate(const std::string &key, std::vector<int> *notified);
+    void        limitNotified(const std::vector<int> &notified, int except = -1);
+    void        forget(const std::string &key);
 
 public:
-    Worker(int id, int fd, std::string shm, std::string sem)
-        : myID(id), serverFd(fd), shmFilename(shm), semFile(sem) {}
+    Worker(int id, int fd, const Config &config)
+        : myID(id), serverFd(fd), shmFilename(config.shmFilename),
+          segment(nullptr), hTable(nullptr), semFile(config.semFile),
+          semaphore(nullptr), drainEvent(nullptr), drainTimer(nullptr),
+          drainTimeout(config.drainTimeout), draining(false),
+          aof(config.aofPath.empty() ? nullptr : new AppendLog(config.aofPath)),
+          commitTimer(nullptr), commitInterval(config.aofCommitMs),
+          backlog(nullptr), readOnly(!config.replicaOf.empty()),
+          stats(nullptr), lockedAt(0), myPartition(id - 1), slotSet(0), forwarder(nullptr),
+          ringEvent(nullptr), retryTimer(nullptr), nextClientId(0),
+          nearCache(config.nearCache ? new NearCache(config.nearCache) : nullptr),
+          hotKeys(config.hotKeys ? new HotKeys(config.hotKeys) : nullptr),
+          hotSummary(nullptr), hotKeysTimer(nullptr),
+          compressThreshold(config.compressThreshold),
+          outputSoftLimit(config.outputSoftLimit), outputHardLimit(config.outputHardLimit),
+          capture(config.capturePath.empty() ? nullptr
+                  : new Capture(config.capturePath, config.captureBinary, config.captureRate)),
+          captureTimer(nullptr),
+          trackingQueue(nullptr), trackingBit(0), trackingTimer(nullptr) {}
     ~Worker();
 
+    /* Generation's rings and counters, wake-up pipes of owners (before start) */
+    void useSlots(int set) { slotSet = set; }
+    void forwardVia(const std::vector<std::pair<int, int>> &pipes);
+
     /* Worker methods */
     void start();
+    void drain();
+    void stop();
+    void commit();
     void addClient(int fd);
     void closeClient(int fd);
     int  receiveDescriptor(int parent);
+    void processForwarded();
+    void flushCapture();
+    void publishHotKeys();
+    void processInvalidations();
 
     /* Add and get response (= out buffer) */
     void        addResponse(int fd, std::string resp);
@@ -90,6 +267,14 @@ typedef std::vector<std::pair<pid_t, int>> ServWorkers;
 //+----------------------------------------------------------------------------+
 
 void worker_cb(evutil_socket_t evs, short events, void *ptr);
+void drain_cb (evutil_socket_t evs, short events, void *ptr);
+void drained_cb(evutil_socket_t evs, short events, void *ptr);
+void commit_cb(evutil_socket_t evs, short events, void *ptr);
+void ring_cb  (evutil_socket_t evs, short events, void *ptr);
+void retry_cb (evutil_socket_t evs, short events, void *ptr);
+void capture_cb(evutil_socket_t evs, short events, void *ptr);
+void hotkeys_cb(evutil_socket_t evs, short events, void *ptr);
+void tracking_cb(evutil_socket_t evs, short events, void *ptr);
 void read_cb  (evutil_socket_t evs, short events, void *ptr);
 void write_cb (evutil_socket_t evs, short events, void *ptr);
 